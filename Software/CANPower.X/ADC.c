@@ -0,0 +1,160 @@
+/*
+ * File:   ADC.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * ADC driver for the switch chip current sense output (CSNS on AN10).
+ * See ADC.h.
+ *
+ * The ADC is triggered by the timer 3 period match (SSRC) and samples automatically again after each
+ * conversion so each conversion is of the voltage at the end of a timer 3 period. DMA channel 2 moves
+ * ADC1BUF0 to the two block buffers in continuous ping-pong mode. Its interrupt at the end of each block
+ * adds the block to the sum for the period, which is published once ADC_PERIOD_BLOCKS blocks have been
+ * added. After a start or restart the block in progress and then ADC_SETTLING_BLOCKS are discarded.
+ *
+ * The period sum is read and its flag cleared with the interrupts disabled so that it can't be
+ * overwritten part way through.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ADC.h"
+#include "interrupts.h"
+#include "xc.h"
+
+
+#define CSNS_INPUT 10 // AN10
+#define BLOCK_SAMPLES 64 // samples per DMA block - a DMA interrupt each (2.1ms)
+#define ADC_PERIOD_BLOCKS (ADC_PERIOD_SAMPLES / BLOCK_SAMPLES)
+#define ADC_SETTLING_BLOCKS 1 // whole blocks discarded after a restart for the current sense output to settle
+
+#if (ADC_PERIOD_BLOCKS * BLOCK_SAMPLES) != ADC_PERIOD_SAMPLES
+#error "A PWM period must be a whole number of DMA blocks"
+#endif
+#if (BLOCK_SAMPLES * (ADC_FULL_SCALE - 1)) > 0xFFFF
+#error "A block of samples must sum to 16 bits"
+#endif
+
+// ADC settings
+#define TRIGGER_TIMER3 0b010 // conversion at the timer 3 period match
+#define CONVERSION_CLOCK 1 // TAD = 2 TCY (125ns) - at least the 75ns minimum for 10 bit conversions
+#define DMA_REQUEST_ADC1 0x000D
+
+static uint16_t buffer_a[BLOCK_SAMPLES] __attribute__((space(dma)));
+static uint16_t buffer_b[BLOCK_SAMPLES] __attribute__((space(dma)));
+
+static uint8_t skip; // blocks still to be discarded
+static uint8_t blocks; // added to the sum so far
+static uint32_t accumulator; // of the period so far
+static uint32_t period_sum; // of the last whole period
+static volatile bool period_ready; // period_sum hasn't been fetched yet
+
+
+/* Must be called once at initialisation time prior to using any functionality
+ * of the ADC module. Hardware ports must have been initialised first. */
+void InitializeADC(void)
+{
+    AD1CON1bits.ADON = 0;
+    AD1CON1bits.ADSIDL = 0; // don't stop on idle
+    AD1CON1bits.ADDMABM = 1; // DMA buffers written in the order of conversion
+    AD1CON1bits.AD12B = 0; // 10 bit
+    AD1CON1bits.FORM = 0b00; // integer
+    AD1CON1bits.SSRC = TRIGGER_TIMER3;
+    AD1CON1bits.ASAM = 1; // sampling starts again after each conversion
+    AD1CON2 = 0; // AVDD and AVSS references, channel 0 only, no scanning
+    AD1CON2bits.SMPI = 0; // DMA address incremented after every conversion
+    AD1CON3bits.ADRC = 0; // clock derived from the system clock
+    AD1CON3bits.ADCS = CONVERSION_CLOCK;
+    AD1CON4bits.DMABL = 0; // one word of buffer per input
+    AD1CHS0 = 0;
+    AD1CHS0bits.CH0SA = CSNS_INPUT;
+
+    // DMA channel 2 - ADC1BUF0 to the buffers in turn
+    DMA2CONbits.CHEN = 0;
+    DMA2CON = 0x0002; // word, peripheral to RAM, post-increment, continuous ping-pong
+    DMA2PAD = (uint16_t) &ADC1BUF0;
+    DMA2REQ = DMA_REQUEST_ADC1;
+    DMA2CNT = BLOCK_SAMPLES - 1;
+    DMA2STA = __builtin_dmaoffset(buffer_a);
+    DMA2STB = __builtin_dmaoffset(buffer_b);
+    _DMA2IF = 0;
+    _DMA2IP = ADC_INTERRUPT_PRIORITY;
+    _DMA2IE = 1;
+    DMA2CONbits.CHEN = 1;
+    period_ready = false;
+}
+
+
+/* Turns the ADC on and starts a new period of samples */
+void ADCStart(void)
+{
+    ADCRestart();
+    AD1CON1bits.ADON = 1;
+}
+
+
+/* Turns the ADC off */
+void ADCStop(void)
+{
+    AD1CON1bits.ADON = 0;
+}
+
+
+/* Discards the samples so far and starts a new period after the current sense output has had time to settle */
+void ADCRestart(void)
+{
+    __builtin_disi(0x3FFF);
+    skip = 1 + ADC_SETTLING_BLOCKS; // the block in progress has samples from before
+    blocks = 0;
+    accumulator = 0;
+    period_ready = false;
+    DISICNT = 0;
+}
+
+
+/* Returns true if a whole switch output PWM period of samples has been taken since the last time
+ * this function returned true (or the last restart). If so the sum of the conversions is returned. */
+bool ADCPeriod(uint32_t *const sum)
+{
+    if (!period_ready)
+    {
+        return false;
+    }
+    __builtin_disi(0x3FFF);
+    *sum = period_sum;
+    period_ready = false;
+    DISICNT = 0;
+    return true;
+}
+
+
+// Interrupt service DMA channel 2 - a block of conversions done. The channel has already gone on to
+// the other buffer so it is the one that isn't selected (PPST2) that is done.
+void __attribute__((interrupt(no_auto_psv))) _DMA2Interrupt(void)
+{
+    const uint16_t *samples = DMACS1bits.PPST2 ? buffer_a : buffer_b;
+    uint16_t sum = 0;
+    uint8_t i;
+    for (i=0; i<BLOCK_SAMPLES; ++i)
+    {
+        sum += samples[i];
+    }
+    if (skip > 0)
+    {
+        --skip;
+    }
+    else
+    {
+        accumulator += sum;
+        if (++blocks == ADC_PERIOD_BLOCKS)
+        {
+            period_sum = accumulator;
+            period_ready = true;
+            accumulator = 0;
+            blocks = 0;
+        }
+    }
+    _DMA2IF = 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * File:   ADC.h
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * ADC driver for the switch chip current sense output (CSNS on AN10).
+ * Must be initialised before first use after the ports have been initialised.
+ *
+ * A conversion is triggered at the end of every timer 3 period - twice per switch chip PWM clock (see
+ * hardware.h) - so whole switch output PWM periods of samples are summed with no beat between the sampling
+ * and the PWM. The samples are moved by DMA channel 2 in ping-pong blocks and summed a block at a time in
+ * the DMA interrupt, so there is no CPU involvement per sample.
+ *
+ * The ADC only runs between ADCStart and ADCStop, and only converts while timer 3 is running.
+ *
+ */
+
+#ifndef ADC_H
+#define	ADC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+#define ADC_FULL_SCALE 1024 // 10 bit conversions
+#define ADC_REFERENCE_MV 3300 // AVDD
+#define ADC_PERIOD_SAMPLES 512 // timer 3 periods in a switch output PWM period - 2 per PWM clock, 256 PWM clocks
+
+
+/* Must be called once at initialisation time prior to using any functionality
+ * of the ADC module. Hardware ports must have been initialised first. */
+void InitializeADC(void);
+
+
+/* Turns the ADC on and starts a new period of samples */
+void ADCStart(void);
+
+
+/* Turns the ADC off */
+void ADCStop(void);
+
+
+/* Discards the samples so far and starts a new period after the current sense output has had
+ * time to settle - e.g. after the current sense has been switched to the other channel */
+void ADCRestart(void);
+
+
+/* Returns true if a whole switch output PWM period of samples has been taken since the last time
+ * this function returned true (or the last restart). If so the sum of the ADC_PERIOD_SAMPLES conversions
+ * is returned - the average in ADC counts with 9 extra bits of resolution. */
+bool ADCPeriod(uint32_t *const sum);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* ADC_H */
@@ -27,6 +27,7 @@
 #include "hardware.h"
 #include "ports.h"
 #include "interrupts.h"
+#include "events.h"
 #include "xc.h"
 
 
@@ -79,15 +80,37 @@ bool CANAmbient(void) {return message_attributes.ambient;}
 bool CANKickstand(void) {return message_attributes.kickstand;}
 uint8_t CANCounter(void) {return message_attributes.counter;}
 
-// keeps track of when the most recent message was received
-static bool can_ecu_received;
-
-/* Returns true if a CAN message has been received from the ECU the last time this function was called */
+/* Returns true if a CAN message has been received from the ECU since the last time this function was called.
+ * Fetches (and so clears) the ECU event. */
 bool CanEcuReceived(void)
 {
-    bool return_value = can_ecu_received;
-    can_ecu_received = false;
-    return return_value;
+    return EventsFetch(EVENT_CAN_ECU) != 0;
+}
+
+
+// the data of the last frame of each of the logged messages and a bit per message set if it's new
+static uint16_t frames[CAN_LOGGED_MESSAGES][4];
+static volatile uint16_t new_frames;
+
+/* Returns true if a frame of the message has been received since the last time this function was called for it.
+ * If so the message identifier and the four data words (data byte 0 in the low byte of the first) are returned. */
+bool CANFrame(const uint8_t message, uint16_t *const identifier, uint16_t data[4])
+{
+    uint8_t i;
+    if ((new_frames & (1 << message)) == 0)
+    {
+        return false;
+    }
+    // the copy must not be interleaved with another frame of the message
+    __builtin_disi(0x3FFF);
+    for (i=0; i<4; ++i)
+    {
+        data[i] = frames[message][i];
+    }
+    new_frames &= ~(1 << message);
+    DISICNT = 0;
+    *identifier = identifiers[message];
+    return true;
 }
 
 
@@ -125,7 +148,7 @@ static DMA_BUFFER_t dma_buffers[NUMBER_OF_BUFFERS] __attribute__((space(dma),ali
 void InitializeCAN(void)
 {
     message_attributes = initial_attribute_values;
-    can_ecu_received = false;
+    new_frames = 0;
 
     PORT_CAN_STBY = CAN_ACTIVE;
 
@@ -270,16 +293,25 @@ void __attribute__((interrupt(no_auto_psv))) _C1Interrupt(void)
             // data byte 5 is at buffer[5] high byte
             // data byte 6 is at buffer[6] low byte
             // data byte 7 is at buffer[7] high byte
+            if (vector < CAN_LOGGED_MESSAGES)
+            {
+                frames[vector][0] = buffer[3];
+                frames[vector][1] = buffer[4];
+                frames[vector][2] = buffer[5];
+                frames[vector][3] = buffer[6];
+                new_frames |= 1 << vector;
+            }
             switch(vector)
             {
                 case 0: // ECU
                     message_attributes.kickstand = (buffer[5] & 0x0c00)==0x0400?false:true;
                     message_attributes.asc_switch = (buffer[5] & 0x0300)==0x0200?true:false;
-                    can_ecu_received = true;
+                    EventSignal(EVENT_BIT_CAN_ECU);
                     break;
                 case 1: // instruments
                     message_attributes.counter = buffer[4] & 0xff;
                     message_attributes.ambient = (buffer[3] & 0xc000) == 0x8000?true:false;
+                    EventSignal(EVENT_BIT_CAN_INSTRUMENTS);
                     break;
                 default:
                     break;
@@ -29,7 +29,8 @@ extern "C" {
 void InitializeCAN(void);
 
 
-/* Returns true if a CAN message has been received from the ECU the last time this function was called */
+/* Returns true if a CAN message has been received from the ECU since the last time this function was called.
+ * Fetches (and so clears) the ECU event - see events.h. */
 bool CanEcuReceived(void);
 
 
@@ -40,6 +41,14 @@ bool CANKickstand(void); // true if kickstand out
 uint8_t CANCounter(void); // the value of the counter from the instruments
 
 
+/* Messages whose frames are kept for logging - the ECU (0) and instruments (1) messages */
+#define CAN_LOGGED_MESSAGES 2
+
+/* Returns true if a frame of the message has been received since the last time this function was called for it.
+ * If so the message identifier and the four data words (data byte 0 in the low byte of the first) are returned. */
+bool CANFrame(const uint8_t message, uint16_t *const identifier, uint16_t data[4]);
+
+
 
 
 
@@ -14,38 +14,65 @@
  * Erroneous page flags removed and write cycles unlimited - no point stopping and producing
  * artificial errors that the higher layers can't handle - nothing to lose by continuing into genuine errors.
  *
- * InitializeEEPROM must be invoked before anything else. It can take a few ms to complete so call before any
- * time critical services have started.
+ * InitializeEEPROM must be invoked before anything else. It only reads the flash - it never erases or programs - so
+ * its time is bounded by reading the page headers and scanning the active page.
  * DataEERead and DataEEWrite can then be used to read and write data from emulated EEPROM addresses according
  * to the DATA_EE_SIZE. Writes to invalid addresses are ignored and reads from either invalid or unwritten
  * addresses return the ERASED_WORD_VALUE.
  * 
- * Writes cause the CPU to stall - can be for a while if the active flash page needs to be packed into a new one.
+ * Writes cause the CPU to stall for a word program. When the active page fills it is packed into a new one in the
+ * background by EEPROMTasks - one flash operation (an erase or a row program) per tick so that no single stall is
+ * longer than a page erase. Writes made during a pack are held in the cache until the pack programs them.
+ * DataEEWriteAsync just updates the cache and leaves EEPROMTasks to program the value - all those outstanding as a
+ * group on the next tick - so the caller doesn't stall. Repeated writes to an address before it's programmed only
+ * program the last value. DataEEFlush programs anything outstanding (finishing any pack) for when the values must be
+ * in flash before the power is cut.
+ * EEPROMTasks must be invoked once per timer tick. It takes the flash token (see flash.h) for its operation so the
+ * operation waits for a later tick if another module has already used the flash in this one.
  *
  * A defined number of flash pages are used. The linker must be configured to reserve some program memory space
  * for them and, if they're to be preserved, the programmer must avoid them too.
- * Each page has the first location as a status word (high byte) and a cycle counter (low word). The remaining
- * locations in each page are written successively until the page fills up - at which point the page content is
- * packed into a new page and the current page erased.
+ * Each page starts with a two location header: the status (high byte) with a sequence number (low word) and then a
+ * CRC-8 of the header (high byte) with the page's erase count (low word). The header is followed by the erase count of
+ * every page. The remaining locations in each page are written successively until the page fills up - at which point
+ * the page content is packed into a new page.
  * EEPROM addresses are emulated in the high byte of the flash locations with data content in the low word.
  * A write of a new value to the emulated EEPROM will write to the next available location in the page - so on read
  * only the last written value for an emulated address is taken into account with the previous written values for that
  * emulated address ignored. Scheme is unchanged from the microchip application note.
  * 
- * The status flag for each page indicates whether the page is the active one, available, or invalid (anything else).
- * There should be only one active page at any time apart from when a page is full and is being packed into a new page. There
- * will be two pages marked active briefly during this process. If a reset happens at a bad time then the initialization
- * routine may discover more than one active page in which case it will erase all but one of them.
+ * A page is valid if its status is active and its header CRC matches. A pack commits the new page with the next
+ * sequence number - the CRC location first and the status last - so the active page is the valid one with the latest
+ * sequence number whatever point a reset happened at. Initialization picks it from the headers alone. The old page, and
+ * any other page with something in its header, is stale and left for EEPROMTasks to erase one a tick once there's
+ * nothing else to do. If there's no valid page at all the first pack (started at initialization) starts page 0.
  * 
- * A cycle counter is maintained in order to track how many times the pages have been erased and re-written - but
- * no action is taken as a result of it. PIC24HJ EEPROM is specified to 10000 writes which is very unlikely in
- * practice due to the load balancing that's inherent in the emulation but, if it is reached, there's not much point
- * stopping.
+ * InitializeEEPROM builds a RAM cache of the active page, the next free location in it and the current value of
+ * each emulated address. Reads are then a lookup in the cache and writes go straight to the next free location
+ * without scanning the page. Writes and the background pack (StartPack and PackThread) keep the cache up to date.
+ * 
+ * DataEEBegin, DataEEStage and DataEECommit write a group of values together. The group is programmed a row at a time
+ * as a group record (holding the number of values), the values and then, in a separate word program once they're all
+ * in flash, a commit record. The page scan only takes the values of a group that has its commit record so a reset
+ * part way through leaves none of them. Rows that are partly programmed already have those locations latched as
+ * erased which leaves them as they are. A group that doesn't fit in the active page, or arrives during a pack, is
+ * left pending in the cache for the pack - which commits them all at once with the new page.
+ * 
+ * The erase count of each page is kept in RAM and carried forward by each pack in the new page's erase count table.
+ * Each erase is also followed by an erase record of the page's count in the active page (if there's room) so that
+ * it's kept over a reset before the next pack. Only an erase cut short by a reset goes uncounted. A pack goes into
+ * the least worn page other than the active one - the next round of those equally worn - so the wear is levelled
+ * across the pages. A stale page that EEPROMTasks has erased isn't erased again when it's packed into. DataEEWear
+ * reports the wear against the PIC24HJ flash endurance of ERASE_ENDURANCE cycles. If that's reached there's not much
+ * point stopping - the emulation carries on regardless.
  * 
  */
 
 
+#include <stdbool.h>
 #include "EEPROM.h"
+#include "flash.h"
+#include "protothread.h"
 
 
 // User defined constants
@@ -53,14 +80,20 @@
 #define INITIALIZATION_PACK_COUNT 10 // Initialization will pack if less than this number of free locations in the current page
 
 
-#if DATA_EE_SIZE > 255
-    #error Maximum data EE size is 255
+#if DATA_EE_SIZE > (253 - NUM_DATA_EE_PAGES)
+    #error Maximum data EE size is 253 less the number of program memory pages
 #endif
 
 #if NUM_DATA_EE_PAGES < 2
     #error Minimum number of program memory pages is 2
 #endif
 
+#if NUM_DATA_EE_PAGES > 32
+    #error Maximum number of program memory pages is 32
+#endif
+
+#define ERASE_ENDURANCE 10000       // PIC24HJ flash erase/write cycles
+
 
 // NVMCON values
 #define ERASE               0x4042
@@ -73,10 +106,11 @@
 #define	NUMBER_OF_INSTRUCTIONS_IN_PAGE  512
 #define	NUMBER_OF_INSTRUCTIONS_IN_ROW   64
 #define NUMBER_OF_ROWS_IN_PAGE          (NUMBER_OF_INSTRUCTIONS_IN_PAGE / NUMBER_OF_INSTRUCTIONS_IN_ROW)
+#define ROW_PROGRAM_MINIMUM             32  // a row program takes about as long as this many word programs
 
 
 //Data EE info stored in PM in following format
-//  Status in first two locations of PM page,
+//  Header in first two locations of PM page,
 //  8-bit DEE Address (odd address, low byte) 16-bit DEE data (even address)
 uint8_t emulationPages[NUM_DATA_EE_PAGES][NUMBER_OF_INSTRUCTIONS_IN_PAGE * 2]
     __attribute__ ((space(prog), aligned(NUMBER_OF_INSTRUCTIONS_IN_PAGE * 2), section(".eeprom"), noload));
@@ -87,18 +121,67 @@ uint8_t emulationPages[NUM_DATA_EE_PAGES][NUMBER_OF_INSTRUCTIONS_IN_PAGE * 2]
 #define DEE_PAGE_OFFSET(page) ((__builtin_tbladdress(&emulationPages) + (DEE_PAGE_SIZE * (page))) & 0xFFFF)
 
 
-// Page status flags values
-#define PAGE_ACTIVE_STATUS 0xAC                 // page is active - should be only one active page
-#define PAGE_AVAILABLE_STATUS ERASED_BYTE_VALUE // Page is available for use
-#define PAGE_STATUS_INVALID 0
+// Page header
+//  location 0 - status (high byte) and sequence number (low word) - programmed last to commit the page
+//  location 1 - CRC-8 of the status, sequence number and erase count (high byte) and the erase count (low word)
+//  then the erase count table - the page number (high byte) and its erase count (low word) for each page
+#define ERASE_COUNT_LOCATION 2
+#define HEADER_LOCATIONS    (ERASE_COUNT_LOCATION + NUM_DATA_EE_PAGES)
+#define PAGE_ACTIVE_STATUS  0xAC    // page has been committed - the valid one with the latest sequence number is active
+#define CRC_POLYNOMIAL      0x07
+
+#define PAGE_BIT(page) ((uint32_t)1 << (page))
+
+typedef enum {HEADER_ERASED, HEADER_VALID, HEADER_INVALID} header_t;
+
+// Group records - addresses beyond the emulated ones
+#define GROUP_ADDRESS  0xFE     // starts a group - data is the number of values that follow
+#define COMMIT_ADDRESS 0xFD     // follows the values once they're programmed - data is the number of values
+
+// Erase records - the erase count of a page (data) following an erase made since the active page was packed
+#define ERASE_ADDRESS (COMMIT_ADDRESS - NUM_DATA_EE_PAGES)      // plus the page number
+
+
+// RAM cache of the emulation - built at initialisation and then kept up to date by the writes and packing
+static uint8_t  activePage;                 // the active page or NUM_DATA_EE_PAGES if there isn't one
+static uint16_t activeSequence;             // sequence number of the active page
+static uint32_t stalePages;                 // pages to be erased in the background - a bit per page
+static uint32_t erasedPages;                // pages erased in the background and not yet packed into
+static uint16_t eraseCounts[NUM_DATA_EE_PAGES];
+static uint16_t nextFree;                   // index of the next free location in the active page
+static uint16_t values[DATA_EE_SIZE];       // current value of each emulated address
+static bool     pending[DATA_EE_SIZE];      // the current value is yet to be programmed
+
+// values staged for a group write
+static uint8_t  stagedCount;
+static uint8_t  stagedAddr[DATA_EE_SIZE];
+static uint16_t stagedData[DATA_EE_SIZE];
+
+// background packing - see PackThread
+static bool     packing;                    // a pack is in progress
+static pt_t     packThread;
+static uint8_t  packedPage;                 // the page being packed into
+static uint8_t  packAddr;                   // next address to be packed
+static uint16_t packNext;                   // next location in the packed page
 
 
 static void     UnlockWrite(void);
-static uint8_t  GetPageStatus(const uint8_t page);
+static uint8_t  HeaderCRC(const uint16_t sequence, const uint16_t count);
+static header_t ReadHeader(const uint8_t page, uint16_t *const sequence, uint16_t *const count);
 static void     ErasePage(const uint8_t page);
+static void     RecordErase(const uint8_t page);
 static uint8_t  ActivePage(void);
-static uint16_t FreeInPage(const uint8_t page);
-static void     PackEE(void);
+static void     BuildCache(void);
+static void     ProgramLocation(const uint8_t page, const uint16_t location, const uint8_t high, const uint16_t low);
+static void     PackRow(void);
+static uint8_t  PendingAddress(void);
+static pt_status_t PackThread(pt_t *const pt);
+static void     StartPack(void);
+static void     ProgramValue(const uint8_t addr);
+static bool     GroupCommitted(const uint16_t pageOffset, const uint16_t location, const uint16_t count);
+static void     ProgramGroup(const uint8_t *const addrs, const uint16_t *const data, const uint8_t count);
+static void     WriteGroup(const uint8_t *const addrs, const uint16_t *const data, const uint8_t count);
+static void     NextOperation(void);
 
 
 /************************************************************************
@@ -122,61 +205,66 @@ static void UnlockWrite(void)
 
 
 /************************************************************************
- * FreeInPage
- * 
- * Returns number of free locations in the page
- * 
- * 
+HeaderCRC
+
+This routine returns the CRC-8 of a page header - the status, sequence
+number and erase count.
+
+Parameters:		Sequence number and erase count
+Return:			CRC-8
 ************************************************************************/
-static uint16_t FreeInPage(const uint8_t page)
+static uint8_t HeaderCRC(const uint16_t sequence, const uint16_t count)
 {
-    uint16_t offset;      //Current page offset
-    uint16_t count, i;
-    count = 0;
-    if (page < NUM_DATA_EE_PAGES)
+    const uint8_t bytes[] = {PAGE_ACTIVE_STATUS, sequence >> 8, sequence & 0xFF, count >> 8, count & 0xFF};
+    uint8_t crc = 0;
+    uint8_t i;
+    uint8_t bit;
+
+    for (i = 0; i < sizeof(bytes); ++i)
     {
-        TBLPAG = DEE_PAGE_TBL(page);
-        offset = DEE_PAGE_OFFSET(page);
-        for (i=1; i < NUMBER_OF_INSTRUCTIONS_IN_PAGE; ++i)
+        crc ^= bytes[i];
+        for (bit = 0; bit < 8; ++bit)
         {
-            if (__builtin_tblrdh(offset+(i*2)) == ERASED_BYTE_VALUE)
-            {
-                ++count;
-            }
-        }   
+            crc = (crc & 0x80)?((crc << 1) ^ CRC_POLYNOMIAL):(crc << 1);
+        }
     }
-    return count;
+    return crc;
 }
 
-
 /************************************************************************
-GetPageStatus
+ReadHeader
 
-This routine returns the page status byte for the selected page.
+This routine reads the header of the selected page.
 
-Parameters:		Page number
-Return:			page status byte - compare with the page status bitmasks
-                and values to make sense of it.
+Parameters:		Page number, where to put the sequence number and erase count
+Return:			HEADER_VALID if the page has been committed (the sequence number
+                and erase count are then filled in), HEADER_ERASED if there's
+                nothing in the header or HEADER_INVALID otherwise.
+Side Effects:	TBLPAG is set to the page.
 ************************************************************************/
-static uint8_t GetPageStatus(const uint8_t page)
+static header_t ReadHeader(const uint8_t page, uint16_t *const sequence, uint16_t *const count)
 {
-    uint16_t statusOffset;
-    uint8_t statusByte = PAGE_STATUS_INVALID;
+    uint16_t pageOffset;
+    uint8_t status;
+    uint8_t crc;
 
-    if (page < NUM_DATA_EE_PAGES)
+    TBLPAG = DEE_PAGE_TBL(page);
+    pageOffset = DEE_PAGE_OFFSET(page);
+    status = __builtin_tblrdh(pageOffset);
+    crc = __builtin_tblrdh(pageOffset + 2);
+    if ((status == ERASED_BYTE_VALUE) && (crc == ERASED_BYTE_VALUE))
     {
-        // Point to proper TBLPAG and offset
-        TBLPAG = DEE_PAGE_TBL(page);
-        statusOffset = DEE_PAGE_OFFSET(page);
-        statusByte = __builtin_tblrdh(statusOffset);
+        return HEADER_ERASED;
     }
-    return statusByte;
+    *sequence = __builtin_tblrdl(pageOffset);
+    *count = __builtin_tblrdl(pageOffset + 2);
+    return ((status == PAGE_ACTIVE_STATUS) && (crc == HeaderCRC(*sequence, *count)))?HEADER_VALID:HEADER_INVALID;
 }
 
 /************************************************************************
 ErasePage
 
-This routine erases the selected page.
+This routine erases the selected page and counts the erase.
 
 Parameters:		Page number
 Return:			None
@@ -186,6 +274,10 @@ static void ErasePage(const uint8_t page)
     uint16_t pmOffset;           //Current array (page) offset of selected element (PM 16-bit word)
     // Point to proper TBLPAG and offset
     TBLPAG = DEE_PAGE_TBL(page);
+    if (eraseCounts[page] < UINT16_MAX)
+    {
+        ++eraseCounts[page];
+    }
 
     NVMCON = ERASE;
 
@@ -196,319 +288,867 @@ static void ErasePage(const uint8_t page)
     UnlockWrite();
 }
 
+/************************************************************************
+RecordErase
+
+This routine programs an erase record of the page's erase count into
+the active page so that the erase is counted after a reset. There's
+no need if there isn't room as the pack to come carries the count
+forward anyway.
+
+Parameters:		Page number
+Return:			None
+Side Effects:	CPU stall occurs for flash programming.
+************************************************************************/
+static void RecordErase(const uint8_t page)
+{
+    if ((activePage < NUM_DATA_EE_PAGES) && (nextFree < NUMBER_OF_INSTRUCTIONS_IN_PAGE))
+    {
+        ProgramLocation(activePage, nextFree, ERASE_ADDRESS + page, eraseCounts[page]);
+        ++nextFree;
+    }
+}
+
 /************************************************************************
  * ActivePage
  *
- * returns either the active page or NUM_DATA_EE_PAGES if no active page
- * is found
+ * returns either the valid page with the latest sequence number or
+ * NUM_DATA_EE_PAGES if no valid page is found - with its sequence number
+ * in activeSequence. Every other page with something in its header is
+ * marked as stale.
+ * Sequence numbers are compared as serial numbers so that they can wrap.
  * 
  ************************************************************************/
 static uint8_t ActivePage(void)
 {
     uint8_t page;
-    for (page = 0;
-      (page < NUM_DATA_EE_PAGES) &&
-      (GetPageStatus(page) != PAGE_ACTIVE_STATUS);
-      ++page);
+    uint8_t active = NUM_DATA_EE_PAGES;
+    uint16_t sequence;
+    uint16_t count;
 
-    return page;
+    activeSequence = 0;
+    stalePages = 0;
+    erasedPages = 0;
+    for (page = 0; page < NUM_DATA_EE_PAGES; ++page)
+    {
+        switch (ReadHeader(page, &sequence, &count))
+        {
+            case HEADER_VALID:
+                if ((active == NUM_DATA_EE_PAGES) || ((int16_t)(sequence - activeSequence) > 0))
+                {
+                    if (active < NUM_DATA_EE_PAGES)
+                    {
+                        stalePages |= PAGE_BIT(active);
+                    }
+                    active = page;
+                    activeSequence = sequence;
+                }
+                else
+                {
+                    stalePages |= PAGE_BIT(page);
+                }
+                break;
+            case HEADER_INVALID:
+                stalePages |= PAGE_BIT(page);
+                break;
+            default:
+                break;
+        }
+    }
+    return active;
 }
 
 
 /************************************************************************
-PackEE
+ * GroupCommitted
+ *
+ * returns true if the group record at the location in the active page is
+ * followed by its values and a matching commit record. TBLPAG must be
+ * set to the active page.
+ * 
+ ************************************************************************/
+static bool GroupCommitted(const uint16_t pageOffset, const uint16_t location, const uint16_t count)
+{
+    uint16_t commit = location + count + 1;
+    return (commit < NUMBER_OF_INSTRUCTIONS_IN_PAGE)
+        && (__builtin_tblrdh(pageOffset+(commit*2)) == COMMIT_ADDRESS)
+        && (__builtin_tblrdl(pageOffset+(commit*2)) == count);
+}
+
+
+/************************************************************************
+ * BuildCache
+ *
+ * Finds the active page, reads its erase count table and scans it for the
+ * current value of each address and the first free location. Values are
+ * written to successive locations so the last one found for an address is
+ * the current one - as are the erase records.
+ * 
+ ************************************************************************/
+static void BuildCache(void)
+{
+    uint16_t savedTBLPAG;
+    uint16_t pageOffset;
+    uint8_t latchAddr;
+    uint16_t i;
+    uint16_t count;
+    bool committed;
+    uint8_t page;
+
+    savedTBLPAG = TBLPAG;
+    stagedCount = 0;
+    for (i=0; i<DATA_EE_SIZE; ++i)
+    {
+        values[i] = ERASED_WORD_VALUE;
+        pending[i] = false;
+    }
+    packing = false;
+    activePage = ActivePage();
+    nextFree = NUMBER_OF_INSTRUCTIONS_IN_PAGE;
+    for (page = 0; page < NUM_DATA_EE_PAGES; ++page)
+    {
+        eraseCounts[page] = 0;
+    }
+    if (activePage < NUM_DATA_EE_PAGES)
+    {
+        TBLPAG = DEE_PAGE_TBL(activePage);
+        pageOffset = DEE_PAGE_OFFSET(activePage);
+        for (page = 0; page < NUM_DATA_EE_PAGES; ++page)
+        {
+            i = ERASE_COUNT_LOCATION + page;
+            if (__builtin_tblrdh(pageOffset+(i*2)) == page)
+            {
+                eraseCounts[page] = __builtin_tblrdl(pageOffset+(i*2));
+            }
+        }
+        for (i=HEADER_LOCATIONS; i<NUMBER_OF_INSTRUCTIONS_IN_PAGE; ++i)
+        {
+            latchAddr = __builtin_tblrdh(pageOffset+(i*2));
+            if (latchAddr == ERASED_BYTE_VALUE)
+            {
+                nextFree = i;
+                break;
+            }
+            if (latchAddr < DATA_EE_SIZE)
+            {
+                values[latchAddr] = __builtin_tblrdl(pageOffset+(i*2));
+            }
+            else if ((latchAddr >= ERASE_ADDRESS) && (latchAddr < COMMIT_ADDRESS))
+            {
+                eraseCounts[latchAddr - ERASE_ADDRESS] = __builtin_tblrdl(pageOffset+(i*2));
+            }
+            else if (latchAddr == GROUP_ADDRESS)
+            {
+                // a group's values only count once it's committed - either way carry on from the commit record
+                count = __builtin_tblrdl(pageOffset+(i*2));
+                committed = GroupCommitted(pageOffset, i, count);
+                for (; (count > 0) && (i < (NUMBER_OF_INSTRUCTIONS_IN_PAGE - 1)); --count)
+                {
+                    ++i;
+                    latchAddr = __builtin_tblrdh(pageOffset+(i*2));
+                    if (committed && (latchAddr < DATA_EE_SIZE))
+                    {
+                        values[latchAddr] = __builtin_tblrdl(pageOffset+(i*2));
+                    }
+                }
+            }
+        }
+    }
+    TBLPAG = savedTBLPAG;
+}
 
-This routine finds the active page and an available page. The most
-recent data EEPROM values are located for each address using ReadEE
-function and written into write latches. Page status is read from active
-page and erase/write count is incremented if page 0 is packed. After all
-information is programmed and verified, the current page is erased. The
-packed page becomes the active page. This function can be called at any-
-time by the user to schedule the CPU stall.
+
+/************************************************************************
+ProgramLocation
+
+This routine programs a single location of a page with the high byte
+and low word given.
+
+Parameters:		Page number, location within the page, high byte and low word
+Return:			None
+Side Effects:	CPU stall occurs for flash programming.
+************************************************************************/
+static void ProgramLocation(const uint8_t page, const uint16_t location, const uint8_t high, const uint16_t low)
+{
+    uint16_t offset;
+
+    TBLPAG = DEE_PAGE_TBL(page);
+    offset = DEE_PAGE_OFFSET(page) + (location * 2);
+
+    NVMCON = PROGRAM_WORD;
+    __builtin_tblwtl(offset, low);
+    __builtin_tblwth(offset, high);
+
+    UnlockWrite();
+
+    Nop();
+    Nop();
+}
+
+
+/************************************************************************
+PackRow
+
+This routine programs the next row of the packed page with the values
+from the cache starting at packAddr, skipping unwritten addresses. The
+header locations at the start of the page are left erased and followed
+by the erase count table. Addresses that are latched are no longer
+pending.
 
 Parameters:		None
 Return:			None
-Side Effects:	Generates CPU stall during program/erase operations and
-                overwrites program memory write latches. Data EE flags
-                may be updated
+Side Effects:	CPU stall occurs for row programming and overwrites program
+                memory write latches.
 ************************************************************************/
-static void PackEE(void)
+static void PackRow(void)
 {
-    uint16_t currentPage;        //Array row (PM page) of active DEE page
-    uint16_t packedPage;         //Array row (PM page) of packed page
-    uint16_t savedTBLPAG;        //Context save of TBLPAG value. Current and packed page are on same page.
-    uint16_t currentOffset;      //Current page offset
-    uint16_t packedOffset;       //Packed page offset
+    uint16_t offset;
     uint16_t i;
-    uint8_t latchAddr;
     uint16_t latchData;
-    savedTBLPAG = TBLPAG;
 
-    currentPage = ActivePage();
+    // packNext is the first location of a row apart from in the first row where the header is skipped
+    TBLPAG = DEE_PAGE_TBL(packedPage);
+    offset = DEE_PAGE_OFFSET(packedPage) + ((packNext & ~(NUMBER_OF_INSTRUCTIONS_IN_ROW - 1)) * 2);
 
-    if (currentPage < NUM_DATA_EE_PAGES)
+    NVMCON = PROGRAM_ROW;
+    for (i = 0; i < (packNext & (NUMBER_OF_INSTRUCTIONS_IN_ROW - 1)); ++i)
     {
-        // Find the next page to use
-        packedPage = currentPage + 1;
-        if (packedPage == NUM_DATA_EE_PAGES)
+        if (i < ERASE_COUNT_LOCATION)
+        {
+            __builtin_tblwtl(offset, ERASED_WORD_VALUE);
+            __builtin_tblwth(offset, ERASED_BYTE_VALUE);
+        }
+        else
         {
-            packedPage = 0;
+            __builtin_tblwtl(offset, eraseCounts[i - ERASE_COUNT_LOCATION]);
+            __builtin_tblwth(offset, i - ERASE_COUNT_LOCATION);
         }
+        offset += 2;
+    }
+    while((packAddr < DATA_EE_SIZE) && (i < NUMBER_OF_INSTRUCTIONS_IN_ROW))
+    {
+        latchData = values[packAddr];
+        if(latchData != ERASED_WORD_VALUE)       //if address is unwritten, skip to next address
+        {
+            __builtin_tblwtl(offset, latchData);
+            __builtin_tblwth(offset, packAddr);
+            offset += 2;
+            ++i;
+            ++packNext;
+        }
+        pending[packAddr] = false;
+        ++packAddr;
+    }
+    while(i < NUMBER_OF_INSTRUCTIONS_IN_ROW)
+    {
+        __builtin_tblwtl(offset, ERASED_WORD_VALUE);
+        __builtin_tblwth(offset, ERASED_BYTE_VALUE);
+        offset += 2;
+        ++i;
+    }
+    UnlockWrite();
+}
+
+
+/************************************************************************
+PendingAddress
+
+Returns the first address with a value yet to be programmed or
+DATA_EE_SIZE if there are none.
+************************************************************************/
+static uint8_t PendingAddress(void)
+{
+    uint8_t addr;
+    for (addr = 0; (addr < DATA_EE_SIZE) && !pending[addr]; ++addr);
+    return addr;
+}
+
+
+/************************************************************************
+PackThread
+
+Packs the active page into the packed page one flash operation per
+invocation:
+ - erase the packed page - unless it has already been erased
+ - program the packed page a row at a time from the cache and erase
+   counts
+ - append any values written since their row was programmed
+ - program the packed page header with the next sequence number - the
+   CRC and erase count then the status which commits the pack
+Until the commit the old page remains the active one so a reset at any
+point before it leaves the old page and its values as they were. Writes
+made during the pack are held in the cache until they are appended.
+After the commit the old page is stale - EEPROMTasks erases it later.
+If there's no active page the pack starts one from the cache.
+
+Parameters:		The protothread state
+Return:			The protothread status - PT_ENDED when the pack is done
+Side Effects:	CPU stall occurs for the flash operation and overwrites
+                program memory write latches.
+************************************************************************/
+static pt_status_t PackThread(pt_t *const pt)
+{
+    uint16_t sequence;
+    uint16_t count;
+    uint8_t addr;
 
+    PT_BEGIN(pt);
+
+    if ((erasedPages & PAGE_BIT(packedPage)) == 0)
+    {
         ErasePage(packedPage);
+        RecordErase(packedPage);
+        stalePages &= ~PAGE_BIT(packedPage);
+        PT_YIELD(pt);
+    }
+    erasedPages &= ~PAGE_BIT(packedPage);
 
-        // Point to first location in packed page
-        TBLPAG = DEE_PAGE_TBL(packedPage);
-        packedOffset = DEE_PAGE_OFFSET(packedPage);
+    packAddr = 0;
+    packNext = HEADER_LOCATIONS;
+    do
+    {
+        PackRow();
+        PT_YIELD(pt);
+    }
+    while (packAddr < DATA_EE_SIZE);
 
-        i = 0;
-        NVMCON = PROGRAM_ROW;
+    // a write can arrive after its row has been programmed - append until there are none left
+    while (((addr = PendingAddress()) < DATA_EE_SIZE) && (packNext < NUMBER_OF_INSTRUCTIONS_IN_PAGE))
+    {
+        pending[addr] = false;
+        ProgramLocation(packedPage, packNext, addr, values[addr]);
+        ++packNext;
+        PT_YIELD(pt);
+    }
 
-        __builtin_tblwtl(packedOffset, ERASED_WORD_VALUE);
-        __builtin_tblwth(packedOffset, ERASED_BYTE_VALUE);
-        packedOffset += 2;
+    // commit the packed page with the next sequence number
+    sequence = activeSequence + 1;
+    count = eraseCounts[packedPage];
+    ProgramLocation(packedPage, 1, HeaderCRC(sequence, count), count);
+    ProgramLocation(packedPage, 0, PAGE_ACTIVE_STATUS, sequence);
 
-        latchAddr = 0;
-        ++i;
+    // the packed page is now the active one with its values following on from the header
+    if (activePage < NUM_DATA_EE_PAGES)
+    {
+        stalePages |= PAGE_BIT(activePage);
+    }
+    activePage = packedPage;
+    activeSequence = sequence;
+    nextFree = packNext;
 
-        do
+    PT_END(pt);
+}
+
+
+/************************************************************************
+StartPack
+
+Starts packing the active page in the background if it isn't already
+being packed. The page packed into is the one other than the active
+page that will be least worn once it's been erased for the pack - the
+next round from the active page of those equally worn.
+************************************************************************/
+static void StartPack(void)
+{
+    uint8_t page;
+    uint8_t i;
+    uint32_t wear;
+    uint32_t leastWear = UINT32_MAX;
+
+    if (!packing)
+    {
+        page = activePage;
+        packedPage = NUM_DATA_EE_PAGES;
+        for (i = 0; i < NUM_DATA_EE_PAGES; ++i)
         {
-            while((latchAddr < DATA_EE_SIZE) && (i < NUMBER_OF_INSTRUCTIONS_IN_ROW))
+            page = (page < (NUM_DATA_EE_PAGES - 1))?(page + 1):0;
+            wear = eraseCounts[page] + (((erasedPages & PAGE_BIT(page)) == 0)?1:0);
+            if ((page != activePage) && (wear < leastWear))
             {
-                latchData = DataEERead(latchAddr);
-                if(latchData != ERASED_WORD_VALUE)       //if address is unwritten, skip to next address
-                {
-                    __builtin_tblwtl(packedOffset, latchData);
-                    __builtin_tblwth(packedOffset, latchAddr);
-                    packedOffset += 2;
-                    ++i;
-                }
-                latchAddr++;
+                packedPage = page;
+                leastWear = wear;
             }
-            while(i < NUMBER_OF_INSTRUCTIONS_IN_ROW)
+        }
+        PT_INIT(&packThread);
+        packing = true;
+    }
+}
+
+/************************************************************************
+ProgramValue
+
+This routine programs the cached value of the address into the next free
+location of the active page. If the active page is being packed (and the
+pack isn't yet committed), is full or there isn't one then the value is
+left pending for the pack to program. A pack is started when the active
+page fills.
+
+Parameters:		Data EE address
+Return:			None
+Side Effects:	CPU stall occurs for flash programming. Pack may be started.
+************************************************************************/
+static void ProgramValue(const uint8_t addr)
+{
+    if ((packing && (activePage != packedPage)) || (nextFree >= NUMBER_OF_INSTRUCTIONS_IN_PAGE))
+    {
+        pending[addr] = true;
+        StartPack();
+    }
+    else
+    {
+        pending[addr] = false;
+        ProgramLocation(activePage, nextFree, addr, values[addr]);
+        ++nextFree;
+        if (nextFree >= NUMBER_OF_INSTRUCTIONS_IN_PAGE)
+        {
+            StartPack();
+        }
+    }
+}
+
+/************************************************************************
+ProgramGroup
+
+This routine programs a group record followed by the addresses and data
+from the next free location of the active page. Where enough of them fall
+in a row the row is programmed in one go - locations of the row before
+the next free one are already programmed and after the values are still
+to be used so are latched as erased which leaves them unchanged.
+Otherwise they're programmed a word at a time.
+
+Parameters:		Addresses and data of the values and the number of them
+Return:			None
+Side Effects:	CPU stall occurs for flash programming and overwrites program
+                memory write latches.
+************************************************************************/
+static void ProgramGroup(const uint8_t *const addrs, const uint16_t *const data, const uint8_t count)
+{
+    uint16_t location = nextFree;
+    uint16_t end = nextFree + count + 1;
+    uint16_t rowStart;
+    uint16_t rowEnd;
+    uint16_t offset = 0;
+    uint16_t j;
+    uint8_t latchAddr;
+    uint16_t latchData;
+    bool rowProgram;
+
+    while (location < end)
+    {
+        rowStart = location & ~(NUMBER_OF_INSTRUCTIONS_IN_ROW - 1);
+        rowEnd = rowStart + NUMBER_OF_INSTRUCTIONS_IN_ROW;
+        rowProgram = ((((rowEnd < end)?rowEnd:end) - location) >= ROW_PROGRAM_MINIMUM);
+        if (rowProgram)
+        {
+            TBLPAG = DEE_PAGE_TBL(activePage);
+            offset = DEE_PAGE_OFFSET(activePage) + (rowStart * 2);
+            NVMCON = PROGRAM_ROW;
+        }
+        else
+        {
+            rowStart = location;
+            rowEnd = (rowEnd < end)?rowEnd:end;
+        }
+        for (j = rowStart; j < rowEnd; ++j)
+        {
+            if (j == nextFree)
+            {
+                latchAddr = GROUP_ADDRESS;
+                latchData = count;
+            }
+            else if ((j > nextFree) && (j < end))
             {
-                __builtin_tblwtl(packedOffset, ERASED_WORD_VALUE);
-                __builtin_tblwth(packedOffset, ERASED_BYTE_VALUE);
-                packedOffset += 2;
-                ++i;
+                latchAddr = addrs[j - nextFree - 1];
+                latchData = data[j - nextFree - 1];
             }
+            else
+            {
+                latchAddr = ERASED_BYTE_VALUE;
+                latchData = ERASED_WORD_VALUE;
+            }
+            if (rowProgram)
+            {
+                __builtin_tblwtl(offset, latchData);
+                __builtin_tblwth(offset, latchAddr);
+                offset += 2;
+            }
+            else
+            {
+                ProgramLocation(activePage, j, latchAddr, latchData);
+            }
+        }
+        if (rowProgram)
+        {
             UnlockWrite();
-            i = 0;
         }
-        while(latchAddr < DATA_EE_SIZE);
+        location = rowEnd;
+    }
+}
 
-        //Program page status
+/************************************************************************
+WriteGroup
 
-        // update the cycle count and make the packed page active
-        currentOffset = DEE_PAGE_OFFSET(currentPage);
-        packedOffset = DEE_PAGE_OFFSET(packedPage);
-        TBLPAG = DEE_PAGE_TBL(currentPage);
-        latchData = __builtin_tblrdl(currentOffset);
-        if((packedPage == 0) && (latchData < UINT16_MAX))
-        {
-            ++latchData;        //Increment E/W counter
-        }
-        TBLPAG = DEE_PAGE_TBL(packedPage);
-        __builtin_tblwth(packedOffset, PAGE_ACTIVE_STATUS);
-        __builtin_tblwtl(packedOffset,latchData);
+This routine writes the values as a group - programmed into the active
+page followed by the commit record and then the cache updated so that
+reads see the whole group at once. If the active page is being packed
+(and the pack isn't yet committed), hasn't room for the group or there
+isn't one then the values are left pending for the pack which programs
+them all before it commits.
 
-        NVMCON = PROGRAM_WORD;
-        UnlockWrite();
+Parameters:		Addresses and data of the values and the number of them
+Return:			None
+Side Effects:	CPU stall occurs for flash programming. Pack may be started.
+************************************************************************/
+static void WriteGroup(const uint8_t *const addrs, const uint16_t *const data, const uint8_t count)
+{
+    uint8_t i;
+    bool program = !(packing && (activePage != packedPage))
+        && ((nextFree + count + 2) <= NUMBER_OF_INSTRUCTIONS_IN_PAGE);
 
-        //Erase active page
-        ErasePage(currentPage);
+    if (program)
+    {
+        ProgramGroup(addrs, data, count);
+        ProgramLocation(activePage, nextFree + count + 1, COMMIT_ADDRESS, count);
+        nextFree += count + 2;
+    }
+    for (i = 0; i < count; ++i)
+    {
+        values[addrs[i]] = data[i];
+        pending[addrs[i]] = !program;
+    }
+    if (!program || (nextFree >= NUMBER_OF_INSTRUCTIONS_IN_PAGE))
+    {
+        StartPack();
     }
-    TBLPAG = savedTBLPAG;
 }
 
 /************************************************************************
 InitializeEEPROM
 
-This routine finds a page to become an active page. It then
-counts the number of active pages. If no active pages are found, the
-first page is initialized for emulation. If one active page is
-found, it is assumes a reset occurred and the function does nothing. If more than one
-active pages are found, it is assumes a reset occurred during a pack - all but the one
-are erased.
-Any page that doesn't have a valid status flag is erased.
+This routine finds the active page from the page headers - the valid
+one with the latest sequence number - and builds the RAM cache from it.
+Nothing is erased or programmed here so the time taken is bounded by
+reading the headers and scanning one page. Any other pages with something
+in their headers (the page packed from before a reset, or corrupt) are
+left for EEPROMTasks to erase in the background. If there's no valid page
+then writes are held in the cache until the pack started here has
+programmed page 0.
 
 Parameters:		None
 Return:			None
 ************************************************************************/
 void InitializeEEPROM(void)
 {
-    uint16_t count;
     uint16_t savedTBLPAG;        //Context save of TBLPAG value. Current and packed page are on same page.
-    uint16_t currentPage;
-    uint16_t pageOffset;
 
     savedTBLPAG = TBLPAG;
 
-    count = 0;
+    BuildCache();
 
-    // Count active page(s).
-    for (currentPage = 0; currentPage < NUM_DATA_EE_PAGES; ++currentPage)
+    // if there are few remaining free locations in the active page (or there isn't one) then start
+    // packing it in the background so as to have room for the writes to come
+    if ((NUMBER_OF_INSTRUCTIONS_IN_PAGE - nextFree) < INITIALIZATION_PACK_COUNT)
     {
-        switch (GetPageStatus(currentPage))
-        {
-            case PAGE_ACTIVE_STATUS:
-                if (count > 0)
-                {
-                    ErasePage(currentPage);
-                }
-                count++;
-                break;
-            case PAGE_AVAILABLE_STATUS:
-                break;
-            default:
-                ErasePage(currentPage);
-                break;
-        }
+        StartPack();
     }
- 
-    //If no active pages found, initialize page 0
-    if(count == 0)
-    {
-        // Point the table page pointer to the emulation pages
-        ErasePage(0);
+    TBLPAG = savedTBLPAG;
+}
 
-        // Point to proper TBLPAG and offset
-        TBLPAG = DEE_PAGE_TBL(0);
-        pageOffset = DEE_PAGE_OFFSET(0);
+/************************************************************************
+DataEERead
 
-        NVMCON = PROGRAM_WORD;
+This routine verifies the address is valid. If not, 0xFFFF is returned.
+Otherwise the value of the address is returned from the cache - 0xFFFF
+if it has never been written. This function can be called by the user.
 
-        __builtin_tblwtl(pageOffset, 0);    //New page: unavailable, active, reset count
-        __builtin_tblwth(pageOffset, PAGE_ACTIVE_STATUS);
-        UnlockWrite();
-    }
+Parameters:		Data EE address
+Return:			Data EE data or 0xFFFF if address not found
+************************************************************************/
+uint16_t DataEERead(const uint8_t addr)
+{
+    return (addr < DATA_EE_SIZE)?values[addr]:ERASED_WORD_VALUE;
+}
+
+/************************************************************************
+DataEEWrite
+
+This routine verifies the address is valid and that the data has changed
+and returns if not. The cache is updated and the data EE information
+(MSB = address, LSW = data) is programmed into the next free location of
+the active page - unless a pack is in progress in which case it is left
+pending for the pack. This function can be called by the user.
+
+Parameters:		Data EE address and data
+Return:			None
+Side Effects:	CPU stall occurs for flash programming. Pack may be started.
+************************************************************************/
+void DataEEWrite(const uint16_t data, const uint8_t addr)
+{
+    uint16_t savedTBLPAG;        //Context save of TBLPAG value. Current and packed page are on same page.
     
-    // if there are few remaining free locations in the active page then pack it now
-    // so as to save run time later
-    if (FreeInPage(ActivePage()) < INITIALIZATION_PACK_COUNT)
+    savedTBLPAG = TBLPAG;
+
+    //Do not write data if it did not change
+    if ((addr < DATA_EE_SIZE) && (values[addr] != data))
     {
-        PackEE();
+        values[addr] = data;
+        ProgramValue(addr);
     }
     TBLPAG = savedTBLPAG;
 }
 
+
 /************************************************************************
-DataEERead
+DataEEWriteAsync
 
-This routine verifies the address is valid. If not, the Illegal Address
-flag is set and 0xFFFF is returned. It then finds the active page. If an
-active page can not be found, the Page Corrupt status bit is set and
-0xFFFF is returned. A reverse search of the active page attempts to find
-the matching address in the program memory MSB (odd address). If a match
-is found, the corresponding data EEPROM data (even address) is returned,
-otherwise 0xFFFF is returned. This function can be called by the user.
+This routine verifies the address is valid and that the data has changed
+and returns if not. The cache is updated and the address left pending for
+EEPROMTasks to program. A further write to the address before then just
+replaces the value to be programmed. This function can be called by the
+user.
 
-Parameters:		Data EE address
-Return:			Data EE data or 0xFFFF if address not found
-Side Effects:	Data EE flags may be updated.
+Parameters:		Data EE address and data
+Return:			None
 ************************************************************************/
-uint16_t DataEERead(const uint8_t addr)
+void DataEEWriteAsync(const uint16_t data, const uint8_t addr)
 {
-    uint16_t savedTBLPAG;        //Context save of TBLPAG value. Current and packed page are on same page.
-    uint8_t page;
-    uint16_t pageOffset;         //Current array (page) offset of selected page (PM 16-bit word)
-    uint16_t pmOffset;           //Current array (page) offset of selected element (PM 16-bit word)
-    uint8_t latchAddr;
-    uint16_t i;
-    uint16_t return_value;
+    if ((addr < DATA_EE_SIZE) && (values[addr] != data))
+    {
+        values[addr] = data;
+        pending[addr] = true;
+    }
+}
 
-    savedTBLPAG = TBLPAG;
 
-    return_value = ERASED_WORD_VALUE;
+/************************************************************************
+DataEEFlush
+
+This routine runs EEPROMTasks until any pack in progress is complete and
+all the pending values are programmed. This function can be called by the
+user when the writes must be in flash before the power is cut.
+
+Parameters:		None
+Return:			None
+Side Effects:	CPU stall occurs for the flash operations - up to a full
+                pack.
+************************************************************************/
+void DataEEFlush(void)
+{
+    uint16_t savedTBLPAG;
 
-    if(addr < DATA_EE_SIZE)
+    savedTBLPAG = TBLPAG;
+    while (packing || (PendingAddress() < DATA_EE_SIZE))
     {
-        page = ActivePage();
+        ClrWdt();
+        NextOperation();
+    }
+    TBLPAG = savedTBLPAG;
+}
+
+
+/************************************************************************
+DataEEBegin
+
+This routine starts a group write - discarding any values staged but
+not committed. This function can be called by the user.
 
-        if (page < NUM_DATA_EE_PAGES)
+Parameters:		None
+Return:			None
+************************************************************************/
+void DataEEBegin(void)
+{
+    stagedCount = 0;
+}
+
+
+/************************************************************************
+DataEEStage
+
+This routine verifies the address is valid and stages the data to be
+written to it when the group is committed. Staging an address again
+replaces its data. This function can be called by the user.
+
+Parameters:		Data EE address and data
+Return:			None
+************************************************************************/
+void DataEEStage(const uint16_t data, const uint8_t addr)
+{
+    uint8_t i;
+
+    if (addr < DATA_EE_SIZE)
+    {
+        for (i = 0; (i < stagedCount) && (stagedAddr[i] != addr); ++i);
+        stagedAddr[i] = addr;
+        stagedData[i] = data;
+        if (i == stagedCount)
         {
-            // Point to proper TBLPAG and offset
-            TBLPAG = DEE_PAGE_TBL(page);
-            pageOffset = DEE_PAGE_OFFSET(page);
+            ++stagedCount;
+        }
+    }
+}
 
-            for (i=NUMBER_OF_INSTRUCTIONS_IN_PAGE; i>0;--i)
-            {
-                pmOffset = pageOffset+(i*2);
-                latchAddr = __builtin_tblrdh(pmOffset);
-                if (latchAddr == addr)
-                {
-                    return_value = __builtin_tblrdl(pmOffset);
-                    break;
-                }
-            }
+
+/************************************************************************
+DataEECommit
+
+This routine writes the staged values that have changed as a group:
+either all of them or, after a reset part way through, none of them.
+This function can be called by the user.
+
+Parameters:		None
+Return:			None
+Side Effects:	CPU stall occurs for flash programming. Pack may be started.
+************************************************************************/
+void DataEECommit(void)
+{
+    uint16_t savedTBLPAG;
+    uint8_t count;
+    uint8_t i;
+
+    savedTBLPAG = TBLPAG;
+
+    // only the values that have changed
+    count = 0;
+    for (i = 0; i < stagedCount; ++i)
+    {
+        if (values[stagedAddr[i]] != stagedData[i])
+        {
+            stagedAddr[count] = stagedAddr[i];
+            stagedData[count] = stagedData[i];
+            ++count;
         }
     }
+
+    if (count > 0)
+    {
+        WriteGroup(stagedAddr, stagedData, count);
+    }
+    stagedCount = 0;
     TBLPAG = savedTBLPAG;
-    return return_value;
 }
 
+
 /************************************************************************
-DataEEWrite
+NextOperation
 
-This routine verifies the address is valid. If not, the Illegal Address
-flag is set and an error code is returned. It then finds the active page.
-If an active page can not be found, the Page Corrupt status bit is set
-and an error code is returned. A read is performed, if the data was not
-changed, the function exits. If the last location is programmed, the Pack
-Skipped error flag is set (one location should always be available). The
-data EE information (MSB = address, LSW = data) is programmed and
-verified. If the verify fails, the Write Error flag is set. If the write
-went into the last location of the page, pack is called. This function
-can be called by the user.
+Runs any pack in progress on by one flash operation or, if there's no
+pack in progress, programs the pending values - as a group if there's
+more than one so that values written together arrive together. With
+nothing else to do it erases a stale page.
 
-Parameters:		Data EE address and data
-Return:			Pass or fail status (0 = Pass)
-Side Effects:	Data EE flags may be updated. CPU stall occurs for flash
-                programming. Pack may be generated.
+Parameters:		None
+Return:			None
+Side Effects:	CPU stall occurs for the flash operation.
 ************************************************************************/
-void DataEEWrite(const uint16_t data, const uint8_t addr)
+static void NextOperation(void)
 {
-    uint16_t savedTBLPAG;        //Context save of TBLPAG value. Current and packed page are on same page.
-    uint16_t page;
-    uint16_t offset;           //Current array (page) offset of selected element (PM 16-bit word)
-    uint16_t i;
-    
-    savedTBLPAG = TBLPAG;
+    uint8_t addrs[DATA_EE_SIZE];
+    uint16_t data[DATA_EE_SIZE];
+    uint8_t count;
+    uint8_t addr;
+    uint8_t page;
 
-    //Do not write data if it did not change
-    if ((addr < DATA_EE_SIZE) && (DataEERead(addr) != data))
+    if (packing)
+    {
+        if (PackThread(&packThread) == PT_ENDED)
+        {
+            packing = false;
+        }
+    }
+    else
     {
-        page = ActivePage();
-        if (page < NUM_DATA_EE_PAGES)
+        count = 0;
+        for (addr = 0; addr < DATA_EE_SIZE; ++addr)
         {
-            if (FreeInPage(page) == 0)
+            if (pending[addr])
             {
-                PackEE();
-                page = ActivePage();
+                addrs[count] = addr;
+                data[count] = values[addr];
+                ++count;
             }
         }
-        if (page < NUM_DATA_EE_PAGES)
+        if (count == 1)
+        {
+            ProgramValue(addrs[0]);
+        }
+        else if (count > 1)
         {
-            TBLPAG = DEE_PAGE_TBL(page);
-            offset = DEE_PAGE_OFFSET(page);
+            WriteGroup(addrs, data, count);
+        }
+        else if (stalePages != 0)
+        {
+            for (page = 0; (stalePages & PAGE_BIT(page)) == 0; ++page);
+            ErasePage(page);
+            RecordErase(page);
+            stalePages &= ~PAGE_BIT(page);
+            erasedPages |= PAGE_BIT(page);
+        }
+    }
+}
 
-            for (i=1; i<NUMBER_OF_INSTRUCTIONS_IN_PAGE; ++i)
-            {
-                offset += 2;
-                if (__builtin_tblrdh(offset) == ERASED_BYTE_VALUE)
-                {
-                    NVMCON = PROGRAM_WORD;
-                    __builtin_tblwtl(offset, data);
-                    __builtin_tblwth(offset, addr);
 
-                    UnlockWrite();
+/************************************************************************
+EEPROMTasks
+
+Makes the next flash operation - a pack step, the pending values or a
+stale page erase - if there is one to make and the flash token is free.
+Must be invoked once per timer tick.
 
-                    Nop();
-                    Nop();
-                    break;
-                }
-            }
-        }
+Parameters:		None
+Return:			None
+Side Effects:	CPU stall occurs for the flash operation.
+************************************************************************/
+void EEPROMTasks(void)
+{
+    uint16_t savedTBLPAG;
+
+    savedTBLPAG = TBLPAG;
+    if ((packing || (PendingAddress() < DATA_EE_SIZE) || (stalePages != 0)) && FlashToken())
+    {
+        NextOperation();
     }
     TBLPAG = savedTBLPAG;
 }
+
+
+/************************************************************************
+DataEEWear
+
+This routine reports the wear of the pages from their erase counts.
+The remaining packs are the erases left before every page reaches
+ERASE_ENDURANCE and each makes room for at least the page less its
+header and a value for every address. This function can be called by
+the user.
+
+Parameters:		Where to put the wear
+Return:			None
+************************************************************************/
+void DataEEWear(EEPROM_wear_t *const wear)
+{
+    uint32_t total = 0;
+    uint8_t page;
+
+    wear->minimum_erases = UINT16_MAX;
+    wear->maximum_erases = 0;
+    wear->remaining_packs = 0;
+    for (page = 0; page < NUM_DATA_EE_PAGES; ++page)
+    {
+        total += eraseCounts[page];
+        if (eraseCounts[page] < wear->minimum_erases)
+        {
+            wear->minimum_erases = eraseCounts[page];
+        }
+        if (eraseCounts[page] > wear->maximum_erases)
+        {
+            wear->maximum_erases = eraseCounts[page];
+        }
+        if (eraseCounts[page] < ERASE_ENDURANCE)
+        {
+            wear->remaining_packs += ERASE_ENDURANCE - eraseCounts[page];
+        }
+    }
+    wear->mean_erases = total / NUM_DATA_EE_PAGES;
+    wear->remaining_erases = (wear->maximum_erases < ERASE_ENDURANCE)?(ERASE_ENDURANCE - wear->maximum_erases):0;
+    wear->remaining_writes = wear->remaining_packs
+        * (NUMBER_OF_INSTRUCTIONS_IN_PAGE - HEADER_LOCATIONS - DATA_EE_SIZE);
+}
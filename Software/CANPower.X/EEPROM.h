@@ -14,13 +14,19 @@
  * Erroneous page flags removed and write cycles unlimited - no point stopping and producing
  * artificial errors that the higher layers can't handle - nothing to lose by continuing into genuine errors.
  *
- * InitializeEEPROM must be invoked before anything else. It can take a few ms to complete so call before any
- * time critical services have started.
+ * InitializeEEPROM must be invoked before anything else. It only reads the flash so its time is bounded - stale
+ * pages left by a reset are erased in the background by EEPROMTasks.
  * DataEERead and DataEEWrite can then be used to read and write data from emulated EEPROM addresses according
  * to the DATA_EE_SIZE. Writes to invalid addresses are ignored and reads from either invalid or unwritten
  * addresses return the ERASED_WORD_VALUE.
  * 
- * Writes cause the CPU to stall - can be for a while if the active flash page needs to be packed into a new one.
+ * Writes cause the CPU to stall for a word program. Full pages are packed in the background by EEPROMTasks
+ * which must be invoked once per timer tick - a flash operation at a time when it gets the flash token (flash.h).
+ * DataEEWriteAsync avoids the stall by leaving EEPROMTasks to program the value and DataEEFlush waits for
+ * everything outstanding to be programmed.
+ * DataEEBegin, DataEEStage and DataEECommit write several values as a group - after a reset either all or none
+ * of them will have been written.
+ * Packs go into the least worn page so the wear is levelled. DataEEWear reports it against the flash endurance.
  * 
  */
 
@@ -36,12 +42,27 @@ extern "C" {
     
 // Size of the emulated EEPROM (in words).
 // (the highest address is one less than this value)
-#define DATA_EE_SIZE 2
+// The application's settings are at addresses 0 and 1, the hour meter checkpoint follows (see meters.h) and then
+// the next fault number (see faults.h).
+#ifndef DATA_EE_SIZE
+#define DATA_EE_SIZE 25
+#endif
 
 // The value of an emulated data word and data byte when unprogrammed
 #define ERASED_WORD_VALUE 0xFFFF
 #define ERASED_BYTE_VALUE 0xFF
 
+// wear of the flash pages used by the emulation
+typedef struct
+{
+    uint16_t minimum_erases; // erase counts of the least and most worn pages
+    uint16_t maximum_erases;
+    uint16_t mean_erases;
+    uint16_t remaining_erases; // before the most worn page reaches the specified endurance
+    uint32_t remaining_packs; // before every page reaches it - each pack erases one page
+    uint32_t remaining_writes; // that the remaining packs make room for at the least
+} EEPROM_wear_t;
+
 
     
 void  InitializeEEPROM(void);
@@ -49,6 +70,22 @@ void  InitializeEEPROM(void);
 uint16_t DataEERead(const uint8_t addr);
 void  DataEEWrite(const uint16_t data, const uint8_t addr);
 
+// writes without stalling - the value is programmed by EEPROMTasks
+void  DataEEWriteAsync(const uint16_t data, const uint8_t addr);
+
+// stalls until all writes (and any pack) are programmed
+void  DataEEFlush(void);
+
+// group writes - the staged values are committed all together or not at all
+void  DataEEBegin(void);
+void  DataEEStage(const uint16_t data, const uint8_t addr);
+void  DataEECommit(void);
+
+void  EEPROMTasks(void);
+
+// reports the page erase counts and the projected remaining endurance
+void  DataEEWear(EEPROM_wear_t *const wear);
+
 
 #ifdef	__cplusplus
 }
@@ -140,7 +140,7 @@ void LEDTasks(void)
         // and the segment time has elapsed then time to output the next segment.
         // otherwise nothing to do
         if ((patterns[pattern][0].time != 0)
-          && ((time_now-(led_control_ptr->timer)) > segment_time))
+          && ((uint16_t)(time_now-(led_control_ptr->timer)) > segment_time))
         {
             ++segment;
             bool end_marker = (patterns[pattern][segment].time == 0);
@@ -207,6 +207,32 @@ static void OutputToLEDPort(const LED_t LED, const bool state)
 }
 
 
+/* Returns the PWM duty currently being output to the LED.
+ * From 0 (off) to LED_DUTY_FULL (fully on at full brightness) */
+uint16_t LEDDuty(const LED_t LED)
+{
+    uint16_t output_value;
+    switch (LED)
+    {
+        case LED0:
+            output_value = OC2RS;
+            break;
+        case LED1:
+            output_value = OC3RS;
+            break;
+        default:
+            output_value = PWM_FULL_OFF;
+            break;
+    }
+    // outputs are inverted so the on time is what's left of the period after the output compare value
+    if (output_value >= PWM_FULL_OFF)
+    {
+        return 0;
+    }
+    return (uint16_t)(((uint32_t)(PWM_FULL_OFF - output_value) * LED_DUTY_FULL) / PWM_FULL_OFF);
+}
+
+
 // set the dimming of the LEDs. True for dim, false for full bright.
 void LEDsDim(bool dim)
 {
@@ -18,6 +18,8 @@
 #ifndef LEDS_H
 #define	LEDS_H
 
+#include <stdint.h>
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
@@ -37,6 +39,10 @@ typedef enum {LED_OFF=0, LED_ON,
     NUMBEROFLEDPATTERNS} LED_pattern_t;
 
 
+// LEDDuty value for an LED that is fully on at full brightness
+#define LED_DUTY_FULL 256
+
+
 // set the dimming of the LEDs. True for dim, false for full bright.
 void LEDsDim(bool dim);
 
@@ -48,6 +54,11 @@ void AllLEDsOff(void);
 /* Output the requested pattern to the requested LED */
 void LEDPattern(const LED_t LED, const LED_pattern_t pattern);
 
+/* Returns the PWM duty currently being output to the LED.
+ * From 0 (off) to LED_DUTY_FULL (fully on at full brightness) */
+uint16_t LEDDuty(const LED_t LED);
+
+
 /* Must be called once at initialisation time prior to using any of the functionality
   of the LEDs module.
   Assumes that timers and ports are initialised already and that the IO ports are already
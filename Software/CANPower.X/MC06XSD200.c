@@ -23,8 +23,44 @@
  * the PWM frequency.
  * SLOW_PWM is software controlled. The hardware PWM output is either fully on or fully off but cycled slowly
  * under software control over 256 timer ticks (2.56 seconds at 10ms timer ticks).
+ *
+ * The level output by each channel rises to the level required by at most the channel's ramp each tick - a
+ * linear ramp of so many levels per tick or an exponential ramp of a fraction of the level output per tick -
+ * so that a load isn't switched on with a step of inrush current. Levels fall straight away. The ramp
+ * starts from off every time that the chip becomes ready. The output level is only written to the chip
+ * when its register value changes so the SPI traffic is per level change rather than per tick.
  * 
- * SPI and ports and the system timer must have been initialised prior to
+ * Once ready any output level changes are written at the start of the same transfer as the readback.
+ * The chip returns the response to each command during the following word so the readback that follows
+ * the writes verifies them - a level change is written and checked in the one SPI burst.
+ *
+ * The polling is in two tiers. Every READBACK_TICKS a short status frame reads back the status, fault
+ * and PWM registers and kicks the watchdog - that sets the fault latency. The full configuration audit
+ * reads back every register and runs every AUDIT_TICKS, and on the next frame after an anomaly (a level
+ * written that didn't read back as written). The first frame after start up is an audit.
+ *
+ * The start up, configuration and readback sequence is a protothread (see protothread.h) which
+ * is run by MC06XSD200Thread on every timer tick and SPI done event. So each SPI transfer is followed
+ * as soon as it completes rather than at the next timer tick.
+ * 
+ * Optionally (CALIBRATION_READBACKS) the SPI clock is calibrated on the first start up - each faster SCK rate is
+ * tried in turn until the configuration read back from the chip no longer matches what was written. The rate is
+ * then settled one step slower than the fastest that matched, for margin, and the chip initialised again at that
+ * rate. It's off by default - the power latch is released after every ride so every start up is a first one and
+ * would pay for it, while the CS0 transactions go a word per timer 3 period whatever the SCK rate.
+ *
+ * The SPI transactions are queued at SPI_PRIORITY_SWITCH_CHIP - ahead of anything else on the SPI - so
+ * that the chip's SPI watchdog is always kept serviced.
+ *
+ * The load current of each channel is measured through the chip's current sense output (CSNS) - the
+ * GCR selects which channel it follows. Once ready the ADC averages a whole switch output PWM period of
+ * the sense voltage (see ADC.h) for the channel selected, and the sense is then switched to the other
+ * channel by a GCR write in the next frame - checked by the next audit along with the rest of the GCR.
+ * The ADC discards the samples until the sense has settled on the new channel. So each channel's current
+ * is updated every few PWM periods. The energy is the current at a nominal supply voltage integrated
+ * every tick.
+ *
+ * SPI and ports and the system timer and the ADC must have been initialised prior to
  * initialising this module.
  */
 
@@ -32,82 +68,188 @@
 #include "ports.h"
 #include "SPI.h"
 #include "hardware.h"
+#include "timer.h"
+#include "protothread.h"
+#include "meters.h"
+#include "faults.h"
+#include "ADC.h"
 #include "xc.h"
 
-// hardware PWM clock
-#define PWM_PERIOD 66 // uS - 15KHz
-
 // requested PWM output levels 0-255
 static uint16_t PWM_level_0;
 static PWM_mode_t PWM_mode_0;
 static uint16_t PWM_level_1;
 static PWM_mode_t PWM_mode_1;
 
+// output level ramps - the rise per tick and its curve
+static uint16_t ramp_rate_0;
+static PWM_ramp_t ramp_curve_0;
+static uint16_t ramp_rate_1;
+static PWM_ramp_t ramp_curve_1;
+// output levels 0-256 - ramped towards the levels required each tick
+static uint16_t output_level_0;
+static uint16_t output_level_1;
+
 
 // counts up once per MC06XSD200Tasks invocation (assumed to be invoked every timer tick)
 // for the software SLOW_PWM mode
 static uint8_t software_PWM_counter;
 
 
-// the state machine
+// the switch state - the sequence within each state is run by the protothread
 typedef enum
 {
     OFF=0, // held in reset
-    STARTING0, // about to turn on - state only here to ensure that reset is held long enough in all circumstances
-    STARTING1,
-    ON, // OUTPUT_WAKE line high - chip just out of reset initialisation not started
-    INITIALIZING, // initialisation sequence sent to SPI
-    READY, // initialised and ready to have the output state written etc.
-    READBACK, // status being read
-    PROGRAMMING, // output state being updated
+    STARTING, // coming out of reset and being initialised
+    READY, // initialised - output states being written and status read back
     FAULT // fault condition detected. Switch held in reset
 }states_t;
 static states_t state;
+static pt_t thread;
+
+// timing of the start up sequence
+#define RESET_TICKS 2 // reset held for at least a whole tick - timer could tick just after the reset was applied
+#define READBACK_TICKS 2 // status read back (and SPI watchdog kicked) every this many ticks once ready
+#define AUDIT_TICKS 100 // full configuration read back at least every this many ticks
+static uint16_t reset_time; // Timer value when reset was applied
+static uint32_t on_count; // TimerCount value when SwitchChipOn was invoked
+static uint32_t on_latency; // TimerCount counts from SwitchChipOn to ready for the last start up
+
+// SPI clock calibration
+#define CALIBRATION_READBACKS 0 // readbacks that must all be OK at each rate - 0 for no calibration
+static bool calibrated; // the SPI clock has been calibrated since reset
 
 
 #define WATCHDOG 0x8000 // SPI command watchdog bit must be toggled regularly
 #define PARITY 0x4000 // SPI parity bit - must be even total number of bits set
+#define CHANNEL_1 0x2000 // channel bit of the commands and readbacks
+#define ADDRESS_SHIFT 10 // register address bits of the write commands and readbacks
 #define NORMAL_MODE 0x0200 // Normal mode indicated in readback when set
 
+// 1 if the word has an odd number of bits set - the bits are folded into a nibble whose parity is
+// looked up in the bits of a constant. A constant expression for a constant word (so it can be used in #if).
+#define ODD_BITS(word) ((0x6996 >> (((word) ^ ((word) >> 4) ^ ((word) >> 8) ^ ((word) >> 12)) & 0x000F)) & 1)
+
+// the word with the parity bit set (or cleared) to make the total number of bits set even
+#define WITH_PARITY(word) ((word) ^ (ODD_BITS(word) ? PARITY : 0))
+
+// register write addresses
+#define PWM_ADDRESS 1
+#define CONF_ADDRESS 2
+#define OC_ADDRESS 4
+#define RETRY_ADDRESS 5
+#define GC_ADDRESS 6
+
+// registers as selected by the read commands
+#define STATR_REGISTER 0
+#define FAULT_REGISTER 1
+#define PWM_REGISTER 2
+#define CONF_REGISTER 3
+#define OC_REGISTER 4
+#define RETRY_REGISTER 5
+#define GC_REGISTER 6
+#define DIAG_REGISTER 7
+
+// command words and the readback expected for them - channel 0 or 1
+#define CHANNEL(channel) ((channel) ? CHANNEL_1 : 0)
+#define WRITE_COMMAND(channel, address, data) WITH_PARITY(CHANNEL(channel) | ((address) << ADDRESS_SHIFT) | (data))
+#define READ_COMMAND(channel, register_number) WITH_PARITY(CHANNEL(channel) | (register_number))
+#define KICK_COMMAND(register_number) WITH_PARITY(WATCHDOG | (register_number)) // a read command that also kicks the watchdog
+#define READBACK_VALUE(register_number, channel, data) \
+    (CHANNEL(channel) | ((register_number) << ADDRESS_SHIFT) | NORMAL_MODE | (data))
+#define READBACK_ALL 0x3FFF // readback mask - channel, register, normal mode and data bits
+#define READBACK_HEADER 0x3E00 // readback mask - channel, register and normal mode bits only
+
 // register configuration values
 // each has a value to configure, a mask for the read back checking, and a value for the read back checking
-#define GCR_INITIAL_VALUE (0x1810|PARITY) // GCR initial - watchdog disabled, no current sensing, PWM initially disabled
-#define GCR_VALUE 0x1980                  // GCR - watchdog enabled, no current sensing, PWM enabled
-#define GCR_READBACK_MASK 0x3FFF
-#define GCR_READBACK_VALUE (0x1800|NORMAL_MODE|(GCR_VALUE&0x01FF)) 
-#define PWM_0_VALUE (0x0400|PARITY)       // PWM_0 - off at level 0
-#define PWM_0_READBACK_MASK 0x3E00
-#define PWM_0_READBACK_VALUE (0x0800|NORMAL_MODE|(PWM_0_VALUE&0x0000))
-#define PWM_1_VALUE (0x2400)              // PWM_1 - off at level 0
-#define PWM_1_READBACK_MASK 0x3E00
-#define PWM_1_READBACK_VALUE (0x2800|NORMAL_MODE|(PWM_1_VALUE&0x0000))
-#define CONFR_0_VALUE (0x08E0)            // CONFR_0 - open load detection disabled, direct control disabled, medium slew
-#define CONFR_0_READBACK_MASK 0x3FFF
-#define CONFR_0_READBACK_VALUE (0x0C00|NORMAL_MODE|(CONFR_0_VALUE&0x01FF))
-#define CONFR_1_VALUE (0x28E0|PARITY)     // CONFR_1 - open load detection disabled, direct control disabled, medium slew
-#define CONFR_1_READBACK_MASK 0x3FFF
-#define CONFR_1_READBACK_VALUE (0x2C00|NORMAL_MODE|(CONFR_1_VALUE&0x01FF))
-#define OCR_0_VALUE (0x1026)              // OCR_0 - external PWM, low current ratios, tOCH1, tOCM1, iOCH2 (23A), iOCM2 (9A), iOCL1 (5A)
-#define OCR_0_READBACK_MASK 0x3FFF
-#define OCR_0_READBACK_VALUE (0x1000|NORMAL_MODE|(OCR_0_VALUE&0x01FF))
-#define OCR_1_VALUE (0x3026|PARITY)       // OCR_1 - external PWM, low current ratios, tOCH1, tOCM1, iOCH2 (23A), iOCM2 (9A), iOCL1 (5A)
-#define OCR_1_READBACK_MASK 0x3FFF
-#define OCR_1_READBACK_VALUE (0x3000|NORMAL_MODE|(OCR_1_VALUE&0x01FF))
-#define RETRYR_0_VALUE (0x1400)           // RETRYR_0 - 16 x 150ms retries 
-#define RETRYR_0_READBACK_MASK 0x3FFF
-#define RETRYR_0_READBACK_VALUE (0x1400|NORMAL_MODE|(RETRYR_0_VALUE&0x01FF))
-#define RETRYR_1_VALUE (0x3400|PARITY)    // RETRYR_1 - 16 x 150ms retries
-#define RETRYR_1_READBACK_MASK 0x3FFF
-#define RETRYR_1_READBACK_VALUE (0x3400|NORMAL_MODE|(RETRYR_1_VALUE&0x01FF))
+#define GCR_INITIAL_DATA 0x010 // GCR initial - watchdog disabled, no current sensing, PWM initially disabled
+#define GCR_DATA 0x180         // GCR - watchdog enabled, PWM enabled - with one of the current sense data below
+#define GCR_SENSE_0_DATA 0x001 // GCR - current sense (CSNS) of channel 0
+#define GCR_SENSE_1_DATA 0x002 // GCR - current sense (CSNS) of channel 1
+#define PWM_DATA 0x000         // PWM - off at level 0
+#define CONFR_DATA 0x0E0       // CONFR - open load detection disabled, direct control disabled, medium slew
+#define OCR_DATA 0x026         // OCR - external PWM, low current ratios, tOCH1, tOCM1, iOCH2 (23A), iOCM2 (9A), iOCL1 (5A)
+#define RETRYR_DATA 0x000      // RETRYR - 16 x 150ms retries
+
+#define GCR_INITIAL_VALUE WRITE_COMMAND(0, GC_ADDRESS, GCR_INITIAL_DATA)
+#define GCR_SENSE_0_VALUE WRITE_COMMAND(0, GC_ADDRESS, GCR_DATA | GCR_SENSE_0_DATA)
+#define GCR_SENSE_1_VALUE WRITE_COMMAND(0, GC_ADDRESS, GCR_DATA | GCR_SENSE_1_DATA)
+#define GCR_VALUE GCR_SENSE_0_VALUE // the current sense starts on channel 0
+#define GCR_READBACK_MASK READBACK_ALL
+#define GCR_SENSE_0_READBACK_VALUE READBACK_VALUE(GC_REGISTER, 0, GCR_DATA | GCR_SENSE_0_DATA)
+#define GCR_SENSE_1_READBACK_VALUE READBACK_VALUE(GC_REGISTER, 0, GCR_DATA | GCR_SENSE_1_DATA)
+#define PWM_0_VALUE WRITE_COMMAND(0, PWM_ADDRESS, PWM_DATA)
+#define PWM_0_READBACK_MASK READBACK_HEADER
+#define PWM_0_READBACK_VALUE READBACK_VALUE(PWM_REGISTER, 0, 0)
+#define PWM_1_VALUE WRITE_COMMAND(1, PWM_ADDRESS, PWM_DATA)
+#define PWM_1_READBACK_MASK READBACK_HEADER
+#define PWM_1_READBACK_VALUE READBACK_VALUE(PWM_REGISTER, 1, 0)
+#define CONFR_0_VALUE WRITE_COMMAND(0, CONF_ADDRESS, CONFR_DATA)
+#define CONFR_0_READBACK_MASK READBACK_ALL
+#define CONFR_0_READBACK_VALUE READBACK_VALUE(CONF_REGISTER, 0, CONFR_DATA)
+#define CONFR_1_VALUE WRITE_COMMAND(1, CONF_ADDRESS, CONFR_DATA)
+#define CONFR_1_READBACK_MASK READBACK_ALL
+#define CONFR_1_READBACK_VALUE READBACK_VALUE(CONF_REGISTER, 1, CONFR_DATA)
+#define OCR_0_VALUE WRITE_COMMAND(0, OC_ADDRESS, OCR_DATA)
+#define OCR_0_READBACK_MASK READBACK_ALL
+#define OCR_0_READBACK_VALUE READBACK_VALUE(OC_REGISTER, 0, OCR_DATA)
+#define OCR_1_VALUE WRITE_COMMAND(1, OC_ADDRESS, OCR_DATA)
+#define OCR_1_READBACK_MASK READBACK_ALL
+#define OCR_1_READBACK_VALUE READBACK_VALUE(OC_REGISTER, 1, OCR_DATA)
+#define RETRYR_0_VALUE WRITE_COMMAND(0, RETRY_ADDRESS, RETRYR_DATA)
+#define RETRYR_0_READBACK_MASK READBACK_ALL
+#define RETRYR_0_READBACK_VALUE READBACK_VALUE(RETRY_REGISTER, 0, RETRYR_DATA)
+#define RETRYR_1_VALUE WRITE_COMMAND(1, RETRY_ADDRESS, RETRYR_DATA)
+#define RETRYR_1_READBACK_MASK READBACK_ALL
+#define RETRYR_1_READBACK_VALUE READBACK_VALUE(RETRY_REGISTER, 1, RETRYR_DATA)
 // fault and status registers don't have configuration values but are checked after readback
 #define STATR_READBACK_MASK 0x3FBC       // any fault condition
-#define STATR_READBACK_VALUE (NORMAL_MODE)
+#define STATR_READBACK_VALUE READBACK_VALUE(STATR_REGISTER, 0, 0)
 #define FAULT_0_READBACK_MASK 0x3F3F     // any fault condition
-#define FAULT_0_READBACK_VALUE (0x0400|NORMAL_MODE)
+#define FAULT_0_READBACK_VALUE READBACK_VALUE(FAULT_REGISTER, 0, 0)
 #define FAULT_1_READBACK_MASK 0x3F3F     // any fault condition
-#define FAULT_1_READBACK_VALUE (0x2400|NORMAL_MODE)
-      
- 
+#define FAULT_1_READBACK_VALUE READBACK_VALUE(FAULT_REGISTER, 1, 0)
+
+#if ODD_BITS(GCR_INITIAL_VALUE) || ODD_BITS(GCR_SENSE_0_VALUE) || ODD_BITS(GCR_SENSE_1_VALUE) \
+  || ODD_BITS(PWM_0_VALUE) || ODD_BITS(PWM_1_VALUE) \
+  || ODD_BITS(CONFR_0_VALUE) || ODD_BITS(CONFR_1_VALUE) || ODD_BITS(OCR_0_VALUE) || ODD_BITS(OCR_1_VALUE) \
+  || ODD_BITS(RETRYR_0_VALUE) || ODD_BITS(RETRYR_1_VALUE) || ODD_BITS(KICK_COMMAND(GC_REGISTER))
+#error "A switch chip command word has odd parity"
+#endif
+#if (GCR_INITIAL_DATA | GCR_DATA | GCR_SENSE_0_DATA | GCR_SENSE_1_DATA | PWM_DATA | CONFR_DATA | OCR_DATA \
+  | RETRYR_DATA) & ~0x01FF
+#error "Switch chip register data must be 9 bits"
+#endif
+#if (GCR_SENSE_0_READBACK_VALUE & ~GCR_READBACK_MASK) || (GCR_SENSE_1_READBACK_VALUE & ~GCR_READBACK_MASK) \
+  || (PWM_0_READBACK_VALUE & ~PWM_0_READBACK_MASK) || (PWM_1_READBACK_VALUE & ~PWM_1_READBACK_MASK) \
+  || (CONFR_0_READBACK_VALUE & ~CONFR_0_READBACK_MASK) || (CONFR_1_READBACK_VALUE & ~CONFR_1_READBACK_MASK) \
+  || (OCR_0_READBACK_VALUE & ~OCR_0_READBACK_MASK) || (OCR_1_READBACK_VALUE & ~OCR_1_READBACK_MASK) \
+  || (RETRYR_0_READBACK_VALUE & ~RETRYR_0_READBACK_MASK) || (RETRYR_1_READBACK_VALUE & ~RETRYR_1_READBACK_MASK) \
+  || (STATR_READBACK_VALUE & ~STATR_READBACK_MASK) || (FAULT_0_READBACK_VALUE & ~FAULT_0_READBACK_MASK) \
+  || (FAULT_1_READBACK_VALUE & ~FAULT_1_READBACK_MASK)
+#error "A switch chip readback value has bits outside its readback mask"
+#endif
+
+// current sense - the CSNS current is the load current of the channel selected over the sense ratio
+// (low current ratio - see OCR_DATA). It is dropped across the sense resistor to AN10.
+#define CURRENT_SENSE_RATIO 4500UL // load current per CSNS current
+#define CURRENT_SENSE_RESISTOR 2200UL // ohms
+// mA from the sum of a period of ADC samples - (sum * CURRENT_SCALE) >> 16
+#define CURRENT_SCALE ((ADC_REFERENCE_MV * CURRENT_SENSE_RATIO * (65536UL / ADC_PERIOD_SAMPLES)) \
+    / (ADC_FULL_SCALE * CURRENT_SENSE_RESISTOR))
+#define MAXIMUM_CURRENT ((((ADC_FULL_SCALE - 1UL) * ADC_PERIOD_SAMPLES) * CURRENT_SCALE) >> 16) // mA
+// energy - there is no measurement of the supply so the nominal battery voltage is assumed
+#define SUPPLY_MV 13800UL
+#define MICRO_WATT_SECONDS 1000000UL
+
+#if (((ADC_FULL_SCALE - 1UL) * ADC_PERIOD_SAMPLES) > (0xFFFFFFFFUL / CURRENT_SCALE)) || (MAXIMUM_CURRENT > 0xFFFF)
+#error "The current scaling must fit 32 bits and the current 16 bits"
+#endif
+#if (MAXIMUM_CURRENT * SUPPLY_MV * TIMER_PERIOD) > (0xFFFFFFFFUL - MICRO_WATT_SECONDS)
+#error "The energy of a tick must fit 32 bits"
+#endif
+
+
 // SPI command sequences - maximum SPI_MAX_WORDS each
 #define INITIALIZATION_LENGTH 14
 static const SPIData_t initialization_sequence[INITIALIZATION_LENGTH] =
@@ -123,50 +265,85 @@ static const SPIData_t initialization_sequence[INITIALIZATION_LENGTH] =
     RETRYR_1_VALUE,
     GCR_VALUE,
     // read the fault and status registers so as to clear any initial fault conditions
-    0x0001 | PARITY,             // FAULT_0
-    0x2001,                      // FAULT_1
-    0x0000 ,                     // STATR
-    0x0006 | WATCHDOG | PARITY   // dummy GCR read command so that previous value can be read and also a watchdog kick
+    READ_COMMAND(0, FAULT_REGISTER),
+    READ_COMMAND(1, FAULT_REGISTER),
+    READ_COMMAND(0, STATR_REGISTER),
+    KICK_COMMAND(GC_REGISTER)    // dummy GCR read command so that previous value can be read and also a watchdog kick
 };
 
 #define READBACK_LENGTH 14
 static const SPIData_t readback_sequence[READBACK_LENGTH] =
 {
-    0x0000 ,                     // STATR
-    0x0001 | PARITY,             // FAULT_0
-    0x2001,                      // FAULT_1
-    0x0002 | PARITY,             // PWMR_0
-    0x2002,                      // PWMR_1
-    0x0003,                      // CONFR_0
-    0x2003 | PARITY,             // CONFR_1
-    0x0004 | PARITY,             // OCR_0
-    0x2004,                      // OCR_1
-    0x0005,                      // RETRYR_0
-    0x2005 | PARITY,             // RETRYR_1
-    0x0006,                      // GCR
-    0x0007 | PARITY,             // DIAGR
-    0x0006 | WATCHDOG | PARITY   // dummy GCR read command so that previous value can be read and also a watchdog kick
+    READ_COMMAND(0, STATR_REGISTER),
+    READ_COMMAND(0, FAULT_REGISTER),
+    READ_COMMAND(1, FAULT_REGISTER),
+    READ_COMMAND(0, PWM_REGISTER),
+    READ_COMMAND(1, PWM_REGISTER),
+    READ_COMMAND(0, CONF_REGISTER),
+    READ_COMMAND(1, CONF_REGISTER),
+    READ_COMMAND(0, OC_REGISTER),
+    READ_COMMAND(1, OC_REGISTER),
+    READ_COMMAND(0, RETRY_REGISTER),
+    READ_COMMAND(1, RETRY_REGISTER),
+    READ_COMMAND(0, GC_REGISTER),
+    READ_COMMAND(0, DIAG_REGISTER),
+    KICK_COMMAND(GC_REGISTER)    // dummy GCR read command so that previous value can be read and also a watchdog kick
+};
+
+// the start of the readback sequence - the registers that can change without a write - and a watchdog kick
+#define STATUS_LENGTH 6
+static const SPIData_t status_sequence[STATUS_LENGTH] =
+{
+    READ_COMMAND(0, STATR_REGISTER),
+    READ_COMMAND(0, FAULT_REGISTER),
+    READ_COMMAND(1, FAULT_REGISTER),
+    READ_COMMAND(0, PWM_REGISTER),
+    READ_COMMAND(1, PWM_REGISTER),
+    KICK_COMMAND(GC_REGISTER)    // dummy GCR read command so that previous value can be read and also a watchdog kick
 };
 
-// Register order for the readback
+// Register order for the readback (the status readback is the first of them)
 enum {DUMMY=0, STATR, FAULT_0, FAULT_1, PWMR_0, PWMR_1, CONFR_0, CONFR_1, OCR_0, OCR_1, RETRYR_0, RETRYR_1, GCR, DIAGR};
 
-// one to get filled in with the programming commands
-#define PROGRAMMING_LENGTH 4
-static SPIData_t programming_sequence[PROGRAMMING_LENGTH];
+// the programming commands (one per channel at most and a current sense switch) followed by the readback sequence
+#define PROGRAMMING_LENGTH 3
+#define FRAME_LENGTH (PROGRAMMING_LENGTH + READBACK_LENGTH)
+static SPIData_t frame[FRAME_LENGTH];
+
+#if (FRAME_LENGTH > SPI_MAX_WORDS) || (INITIALIZATION_LENGTH > FRAME_LENGTH)
+#error "The programming and readback frame must fit an SPI transaction and hold the responses to any sequence"
+#endif
+
+// the PWM register data bits last read back from each channel - PWM_UNKNOWN until the first readback
+#define PWM_UNKNOWN 0xFFFF
+static uint16_t PWM_readback_0;
+static uint16_t PWM_readback_1;
+// the PWM register data bits required when the last frame was built
+static uint16_t PWM_required_0;
+static uint16_t PWM_required_1;
+
+// the next frame is a full configuration audit
+static bool audit;
+static uint16_t audit_time; // Timer value at the start of the last audit
+
+// current sense
+static uint8_t sense_channel; // channel the current sense is on (or being switched to)
+static bool sense_switch; // the current sense is to be switched to sense_channel in the next frame
+static uint16_t channel_current[2]; // mA - last measured
+static uint32_t channel_energy[2]; // Ws - since reset
+static uint32_t channel_energy_fraction[2]; // uWs - towards the next Ws
+
+// the SPI transaction for each of the sequences in turn, the words returned by the chip during it and
+// where the responses to the readback sequence start in them
+static SPI_transaction_t transaction;
+static SPIData_t responses[FRAME_LENGTH];
+static uint16_t readback_offset;
 
 /* returns the supplied word with parity bit set if necessary to keep the total
- * set bits even as required by the MC06XSD200 SPI */
+ * set bits even as required by the MC06XSD200 SPI - the same few operations whatever the word */
 static SPIData_t Parity(const SPIData_t word)
 {
-    uint8_t count=0;
-    SPIData_t shift = word;
-    while (shift)
-    {
-        count+=shift&1;
-        shift = shift >> 1;
-    }
-   return (count&1)?(word^PARITY):word;
+    return WITH_PARITY(word);
 }
 
 
@@ -192,6 +369,45 @@ void SetPWMLevel1(const uint16_t level, const PWM_mode_t mode)
 }
 
 
+/* Return the PWM levels last requested for switch channel 0 and 1 respectively */
+uint16_t PWMLevel0(void) {return PWM_level_0;}
+uint16_t PWMLevel1(void) {return PWM_level_1;}
+
+
+/* Sets the ramp of the output level rises for switch channel 0.
+ * LINEAR_RAMP rises by the rate in levels per tick. EXPONENTIAL_RAMP rises by the rate in 256ths of the
+ * level being output per tick (at least a level per tick). PWM_RAMP_NONE for rises straight away. */
+void SetPWMRamp0(const uint16_t rate, const PWM_ramp_t curve)
+{
+    ramp_rate_0 = rate;
+    ramp_curve_0 = curve;
+}
+
+
+/* Sets the ramp of the output level rises for switch channel 1.
+ * LINEAR_RAMP rises by the rate in levels per tick. EXPONENTIAL_RAMP rises by the rate in 256ths of the
+ * level being output per tick (at least a level per tick). PWM_RAMP_NONE for rises straight away. */
+void SetPWMRamp1(const uint16_t rate, const PWM_ramp_t curve)
+{
+    ramp_rate_1 = rate;
+    ramp_curve_1 = curve;
+}
+
+
+/* Returns the load current last measured for switch channel 0 or 1 - mA. Zero while the chip isn't ready. */
+uint16_t SwitchChannelCurrent(const uint8_t channel)
+{
+    return channel_current[channel & 1];
+}
+
+
+/* Returns the energy delivered by switch channel 0 or 1 since reset - Ws at the nominal supply voltage */
+uint32_t SwitchChannelEnergy(const uint8_t channel)
+{
+    return channel_energy[channel & 1];
+}
+
+
 /* turns the switch chip off - holds in reset */
 void SwitchChipOff(void)
 {
@@ -199,6 +415,11 @@ void SwitchChipOff(void)
     // stop the timer and output compare for the PWM clock
     OC1CONbits.OCM = 0b000; // output compare toggles pin
     T3CONbits.TON = 0;
+    SPIAbort(SPI_CS0); // a transfer in progress would never finish without timer 3
+    ADCStop();
+    channel_current[0] = 0;
+    channel_current[1] = 0;
+    reset_time = Timer();
     state = OFF;
 }
 
@@ -210,7 +431,9 @@ void SwitchChipOn(void)
 {
     if (state == OFF)
     {
-        state = STARTING0;
+        on_count = TimerCount();
+        PT_INIT(&thread);
+        state = STARTING;
     }
 }
 
@@ -223,6 +446,15 @@ bool SwitchChipFault(void)
 }
 
 
+/* returns the time in timer counts (see TimerCount) from the last SwitchChipOn to the
+ * chip having been initialised and its configuration read back OK - i.e. outputs enabled.
+ * Zero if the chip hasn't got that far yet. */
+uint32_t SwitchChipOnLatency(void)
+{
+    return on_latency;
+}
+
+
 /* puts the switch chip in reset and initialises the state machine.
  * Starts timer 3 and OC1 for the PWM clock generation
  * SwitchChipOn should be invoked after this if the switch chip is actually to do
@@ -235,134 +467,338 @@ void InitializeMC06XSD200(void)
     PWM_mode_0 = SLOW_PWM;
     PWM_level_1 = 0;
     PWM_mode_1 = SLOW_PWM;
+    ramp_rate_0 = PWM_RAMP_NONE;
+    ramp_curve_0 = LINEAR_RAMP;
+    ramp_rate_1 = PWM_RAMP_NONE;
+    ramp_curve_1 = LINEAR_RAMP;
+    on_latency = 0;
+    calibrated = false;
+    channel_energy[0] = 0;
+    channel_energy[1] = 0;
+    channel_energy_fraction[0] = 0;
+    channel_energy_fraction[1] = 0;
+    transaction.chip_select = SPI_CS0;
+    transaction.receive = responses;
+    transaction.priority = SPI_PRIORITY_SWITCH_CHIP;
+    transaction.callback = NULL; // the thread is run on the SPI done event
     SwitchChipOff();
 
     T3CONbits.TON = 0;
     T3CONbits.TSIDL = 0; // don't stop on idle
     T3CONbits.TCKPS = 0b00; //prescaler 1
     TMR3 = 0;
-    PR3 = FCY * PWM_PERIOD / 2 / 1000000;
+    PR3 = PWM_TIMER_PERIOD; // hardware PWM clock (see hardware.h)
     OC1CONbits.OCSIDL = 0; // don't stop on idle
     OC1CONbits.OCTSEL = 1; // output compare based on timer 3
-    OC1R = FCY * PWM_PERIOD / 4 / 1000000;
+    OC1R = PWM_TIMER_PERIOD / 2;
 }
 
 
-/* Must be invoked regularly (per timer tick) so as to keep the watchdog serviced
-   and the output states up to date etc.
-   The startup sequence is driven through some states so as to ensure that the
-   reset is driven for as long as it needs to be. Actually it could go 10000 times
-   faster than this but it doesn't matter. */
-void MC06XSD200Tasks(void)
+/* returns true if the status read back from the chip is as it should be */
+static bool StatusOK(const SPIData_t *const readback)
 {
-    SPIData_t* readback;
-    ++software_PWM_counter;
+    return (readback != NULL)
+      && ((readback[STATR] & STATR_READBACK_MASK) == STATR_READBACK_VALUE)
+      && ((readback[FAULT_0] & FAULT_0_READBACK_MASK) == FAULT_0_READBACK_VALUE)
+      && ((readback[FAULT_1] & FAULT_1_READBACK_MASK) == FAULT_1_READBACK_VALUE)
+      && ((readback[PWMR_0] & PWM_0_READBACK_MASK) == PWM_0_READBACK_VALUE)
+      && ((readback[PWMR_1] & PWM_1_READBACK_MASK) == PWM_1_READBACK_VALUE);
+}
 
-    switch (state)
+
+/* returns true if the configuration and status read back from the chip is as it should be */
+static bool ReadbackOK(const SPIData_t *const readback)
+{
+    return StatusOK(readback)
+      && ((readback[CONFR_0] & CONFR_0_READBACK_MASK) == CONFR_0_READBACK_VALUE)
+      && ((readback[CONFR_1] & CONFR_1_READBACK_MASK) == CONFR_1_READBACK_VALUE)
+      && ((readback[OCR_0] & OCR_0_READBACK_MASK) == OCR_0_READBACK_VALUE)
+      && ((readback[OCR_1] & OCR_1_READBACK_MASK) == OCR_1_READBACK_VALUE)
+      && ((readback[RETRYR_0] & RETRYR_0_READBACK_MASK) == RETRYR_0_READBACK_VALUE)
+      && ((readback[RETRYR_1] & RETRYR_1_READBACK_MASK) == RETRYR_1_READBACK_VALUE)
+      && ((readback[GCR] & GCR_READBACK_MASK)
+        == ((sense_channel == 0) ? GCR_SENSE_0_READBACK_VALUE : GCR_SENSE_1_READBACK_VALUE));
+}
+
+
+/* fills in the programming commands for any outputs whose last read back levels don't match the
+ * levels being output, and for any current sense switch. Returns the number of commands - zero if nothing to program. */
+static uint16_t Programming(SPIData_t *const programming_sequence)
+{
+    uint16_t programming_count = 0;
+    // MC06XSD200 requires gives 1/256 PWM output when zero is set in the PWM register
+    // - to get fully off the "on" bit (bit 8) has to be cleared.
+    // Fully on is level 255.
+    uint16_t PWM_control_value_0 = 0;
+    uint16_t PWM_control_value_1 = 0;
+    if (output_level_0>0)
     {
-        case OFF:
-        case FAULT:
-            // nothing to do except stay off
-            break;
-        case STARTING0:
-            state = STARTING1;
-            break;
-        case STARTING1:
-            // enable timer and output compare for the PWM clock
-            OC1CONbits.OCM = 0b011; // output compare toggles pin
-            T3CONbits.TON = 1;
-            PORT_OUTPUT_WAKE = OUTPUT_WAKE_PORT_ACTIVE;
-            state = ON;
-            break;
-        case ON:
-            if (SPIIdle())
-            {
-                SPITransfer(initialization_sequence, INITIALIZATION_LENGTH);
-                state = INITIALIZING;
-            }
-            break;
-        case INITIALIZING:
-            if (SPIIdle())
-            {
-                SPITransfer(readback_sequence, READBACK_LENGTH);
-                state = READBACK;
-            }
-            break;
-        case READY:
-            readback = SPIData();
-            // check configuration is as it should be - FAULT if not
-            if ((readback == NULL)
-              || ((readback[STATR] & STATR_READBACK_MASK) != STATR_READBACK_VALUE)
-              || ((readback[FAULT_0] & FAULT_0_READBACK_MASK) != FAULT_0_READBACK_VALUE)
-              || ((readback[FAULT_1] & FAULT_1_READBACK_MASK) != FAULT_1_READBACK_VALUE)
-              || ((readback[PWMR_0] & PWM_0_READBACK_MASK) != PWM_0_READBACK_VALUE)
-              || ((readback[PWMR_1] & PWM_1_READBACK_MASK) != PWM_1_READBACK_VALUE)
-              || ((readback[CONFR_0] & CONFR_0_READBACK_MASK) != CONFR_0_READBACK_VALUE)
-              || ((readback[CONFR_1] & CONFR_1_READBACK_MASK) != CONFR_1_READBACK_VALUE)
-              || ((readback[OCR_0] & OCR_0_READBACK_MASK) != OCR_0_READBACK_VALUE)
-              || ((readback[OCR_1] & OCR_1_READBACK_MASK) != OCR_1_READBACK_VALUE)
-              || ((readback[RETRYR_0] & RETRYR_0_READBACK_MASK) != RETRYR_0_READBACK_VALUE)
-              || ((readback[RETRYR_1] & RETRYR_1_READBACK_MASK) != RETRYR_1_READBACK_VALUE)
-              || ((readback[GCR] & GCR_READBACK_MASK) != GCR_READBACK_VALUE))
+        PWM_control_value_0 = 0x0100|((output_level_0 -1)&0x00FF);
+    }
+    if (output_level_1>0)
+    {
+        PWM_control_value_1 = 0x0100|((output_level_1 -1)&0x00FF);
+    }
+    PWM_required_0 = PWM_control_value_0;
+    PWM_required_1 = PWM_control_value_1;
+    if (PWM_readback_0 != PWM_control_value_0)
+    {
+        programming_sequence[programming_count++] = Parity(PWM_0_VALUE | PWM_control_value_0);
+    }
+    if (PWM_readback_1 != PWM_control_value_1)
+    {
+        programming_sequence[programming_count++] = Parity(PWM_1_VALUE | PWM_control_value_1);
+    }
+    if (sense_switch)
+    {
+        programming_sequence[programming_count++] = (sense_channel == 0) ? GCR_SENSE_0_VALUE : GCR_SENSE_1_VALUE;
+    }
+    return programming_count;
+}
+
+
+/* Queues the transfer of a command sequence to the chip. The responses to the readback sequence (if it
+ * has one) start at the offset in the sequence. */
+static void Transfer(const SPIData_t *const sequence, const uint16_t length, const uint16_t offset)
+{
+    transaction.transmit = sequence;
+    transaction.length = length;
+    readback_offset = offset;
+    SPIQueue(&transaction);
+}
+
+
+/* Builds and queues the frame of programming commands followed by the readback (or status) sequence.
+ * Each command's response comes during the next word so the readback responses follow on from the
+ * programming commands and their PWMR responses are the levels just written. */
+static void TransferFrame(const SPIData_t *const sequence, const uint16_t length)
+{
+    uint16_t i;
+    uint16_t programming_count = Programming(frame);
+    for (i=0; i<length; ++i)
+    {
+        frame[programming_count + i] = sequence[i];
+    }
+    Transfer(frame, programming_count + length, programming_count);
+}
+
+
+/* Returns the responses to the readback sequence of the last transfer in register order */
+static const SPIData_t* Readback(void)
+{
+    return &responses[readback_offset];
+}
+
+
+/* Captures the readback (a full readback unless status only) and requested levels for the fault black box */
+static void CaptureFault(const SPIData_t *const readback, const bool status_only)
+{
+    fault_snapshot_t snapshot;
+    snapshot.STATR = (readback != NULL) ? readback[STATR] : FAULT_REGISTER_UNREAD;
+    snapshot.DIAGR = ((readback != NULL) && !status_only) ? readback[DIAGR] : FAULT_REGISTER_UNREAD;
+    snapshot.FAULT_0 = (readback != NULL) ? readback[FAULT_0] : FAULT_REGISTER_UNREAD;
+    snapshot.FAULT_1 = (readback != NULL) ? readback[FAULT_1] : FAULT_REGISTER_UNREAD;
+    snapshot.PWMR_0 = (readback != NULL) ? readback[PWMR_0] : FAULT_REGISTER_UNREAD;
+    snapshot.PWMR_1 = (readback != NULL) ? readback[PWMR_1] : FAULT_REGISTER_UNREAD;
+    snapshot.level_0 = PWM_level_0;
+    snapshot.level_1 = PWM_level_1;
+    FaultCapture(&snapshot);
+}
+
+
+/* The start up and readback sequence.
+ * Reset is held for at least RESET_TICKS since it was applied and the chip is given until the
+ * next tick after wake to come out of reset. Thereafter each step follows on as soon as the
+ * SPI is idle. Once ready the status is read back every READBACK_TICKS so that the
+ * chip's SPI watchdog is kept serviced and the output levels kept up to date - with the whole
+ * configuration every AUDIT_TICKS or after an anomaly. */
+static pt_status_t SwitchThread(pt_t *const pt)
+{
+    static uint16_t start_time; // Timer value at the start of the current wait
+#if (CALIBRATION_READBACKS > 0)
+    static uint16_t trial_divider; // SPI clock divider being tried
+    static uint16_t verified_divider; // fastest SPI clock divider found OK so far
+    static uint16_t settled_divider; // the one before - a step slower for margin
+    static uint8_t count;
+#endif
+    uint32_t sum;
+
+    PT_BEGIN(pt);
+    PT_WAIT_UNTIL(pt, (uint16_t)(Timer() - reset_time) >= RESET_TICKS);
+    // enable timer and output compare for the PWM clock
+    OC1CONbits.OCM = 0b011; // output compare toggles pin
+    T3CONbits.TON = 1;
+    PORT_OUTPUT_WAKE = OUTPUT_WAKE_PORT_ACTIVE;
+    start_time = Timer();
+    PT_WAIT_UNTIL(pt, Timer() != start_time);
+
+    sense_channel = 0; // as initialised
+    sense_switch = false;
+    Transfer(initialization_sequence, INITIALIZATION_LENGTH, 0);
+    PT_WAIT_WHILE(pt, SPIBusy(&transaction));
+
+#if (CALIBRATION_READBACKS > 0)
+    if (!calibrated)
+    {
+        calibrated = true;
+        verified_divider = SPIClockDivider(SPI_CS0);
+        settled_divider = verified_divider;
+        for (trial_divider = verified_divider - 1; trial_divider > 0; --trial_divider)
+        {
+            if (!SPISetClockDivider(SPI_CS0, trial_divider))
             {
-                SwitchChipOff();
-                state = FAULT;
+                continue; // not a rate that the prescales can make
             }
-            else
+            for (count = 0; count < CALIBRATION_READBACKS; ++count)
             {
-                // check whether the set output levels match the requested levels
-                // and re-program if different
-                uint8_t programming_count = 0;
-                // PWM required are exactly as requested if FAST_PWM mode
-                // software controlled SLOW_PWM mode puts the output fully on or fully off
-                // according to the software_PWM_counter value
-                uint16_t required_output_level_0 = ((PWM_mode_0==FAST_PWM)?PWM_level_0:((PWM_level_0>software_PWM_counter)?PWM_FULL_ON:PWM_FULL_OFF));
-                uint16_t required_output_level_1 = ((PWM_mode_1==FAST_PWM)?PWM_level_1:((PWM_level_1>software_PWM_counter)?PWM_FULL_ON:PWM_FULL_OFF));
-                // MC06XSD200 requires gives 1/256 PWM output when zero is set in the PWM register
-                // - to get fully off the "on" bit (bit 8) has to be cleared.
-                // Fully on is level 255.
-                uint16_t PWM_control_value_0 = 0;
-                uint16_t PWM_control_value_1 = 0;
-                if (required_output_level_0>0)
+                Transfer(readback_sequence, READBACK_LENGTH, 0);
+                PT_WAIT_WHILE(pt, SPIBusy(&transaction));
+                if (!ReadbackOK(Readback()))
                 {
-                    PWM_control_value_0 = 0x0100|((required_output_level_0 -1)&0x00FF);
+                    break;
                 }
-                if (required_output_level_1>0)
-                {
-                    PWM_control_value_1 = 0x0100|((required_output_level_1 -1)&0x00FF);
-                }
-                if ((readback[PWMR_0] & 0x1ff) != PWM_control_value_0)
-                {
-                    programming_sequence[programming_count++] = Parity(PWM_0_VALUE | PWM_control_value_0);
-                }
-                if ((readback[PWMR_1] & 0x1ff) != PWM_control_value_1)
-                {
-                    programming_sequence[programming_count++] = Parity(PWM_1_VALUE | PWM_control_value_1);
-                }
-                if (programming_count > 0)
-                {
-                    SPITransfer(programming_sequence, programming_count);
-                    state = PROGRAMMING;
-                }
-                else // if nothing better to do then readback again so that status can be checked
-                {
-                    SPITransfer(readback_sequence, READBACK_LENGTH);
-                    state = READBACK;
-                }
-            }
-            break;
-        case READBACK:
-            if (SPIIdle())
-            {
-                state = READY;
             }
-            break;
-        case PROGRAMMING:
-            if (SPIIdle())
+            if (count < CALIBRATION_READBACKS)
             {
-                SPITransfer(readback_sequence, READBACK_LENGTH);
-                state = READBACK;
+                break;
             }
-            break;
+            settled_divider = verified_divider;
+            verified_divider = trial_divider;
+        }
+        SPISetClockDivider(SPI_CS0, settled_divider);
+        // initialise again in case a failed rate upset the configuration
+        Transfer(initialization_sequence, INITIALIZATION_LENGTH, 0);
+        PT_WAIT_WHILE(pt, SPIBusy(&transaction));
+    }
+#endif
+
+    PWM_readback_0 = PWM_UNKNOWN;
+    PWM_readback_1 = PWM_UNKNOWN;
+    audit = true; // nothing is enabled until the whole configuration has been read back
+
+    while (true)
+    {
+        start_time = Timer();
+        // write any output levels that don't match the requested levels and read back the status
+        if ((uint16_t)(start_time - audit_time) >= AUDIT_TICKS)
+        {
+            audit = true;
+        }
+        if (audit)
+        {
+            audit_time = start_time;
+            TransferFrame(readback_sequence, READBACK_LENGTH);
+        }
+        else
+        {
+            TransferFrame(status_sequence, STATUS_LENGTH);
+        }
+        PT_WAIT_WHILE(pt, SPIBusy(&transaction));
+        // check configuration (or just the status) is as it should be - FAULT if not
+        if (!(audit ? ReadbackOK(Readback()) : StatusOK(Readback())))
+        {
+            CaptureFault(Readback(), !audit);
+            SwitchChipOff();
+            state = FAULT;
+            PT_EXIT(pt);
+        }
+        if (state == STARTING)
+        {
+            on_latency = TimerCount() - on_count;
+            state = READY;
+            ADCStart();
+        }
+        // the levels now set - anything that didn't take is written again in the next frame
+        PWM_readback_0 = Readback()[PWMR_0] & 0x1ff;
+        PWM_readback_1 = Readback()[PWMR_1] & 0x1ff;
+        // a level that didn't take is an anomaly - the whole configuration is checked with the rewrite
+        audit = (PWM_readback_0 != PWM_required_0) || (PWM_readback_1 != PWM_required_1);
+        if (sense_switch)
+        {
+            // the current sense is now on the other channel - the samples start again once it has settled
+            sense_switch = false;
+            ADCRestart();
+        }
+        else if (ADCPeriod(&sum))
+        {
+            // a PWM period of the channel - then the current sense is switched to the other one
+            channel_current[sense_channel] = (uint16_t)((sum * CURRENT_SCALE) >> 16);
+            sense_channel ^= 1;
+            sense_switch = true;
+        }
+        PT_WAIT_UNTIL(pt, (uint16_t)(Timer() - start_time) >= READBACK_TICKS);
+    }
+    PT_END(pt);
+}
+
+
+/* returns the level required of a channel - exactly as requested if FAST_PWM mode.
+ * Software controlled SLOW_PWM mode puts the output fully on or fully off according to the software_PWM_counter value */
+static uint16_t RequiredLevel(const uint16_t level, const PWM_mode_t mode)
+{
+    return (mode==FAST_PWM)?level:((level>software_PWM_counter)?PWM_FULL_ON:PWM_FULL_OFF);
+}
+
+
+/* returns the output level a tick further up the ramp towards the level required - falls are straight away */
+static uint16_t Ramp(const uint16_t output_level, const uint16_t required_level, const uint16_t rate,
+    const PWM_ramp_t curve)
+{
+    uint16_t step;
+    if ((required_level <= output_level) || (rate == PWM_RAMP_NONE))
+    {
+        return required_level;
+    }
+    step = (curve == EXPONENTIAL_RAMP) ? (uint16_t)(((uint32_t)output_level * rate) >> 8) : rate;
+    if (step == 0)
+    {
+        step = 1;
+    }
+    return ((required_level - output_level) > step) ? (output_level + step) : required_level;
+}
+
+
+/* adds a tick of the channel's current to its energy */
+static void Energy(const uint8_t channel)
+{
+    channel_energy_fraction[channel] += (uint32_t)channel_current[channel] * SUPPLY_MV * TIMER_PERIOD / 1000;
+    while (channel_energy_fraction[channel] >= MICRO_WATT_SECONDS)
+    {
+        channel_energy_fraction[channel] -= MICRO_WATT_SECONDS;
+        ++channel_energy[channel];
+    }
+}
+
+
+/* Must be invoked regularly (per timer tick) so as to keep the software PWM counting, the output levels
+ * ramping and the energy integrated */
+void MC06XSD200Tasks(void)
+{
+    ++software_PWM_counter;
+    if (state == READY)
+    {
+        output_level_0 = Ramp(output_level_0, RequiredLevel(PWM_level_0, PWM_mode_0), ramp_rate_0, ramp_curve_0);
+        output_level_1 = Ramp(output_level_1, RequiredLevel(PWM_level_1, PWM_mode_1), ramp_rate_1, ramp_curve_1);
+        MetersTick(0, PWM_level_0);
+        MetersTick(1, PWM_level_1);
+        Energy(0);
+        Energy(1);
+    }
+    else
+    {
+        // the ramps start from off when the chip is ready
+        output_level_0 = PWM_FULL_OFF;
+        output_level_1 = PWM_FULL_OFF;
+    }
+}
+
+
+/* Must be invoked on every timer tick and SPI done event so as to keep the watchdog serviced
+   and the output states up to date etc. Runs the start up and readback sequence on as far as it can go. */
+void MC06XSD200Thread(void)
+{
+    if ((state == STARTING) || (state == READY))
+    {
+        SwitchThread(&thread);
     }
 }
@@ -21,8 +21,14 @@
  * the PWM frequency.
  * SLOW_PWM is software controlled. The hardware PWM output is either fully on or fully off but cycled slowly
  * under software control over 256 timer ticks (2.56 seconds at 10ms timer ticks).
+ *
+ * Each channel's output level rises are slew limited by its ramp (SetPWMRamp0 and SetPWMRamp1) - linear or
+ * exponential. By default there is no ramp.
+ *
+ * Once the chip is ready the load current of each channel is measured in turn through the chip's current
+ * sense output and the ADC, and integrated into the energy delivered by each channel.
  * 
- * SPI and ports and the system timer must have been initialised prior to
+ * SPI and ports and the system timer and the ADC must have been initialised prior to
  * initialising this module.
  */
 
@@ -42,6 +48,9 @@ extern "C" {
 
 typedef enum {SLOW_PWM, FAST_PWM} PWM_mode_t;
 
+typedef enum {LINEAR_RAMP, EXPONENTIAL_RAMP} PWM_ramp_t;
+#define PWM_RAMP_NONE 0 // ramp rate for level rises to be output straight away
+
 /* Requests PWM level for switch channel 0 and 1 respectively.
  * Values 0-256. 0 = fully off, 256 = fully on.
  * Will take effect only when switch chip is on.
@@ -49,6 +58,24 @@ typedef enum {SLOW_PWM, FAST_PWM} PWM_mode_t;
 void SetPWMLevel0(const uint16_t level, const PWM_mode_t const mode);
 void SetPWMLevel1(const uint16_t level, const PWM_mode_t mode);
 
+/* Return the PWM levels last requested for switch channel 0 and 1 respectively */
+uint16_t PWMLevel0(void);
+uint16_t PWMLevel1(void);
+
+/* Sets the ramp of the output level rises for switch channel 0 and 1 respectively.
+ * LINEAR_RAMP rises by the rate in levels per tick. EXPONENTIAL_RAMP rises by the rate in 256ths of the
+ * level being output per tick (at least a level per tick). PWM_RAMP_NONE for rises straight away.
+ * Falls are always straight away. */
+void SetPWMRamp0(const uint16_t rate, const PWM_ramp_t curve);
+void SetPWMRamp1(const uint16_t rate, const PWM_ramp_t curve);
+
+/* Returns the load current last measured for switch channel 0 or 1 - mA averaged over a PWM period.
+ * Zero while the chip isn't ready. */
+uint16_t SwitchChannelCurrent(const uint8_t channel);
+
+/* Returns the energy delivered by switch channel 0 or 1 since reset - Ws at the nominal supply voltage */
+uint32_t SwitchChannelEnergy(const uint8_t channel);
+
 
 /* turns the switch chip off - holds in reset */
 void SwitchChipOff(void);
@@ -62,10 +89,21 @@ void SwitchChipOn(void);
  have been turned off. Can be retried by invoking SwitchChipOn. */
 bool SwitchChipFault(void);
 
-/* Must be invoked regularly (per timer tick) so as to keep the watchdog serviced
-   and the output states up to date etc.*/
+/* returns the time in timer counts (see TimerCount) from the last SwitchChipOn to the
+ * chip having been initialised and its configuration read back OK - i.e. outputs enabled.
+ * Zero if the chip hasn't got that far yet. About two ticks from a reset (the simulator reports it
+ * - about 21ms in the ride scenario): the reset is held over a whole tick and the wake takes another, then
+ * the initialisation and readback transfers follow back to back. */
+uint32_t SwitchChipOnLatency(void);
+
+/* Must be invoked regularly (per timer tick) so as to keep the software PWM counting, the output levels
+ * ramping and the energy integrated */
 void MC06XSD200Tasks(void);
 
+/* Must be invoked on every timer tick and SPI done event so as to keep the watchdog serviced
+   and the output states up to date etc. */
+void MC06XSD200Thread(void);
+
 /* puts the switch chip in reset and initialises the state machine.
  * SwitchChipOn should be invoked after this if the switch chip is actually to do
  * anything */
@@ -8,75 +8,355 @@
  * Should be Initialised before first use.
  * 
  * Sets up for unframed (3 wire) 16 bit Master mode.
- * CS0 is driven in software (it's not on a re-mappable port).
- * CS1 is left undriven so this module will need some modification if the expansion connector has
- * an SPI device on it.
+ * The SCK divider for SPI_CLOCK_FREQUENCY is worked out from the primary (1, 4, 16 or 64) and secondary
+ * (1 to 8) prescales at compile time. Each chip select has its own divider which is set up as each of
+ * its transactions is started - the SPI has to be disabled to change the prescales.
  *
- * SPI transfers are initiated by invoking SPITransfer with a pointer to an array of
- * SPIData_t values while the SPI is idle (use SPIIdle to determine).
- * When the transfer is complete SPIIdle will return true and SPIData will return a pointer to
- * an array of SPIData_t values that were received from the SPI slave during the transfer.
- * The maximum number of words that can be transferred in one go is SPI_MAX_WORDS due to the sizing of the
- * receive buffer.
- * 
- * SPI data is transferred under interrupt control so an idling processor will get an
- * interrupt wake up several times including immediately as SPIIdle becomes true.
+ * Transactions are queued by SPIQueue in priority order as a linked list of the caller's
+ * SPI_transaction_t structures - there is no allocation and no limit on the number queued.
+ * The head of the queue is started as soon as the SPI is free - by SPIQueue if it is idle, otherwise from
+ * the interrupt that completes the transaction before. On completion the received words are copied from
+ * the DMA buffer to the caller's buffer and the callback invoked.
+ * The queue is shared with the interrupts so it is only changed from the main line with them disabled.
  * 
+ * The words are moved by DMA - channel 0 loads SPI1BUF from the transmit buffer and channel 1 stores
+ * SPI1BUF to the receive buffer - so the CPU only gets the interrupts to start and complete a transaction.
+ *
+ * The switch chip needs CS0 taken inactive between every word. CS0 (RP12) is remapped to output compare 4
+ * for the duration of a transaction. Output compare 4 runs in continuous pulse mode on timer 3 - CS0 goes
+ * inactive (high) at OC4R after each word and active (low) again at OC4RS just before the end of the
+ * timer 3 period. Timer 3 is the DMA channel 0 request so each word starts as the period ends.
+ * The CS0 setup, hold and inactive times are given in ns and converted to counts from FCY at compile time
+ * so they stay correct at any clock - there are no software delays.
+ * So the words are a timer 3 period apart and timer 3 must be running - it is the switch chip's
+ * PWM clock timebase (see MC06XSD200.c) and so is running whenever the switch chip is on. A CS0
+ * transaction started while timer 3 is stopped is aborted rather than holding up the queue.
+ *
+ * A CS0 transaction is started from the output compare 4 interrupt (in single compare mode) part way through
+ * the period where CS0 can go active without a spurious frame before the first word.
+ * It remaps CS0 and enables the DMA. The DMA channel 1 interrupt at the end of the last word remaps
+ * CS0 back to the port - the DMA and interrupt latency covers the CS0 hold time after the last clock.
+ *
+ * CS1 is held active for the whole of a transaction so its words run back to back - both DMA channels
+ * are requested by the SPI as each word completes and the first word is forced. CS1 is taken active
+ * before the first word is forced and inactive again in the DMA channel 1 interrupt.
+ *
  */
 
 #include "SPI.h"
 #include "ports.h"
 #include "xc.h"
 #include "interrupts.h"
+#include "events.h"
+#include "hardware.h"
+
+
+// SPI clock - FCY divided by the primary and secondary prescales - the smallest divider not faster
+// than SPI_CLOCK_FREQUENCY using the smallest primary prescale that will do
+#define SPI_DIVIDER_NEEDED ((FCY + SPI_CLOCK_FREQUENCY - 1) / SPI_CLOCK_FREQUENCY)
+#if SPI_DIVIDER_NEEDED <= 8
+#define SPI_PRIMARY_PRESCALE 1
+#elif SPI_DIVIDER_NEEDED <= 32
+#define SPI_PRIMARY_PRESCALE 4
+#elif SPI_DIVIDER_NEEDED <= 128
+#define SPI_PRIMARY_PRESCALE 16
+#elif SPI_DIVIDER_NEEDED <= 512
+#define SPI_PRIMARY_PRESCALE 64
+#else
+#error "SPI_CLOCK_FREQUENCY is too low for the SPI prescales"
+#endif
+#define SPI_SECONDARY_PRESCALE ((SPI_DIVIDER_NEEDED + SPI_PRIMARY_PRESCALE - 1) / SPI_PRIMARY_PRESCALE)
+#define SPI_CLOCK_DIVIDER (SPI_PRIMARY_PRESCALE * SPI_SECONDARY_PRESCALE)
+#define SPI_MINIMUM_DIVIDER 2 // the prescales mustn't both be 1:1
+
+#if (SPI_CLOCK_DIVIDER < SPI_MINIMUM_DIVIDER) || (FCY / SPI_CLOCK_DIVIDER > SPI_MAXIMUM_CLOCK_FREQUENCY)
+#error "SPI_CLOCK_FREQUENCY is too high"
+#endif
+
+// CS0 timings required by the switch chip in ns
+#define CS_SETUP_TIME 500 // CS0 active before the first clock
+#define CS_HOLD_TIME 500 // CS0 still active after the last clock
+#define CS_INACTIVE_TIME 1000 // CS0 inactive between words
+
+// CS0 framing in timer 3 counts - timer 3 counts instruction cycles so these follow FCY
+#define WORD_COUNTS(divider) (16 * (divider))
+#define DMA_LATENCY_COUNTS 4 // from the end of the timer 3 period to SPI1BUF loaded by the DMA
+#define CS_SETUP_COUNTS NS_TO_CYCLES(CS_SETUP_TIME)
+#define CS_HOLD_COUNTS NS_TO_CYCLES(CS_HOLD_TIME)
+#define CS_INACTIVE_COUNTS NS_TO_CYCLES(CS_INACTIVE_TIME)
+#define CS_RISE(divider) (DMA_LATENCY_COUNTS + WORD_COUNTS(divider) + CS_HOLD_COUNTS) // OC4R - CS0 inactive after each word
+#define CS_FALL (PWM_TIMER_PERIOD + 1 - CS_SETUP_COUNTS) // OC4RS - CS0 active before each word
+
+#if CS_RISE(SPI_CLOCK_DIVIDER) + CS_INACTIVE_COUNTS > CS_FALL
+#error "The timer 3 period is too short for an SPI word with the CS0 timings"
+#endif
+
+// DMA request sources
+#define DMA_REQUEST_TIMER3 0x0008
+#define DMA_REQUEST_SPI1 0x000A
+#define DMA_REQUEST_FORCE 0x8000 // forces a single transfer - cleared by the hardware
+
+// output compare modes
+#define OC_OFF 0b000
+#define OC_SINGLE_COMPARE 0b001
+#define OC_CONTINUOUS_PULSE 0b101
+
+static SPIData_t transmit_buffer[SPI_MAX_WORDS] __attribute__((space(dma))); // data to transmit
+static SPIData_t receive_buffer[SPI_MAX_WORDS] __attribute__((space(dma))); // data received from the slave during transfer
+static SPI_transaction_t *volatile queue; // transactions waiting to be started - highest priority first
+static SPI_transaction_t *volatile active; // transaction in progress - NULL if the SPI is idle
+
+// SCK for each chip select - the divider, the primary and secondary prescale register values for it
+// and the SPI mode (clock polarity and phase)
+typedef struct
+{
+    uint16_t divider;
+    uint8_t primary;
+    uint8_t secondary;
+    uint8_t mode;
+} SPI_clock_t;
+static SPI_clock_t clocks[2];
+static SPI_clock_t clock_set_up; // the clock the SPI is set up for
+static uint16_t CS_rise; // CS_RISE for the CS0 divider
+
+
+/* Works out the prescale register values for the divider - returns false if the prescales can't make it */
+static bool Prescales(const uint16_t divider, SPI_clock_t *const clock)
+{
+    uint8_t i;
+    uint16_t primary_prescale = 1;
+    for (i=0; i<4; ++i)
+    {
+        if (((divider % primary_prescale) == 0) && ((divider / primary_prescale) <= 8))
+        {
+            clock->divider = divider;
+            clock->primary = 0b11 - i; // 0b11 to 0b00 are 1:1, 4:1, 16:1 and 64:1
+            clock->secondary = 8 - (divider / primary_prescale); // 0b111 to 0b000 are 1:1 to 8:1
+            return divider >= SPI_MINIMUM_DIVIDER;
+        }
+        primary_prescale *= 4;
+    }
+    return false;
+}
+
+
+/* Sets the SPI up for the clock - it has to be disabled to change the prescales or the mode */
+static void SetClock(const SPI_clock_t *const clock)
+{
+    if ((clock->divider != clock_set_up.divider) || (clock->mode != clock_set_up.mode))
+    {
+        _SPIEN = 0;
+        _PPRE = clock->primary;
+        _SPRE = clock->secondary;
+        _CKP = (clock->mode >> 1) & 1; // SCK idles high in modes 2 and 3
+        _CKE = (clock->mode & 1) ? 0 : 1; // data out on the leading clock edge in modes 1 and 3
+        _SPIEN = 1;
+        clock_set_up = *clock;
+    }
+}
+
+
+/* Maps CS0 to output compare 4 (framed by hardware) or back to the port (inactive) */
+static void MapCS0(const bool framed)
+{
+    uint8_t oscconl_value;
+    oscconl_value = OSCCONL;
+    __builtin_write_OSCCONL(oscconl_value & ~_OSCCON_IOLOCK_MASK); // clear the IOLOCK
+    _RP12R = framed ? _RPOUT_OC4 : 0;
+    __builtin_write_OSCCONL(oscconl_value | _OSCCON_IOLOCK_MASK); // make sure that the IOLOCK is set
+}
+
+
+/* Stops the DMA and the chip select framing of the active transaction */
+static void Stop(void)
+{
+    _OC4IE = 0;
+    DMA0CONbits.CHEN = 0;
+    DMA1CONbits.CHEN = 0;
+    MapCS0(false);
+    OC4CONbits.OCM = OC_OFF;
+    PORT_CS1 = CS1_PORT_INACTIVE;
+    _OC4IF = 0;
+    _DMA1IF = 0;
+}
+
+
+/* Completes the active transaction with the given status */
+static void Complete(const SPI_status_t status)
+{
+    uint16_t i;
+    SPI_transaction_t *const transaction = active;
+    active = NULL;
+    if ((status == SPI_DONE) && (transaction->receive != NULL))
+    {
+        for (i=0; i<transaction->length; ++i)
+        {
+            transaction->receive[i] = receive_buffer[i];
+        }
+    }
+    transaction->status = status;
+    if (transaction->callback != NULL)
+    {
+        transaction->callback(transaction);
+    }
+    EventSignal(EVENT_BIT_SPI_DONE);
+}
 
 
-static SPIData_t received_data[SPI_MAX_WORDS]; // data received from the slave during transfer
-static SPIData_t const* transmit_data; // pointer to data to transmit. NULL if idle.
-static uint16_t words_remaining; // number of words still to transfer. Zero if idle.
-static uint16_t current_word; // index value of the word currently in transfer
+/* Starts the transaction at the head of the queue if the SPI is free.
+ * Must be called from the SPI interrupts or with them disabled. */
+static void Start(void)
+{
+    uint16_t i;
+    SPI_transaction_t *transaction;
+    while ((active == NULL) && (queue != NULL))
+    {
+        transaction = queue;
+        queue = transaction->next;
+        active = transaction;
+        transaction->status = SPI_ACTIVE;
+        for (i=0; i<transaction->length; ++i)
+        {
+            transmit_buffer[i] = transaction->transmit[i];
+        }
+        DMA0CNT = transaction->length - 1;
+        DMA1CNT = transaction->length - 1;
+        SetClock(&clocks[transaction->chip_select]);
+        if (transaction->chip_select == SPI_CS1)
+        {
+            // words back to back - the first forced and then each as the one before completes
+            DMA0REQ = DMA_REQUEST_SPI1;
+            PORT_CS1 = CS1_PORT_ACTIVE;
+            DMA1CONbits.CHEN = 1;
+            DMA0CONbits.CHEN = 1;
+            DMA0REQ = DMA_REQUEST_SPI1 | DMA_REQUEST_FORCE;
+        }
+        else if (T3CONbits.TON)
+        {
+            // start from the output compare 4 interrupt between the CS0 rise and fall points
+            DMA0REQ = DMA_REQUEST_TIMER3;
+            OC4CONbits.OCM = OC_OFF;
+            OC4R = (CS_rise + CS_FALL) / 2;
+            _OC4IF = 0;
+            _OC4IE = 1;
+            OC4CONbits.OCM = OC_SINGLE_COMPARE;
+        }
+        else
+        {
+            Complete(SPI_ABORTED); // no timer 3 to frame CS0 - would never complete
+        }
+    }
+}
 
 
-/* Returns true if the SPI is idle and so is able to accept a new SPITransfer.
- * If there has previously been an SPI transfer then the SPIData will return
- * the values received from the slave during that transfer. */
+/* Returns true if no transaction is queued or in progress */
 bool SPIIdle(void)
 {
-    return (transmit_data == NULL);
+    return active == NULL;
+}
+
+
+/* Queues a transaction. Returns false (and does nothing) if it is already queued or in progress or its
+ * length is out of range. The transaction must not be changed until it is complete. */
+bool SPIQueue(SPI_transaction_t *const transaction)
+{
+    SPI_transaction_t *volatile *link;
+    if (SPIBusy(transaction) || (transaction->length == 0) || (transaction->length > SPI_MAX_WORDS))
+    {
+        return false;
+    }
+    transaction->status = SPI_QUEUED;
+    __builtin_disi(0x3FFF); // interrupts off while the queue is changed
+    // after any others of the same or higher priority
+    for (link = &queue; (*link != NULL) && ((*link)->priority >= transaction->priority); link = &(*link)->next)
+    {
+    }
+    transaction->next = *link;
+    *link = transaction;
+    Start();
+    DISICNT = 0; // and back on again
+    return true;
+}
+
+
+/* Returns true while the transaction is queued or in progress */
+bool SPIBusy(const SPI_transaction_t *const transaction)
+{
+    return (transaction->status == SPI_QUEUED) || (transaction->status == SPI_ACTIVE);
+}
+
+
+/* Abandons all of the transactions for the chip select - queued or in progress - e.g. when timer 3 is
+ * stopped. Their status is set to SPI_ABORTED. */
+void SPIAbort(const SPI_chip_select_t chip_select)
+{
+    SPI_transaction_t *volatile *link;
+    SPI_transaction_t *transaction;
+    __builtin_disi(0x3FFF); // interrupts off while the queue is changed
+    link = &queue;
+    while (*link != NULL)
+    {
+        transaction = *link;
+        if (transaction->chip_select == chip_select)
+        {
+            *link = transaction->next;
+            transaction->status = SPI_ABORTED;
+            if (transaction->callback != NULL)
+            {
+                transaction->callback(transaction);
+            }
+        }
+        else
+        {
+            link = &transaction->next;
+        }
+    }
+    if ((active != NULL) && (active->chip_select == chip_select))
+    {
+        Stop();
+        Complete(SPI_ABORTED);
+        Start();
+    }
+    DISICNT = 0; // and back on again
 }
 
 
-/* Initiates a transfer of length words pointed to by data.
- * Will do nothing if SPI is not idle at the time of invocation.
- * SPIIdle will return true when the transfer is complete at which time
- * SPIData will return a pointer to the values received from the slave */
-void SPITransfer(const SPIData_t *const data, const uint16_t length)
+/* Sets the SCK divider (FCY/SCK) for the chip select's transactions from the next one started.
+ * Returns false (and leaves it unchanged) if the prescales can't make the divider exactly, if the SCK rate
+ * would be above SPI_MAXIMUM_CLOCK_FREQUENCY or if a CS0 word would no longer fit in the timer 3 period. */
+bool SPISetClockDivider(const SPI_chip_select_t chip_select, const uint16_t divider)
 {
-    if ((transmit_data == NULL) && (length > 0))
+    SPI_clock_t clock = clocks[chip_select];
+    if (!Prescales(divider, &clock) || ((FCY / divider) > SPI_MAXIMUM_CLOCK_FREQUENCY)
+      || ((chip_select == SPI_CS0) && ((CS_RISE(divider) + CS_INACTIVE_COUNTS) > CS_FALL)))
+    {
+        return false;
+    }
+    __builtin_disi(0x3FFF); // interrupts off while the clock is changed - a transaction could be starting
+    clocks[chip_select] = clock;
+    if (chip_select == SPI_CS0)
     {
-        current_word = 0;
-        words_remaining = length>SPI_MAX_WORDS?SPI_MAX_WORDS:length;
-        transmit_data = data;
-        PORT_CS0 = CS0_PORT_ACTIVE; // select slave and then wait 500ns before initiating transfer
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        SPI1BUF = transmit_data[current_word];
+        CS_rise = CS_RISE(divider);
     }
+    DISICNT = 0; // and back on again
+    return true;
 }
 
 
-/* Returns a pointer to an array of words received from the SPI slave device
- * during the last transfer or NULL of the SPI is not idle.
- * The number of valid words received will be the same as the length of the
- * transmitted data */
-SPIData_t* SPIData(void)
+/* Returns the SCK divider (FCY/SCK) for the chip select's transactions */
+uint16_t SPIClockDivider(const SPI_chip_select_t chip_select)
 {
-    return (transmit_data)?NULL:received_data;
+    return clocks[chip_select].divider;
+}
+
+
+/* Sets the SPI mode (0 to 3 - clock polarity and phase) for the chip select's transactions from the next
+ * one started */
+void SPISetMode(const SPI_chip_select_t chip_select, const uint8_t mode)
+{
+    __builtin_disi(0x3FFF); // interrupts off while the mode is changed - a transaction could be starting
+    clocks[chip_select].mode = mode & 0b11;
+    DISICNT = 0; // and back on again
 }
 
 
@@ -84,10 +364,15 @@ SPIData_t* SPIData(void)
  * Ports must be initialised first. */
 void InitializeSPI(void)
 {
-    words_remaining = 0;
-    current_word = 0;
-    transmit_data = NULL;
+    queue = NULL;
+    active = NULL;
+    Prescales(SPI_CLOCK_DIVIDER, &clocks[SPI_CS0]);
+    clocks[SPI_CS0].mode = SPI_SWITCH_CHIP_MODE;
+    clocks[SPI_CS1] = clocks[SPI_CS0];
+    clock_set_up = clocks[SPI_CS0];
+    CS_rise = CS_RISE(SPI_CLOCK_DIVIDER);
     PORT_CS0 = CS0_PORT_INACTIVE; // make sure that chip is not selected
+    PORT_CS1 = CS1_PORT_INACTIVE;
     _MSTEN = 1;
     _SPISIDL = 0;
     _SPIROV = 0;
@@ -95,59 +380,82 @@ void InitializeSPI(void)
     _DISSDO = 0;
     SPI1CON1bits.MODE16 = 1;
     _SMP = 1;
-    _CKP = 0;
+    _CKP = 0; // SPI_SWITCH_CHIP_MODE
     _CKE = 0;
     _SSEN = 0;
     _FRMEN = 0; // unframed mode
     _SPIFSD = 0;
     _FRMPOL = 0;
     _FRMDLY = 0;
-    _SPRE = 0b111; // 1:1 secondary clock prescale
-     _PPRE = 0b01; // 1:16 primary clock prescale - 1MHz
+    _SPRE = clocks[SPI_CS0].secondary; // secondary and primary clock prescales for SPI_CLOCK_FREQUENCY
+    _PPRE = clocks[SPI_CS0].primary;
     _SPI1IF = 0;
-    _SPI1IP = SPI_INTERRUPT_PRIORITY;
-    _SPI1IE = 1;
+    _SPI1IE = 0; // the SPI interrupt is the DMA request
     _SPIEN = 1;
+
+    // output compare 4 frames CS0 on timer 3
+    OC4CONbits.OCM = OC_OFF;
+    OC4CONbits.OCSIDL = 0; // don't stop on idle
+    OC4CONbits.OCTSEL = 1; // output compare based on timer 3
+    _OC4IF = 0;
+    _OC4IE = 0;
+    _OC4IP = SPI_INTERRUPT_PRIORITY;
+
+    // DMA channel 0 - transmit buffer to SPI1BUF on each timer 3 period (CS0) or SPI word done (CS1)
+    DMA0CONbits.CHEN = 0;
+    DMA0CON = 0x2001; // word, RAM to peripheral, post-increment, one-shot
+    DMA0PAD = (uint16_t) &SPI1BUF;
+    DMA0REQ = DMA_REQUEST_TIMER3;
+    DMA0STA = __builtin_dmaoffset(transmit_buffer);
+
+    // DMA channel 1 - SPI1BUF to receive buffer as each word completes
+    DMA1CONbits.CHEN = 0;
+    DMA1CON = 0x0001; // word, peripheral to RAM, post-increment, one-shot
+    DMA1PAD = (uint16_t) &SPI1BUF;
+    DMA1REQ = DMA_REQUEST_SPI1;
+    DMA1STA = __builtin_dmaoffset(receive_buffer);
+    _DMA1IF = 0;
+    _DMA1IP = SPI_INTERRUPT_PRIORITY;
+    _DMA1IE = 1;
 }
 
 
-// Interrupt service for SPI transfer complete
-void __attribute__((interrupt(no_auto_psv))) _SPI1Interrupt(void)
+// Interrupt service for the start of a CS0 transaction - part way through the timer 3 period
+void __attribute__((interrupt(no_auto_psv))) _OC4Interrupt(void)
 {
-    received_data[current_word++] = SPI1BUF;
-    while (_RB13); // wait for clock to go low if it isn't already
-    PORT_CS0 = CS0_PORT_INACTIVE; // Slave chip unselect
-    if (--words_remaining > 0)
+    _OC4IF = 0;
+    if ((TMR3 < CS_rise) || (TMR3 >= CS_FALL))
     {
-        asm(" nop"); // CS0 must have been inactive for 1uS before taking it active again
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        PORT_CS0 = CS0_PORT_ACTIVE; // select slave and then wait 500ns before initiating transfer
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        asm(" nop");
-        SPI1BUF = transmit_data[current_word];
+        // held up too long for this period - there wouldn't be the setup time before the first word
+        // or CS0 would go inactive again before it - so start in the next period
+        OC4CONbits.OCM = OC_OFF;
+        OC4CONbits.OCM = OC_SINGLE_COMPARE;
+        return;
+    }
+    _OC4IE = 0;
+    OC4CONbits.OCM = OC_OFF;
+    OC4R = CS_rise;
+    OC4RS = CS_FALL;
+    OC4CONbits.OCM = OC_CONTINUOUS_PULSE; // output starts low - CS0 active until the first word is done
+    MapCS0(true);
+    DMA1CONbits.CHEN = 1;
+    DMA0CONbits.CHEN = 1; // first word at the end of this period
+}
+
+
+// Interrupt service for the transaction complete - the last word received. Starts the next one.
+void __attribute__((interrupt(no_auto_psv))) _DMA1Interrupt(void)
+{
+    _DMA1IF = 0;
+    if (active->chip_select == SPI_CS1)
+    {
+        PORT_CS1 = CS1_PORT_INACTIVE; // Slave chip unselect
     }
     else
     {
-        transmit_data = NULL;
+        MapCS0(false); // Slave chip unselect
+        OC4CONbits.OCM = OC_OFF;
     }
-    _SPI1IF = 0;
+    Complete(SPI_DONE);
+    Start();
 }
-
-
-
-
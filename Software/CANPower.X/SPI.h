@@ -8,19 +8,29 @@
  * Should be Initialized before first use.
  * 
  * Sets up for unframed (3 wire) 16 bit Master mode.
- * CS0 is driven in software (it's not on a re-mappable port).
- * CS1 is left undriven so this module will need some modification if the expansion connector has
- * an SPI device on it.
+ * The SCK rate is set at build time by SPI_CLOCK_FREQUENCY - the fastest rate the prescales can make that
+ * is not above it. Each chip select can then be given its own rate by SPISetClockDivider (e.g. once
+ * a faster rate has been verified with the device) and its own SPI mode by SPISetMode. Both start out as
+ * the switch chip's.
+ * CS0 is framed by hardware (output compare 4 on timer 3) and so only works while timer 3 is running.
+ * CS1 (RC6 - there being no expansion connector as such) is held active by software for the whole of
+ * a transfer.
  * 
- * SPI transfers are initiated by invoking SPITransfer with a pointer to an array of
- * SPIData_t values while the SPI is idle (use SPIIdle to determine).
- * When the transfer is complete SPIIdle will return true and SPIData will return a pointer to
- * an array of SPIData_t values that were received from the SPI slave during the transfer.
- * The maximum number of words that can be transferred in one go is SPI_MAX_WORDS due to the sizing of the
- * receive buffer.
+ * Transfers are queued transactions (SPI_transaction_t) owned by the caller. Each carries its chip select,
+ * the words to transmit, a buffer for the words received (or NULL), the number of words, a priority and
+ * a completion callback (or NULL). SPIQueue adds a transaction and SPIBusy returns true until it is complete.
+ * The maximum number of words that can be transferred in one transaction is SPI_MAX_WORDS due to the
+ * sizing of the DMA buffers.
  * 
- * SPI data is transferred under interrupt control so an idling processor will get an
- * interrupt wake up several times including immediately as SPIIdle becomes true.
+ * The queue is ordered by priority - higher first, in the order queued for the same priority. Each
+ * transaction is started from the interrupt as the one before completes, so they run back to back without
+ * waiting on the main loop. A transaction in progress isn't pre-empted so a higher priority one (e.g. the
+ * switch chip watchdog kick) waits for at most one SPI_MAX_WORDS transaction.
+ * 
+ * SPI data is transferred by DMA so an idling processor gets just two interrupt wake ups
+ * per CS0 transaction - one to start it and one as it completes - and one per CS1 transaction.
+ * The completion callback is invoked from that interrupt (or from SPIAbort) and the SPI done event
+ * (see events.h) is signalled as each transaction completes.
  * 
  */
 
@@ -35,31 +45,78 @@
 extern "C" {
 #endif
 
-// maximum number of words that can be transferred per invocation
-#define SPI_MAX_WORDS 16
+// maximum number of words that can be transferred per transaction - enough for an SPI flash 256 byte
+// page program with its command and address
+#define SPI_MAX_WORDS 130
+
+// the switch chip's SPI mode - clock idles low, data changes on the leading edge and is sampled on the trailing
+#define SPI_SWITCH_CHIP_MODE 1
+
+// SCK rates - the build time rate for all of the chip selects and the fastest rate any device can take
+// (the switch chip's maximum)
+#define SPI_CLOCK_FREQUENCY 1000000UL
+#define SPI_MAXIMUM_CLOCK_FREQUENCY 8000000UL
+
+// transaction priorities of the SPI devices - the switch chip's watchdog must be kept serviced
+#define SPI_PRIORITY_SWITCH_CHIP 2
+#define SPI_PRIORITY_EXPANSION 1
 
     
 typedef uint16_t SPIData_t;
 
+typedef enum {SPI_CS0=0, SPI_CS1} SPI_chip_select_t;
+
+typedef enum {SPI_IDLE=0, SPI_QUEUED, SPI_ACTIVE, SPI_DONE, SPI_ABORTED} SPI_status_t;
+
+typedef struct SPI_transaction SPI_transaction_t;
+
+// invoked at the SPI interrupt priority as a transaction completes or is aborted
+typedef void (*SPI_callback_t)(SPI_transaction_t *const transaction);
+
+struct SPI_transaction
+{
+    SPI_chip_select_t chip_select;
+    const SPIData_t *transmit; // words to transmit
+    SPIData_t *receive; // words received from the slave are copied here on completion - NULL if not needed
+    uint16_t length; // words - 1 to SPI_MAX_WORDS
+    uint8_t priority; // higher priority transactions are started first
+    SPI_callback_t callback; // NULL if not needed
+    volatile SPI_status_t status; // set by the SPI module
+    SPI_transaction_t *next; // queue link - only for the SPI module
+};
+
 
-/* Returns true if the SPI is idle and so is able to accept a new SPITransfer.
- * If there has previously been an SPI transfer then the SPIData will return
- * the values received from the slave during that transfer. */
+/* Returns true if no transaction is queued or in progress */
 bool SPIIdle(void);
 
 
-/* Initiates a transfer of length words pointed to by data.
- * Will do nothing if SPI is not idle at the time of invocation.
- * SPIIdle will return true when the transfer is complete at which time
- * SPIData will return a pointer to the values received from the slave */
-void SPITransfer(const SPIData_t *const data, const uint16_t length);
+/* Queues a transaction. Returns false (and does nothing) if it is already queued or in progress or its
+ * length is out of range. The transaction must not be changed until it is complete. */
+bool SPIQueue(SPI_transaction_t *const transaction);
 
 
-/* Returns a pointer to an array of words received from the SPI slave device
- * during the last transfer or NULL of the SPI is not idle.
- * The number of valid words received will be the same as the length of the
- * transmitted data */
-SPIData_t* SPIData(void);
+/* Returns true while the transaction is queued or in progress */
+bool SPIBusy(const SPI_transaction_t *const transaction);
+
+
+/* Abandons all of the transactions for the chip select - queued or in progress - e.g. when timer 3 is
+ * stopped. Their status is set to SPI_ABORTED. */
+void SPIAbort(const SPI_chip_select_t chip_select);
+
+
+/* Sets the SCK divider (FCY/SCK) for the chip select's transactions from the next one started.
+ * Returns false (and leaves it unchanged) if the prescales can't make the divider exactly, if the SCK rate
+ * would be above SPI_MAXIMUM_CLOCK_FREQUENCY or if a CS0 word would no longer fit in the timer 3 period. */
+bool SPISetClockDivider(const SPI_chip_select_t chip_select, const uint16_t divider);
+
+
+/* Returns the SCK divider (FCY/SCK) for the chip select's transactions */
+uint16_t SPIClockDivider(const SPI_chip_select_t chip_select);
+
+
+/* Sets the SPI mode (0 to 3 - clock polarity and phase) for the chip select's transactions from the next
+ * one started */
+void SPISetMode(const SPI_chip_select_t chip_select, const uint8_t mode);
 
 
 /* Must be called once at initialisation time prior to using any of the functionality in the SPI module.
@@ -71,4 +128,3 @@ void InitializeSPI(void);
 #endif
 
 #endif	/* SPI_H */
-
@@ -21,7 +21,11 @@
  * A long press (>20 seconds) of the control button toggles between modulated and unmodulated modes.
  * A short press (<1 second) of the control button while in modulated mode cycles through the modulation levels.
  * Channel 0 mode and modulation level are stored in EEPROM at power off time (immmediately prior to transition to the
- * alarm simulation state)).
+ * alarm simulation state)). They're programmed together in the background (so a reset can't leave one without the
+ * other) and flushed before the power latch is released. The power latch is held on after that until the data logger
+ * has programmed its last page (or for at most LOGGER_DRAIN_DELAY).
+ * State transitions, mode and modulation level changes and switch chip faults are appended to the journal along with
+ * the minutes since power up.
  * 
  * An alarm simulation is included after the ignition is turned off (and the POWER_OFF_DELAY has elapsed).
  * During alarm simulation the switch chip is turned off but the LED indicates as if there were an
@@ -57,6 +61,7 @@
  * The current state's function is invoked regularly (once per timer tick).
  * The StateTransition function is used to change state.
  * The state machnine can be extended by adding to BOTH the states_t and the STATE_FUNCTIONS
+ * (and the STATE_ACCOUNTING for the energy accounting).
  * 
  */
 
@@ -69,7 +74,12 @@
 #include "CAN.h"
 #include "MC06XSD200.h"
 #include "EEPROM.h"
+#include "journal.h"
+#include "flash.h"
+#include "meters.h"
 #include "ports.h"
+#include "energy.h"
+#include "logger.h"
 
 // Delay after last CAN message for which the fully on state is maintained
 #define POWER_OFF_DELAY (3*TICKS_PER_MINUTE) // 3 minutes
@@ -77,11 +87,9 @@
 // If no CAN messages are received for this amount of time then the ignition is assumed to be off
 #define IGNITION_OFF_DELAY (1000/TIMER_PERIOD) // 1 second
 
-// Alarm simulation indicated after turning off for this many minutes
-// Set to zero for no alarm simulation indication - goes straight to power removal
-// Alarm simulation draws about 8mA and so would fully flatten a battery within a month
-// or two.
-#define ALARM_SIMULATION_TIME (24*60) // 24 hours
+// At power off the power is held on at most this long for the data logger to program its last page - a page program
+// is a few ms but a short boot may still be scanning the SPI flash for the end of the log
+#define LOGGER_DRAIN_DELAY (5000/TIMER_PERIOD) // 5 seconds
 
 // If defined then the kickstand warning indication will be issued with the ignition is on and the
 // kickstand is deployed.
@@ -116,6 +124,13 @@ static const uint16_t CHANNEL_0_PWM_SETTING[NUMBER_OF_POWER_MODES][NUMBER_OF_MOD
 #define CHANNEL_1_ON PWM_FULL_ON
 #define CHANNEL_1_ON_PWM_MODE FAST_PWM
 
+// output level rises are ramped so that the loads don't take a step of inrush current from the supply -
+// enough of which trips the switch chip over-current windows
+#define CHANNEL_0_RAMP_RATE 16 // PWM levels per tick - off to fully on in 160ms
+#define CHANNEL_0_RAMP_CURVE LINEAR_RAMP
+#define CHANNEL_1_RAMP_RATE 16
+#define CHANNEL_1_RAMP_CURVE LINEAR_RAMP
+
 typedef struct
 {
     LED_pattern_t LED0_pattern;
@@ -173,6 +188,10 @@ static state_function_t InitialState, PowerOnState, AlarmSimulationState, PowerO
 static const state_function_ptr STATE_FUNCTIONS[NUMBER_OF_STATES] =
     {&InitialState, &PowerOnState, &AlarmSimulationState, &PowerOffState};
 
+// energy accounting for each state
+static const accounting_state_t STATE_ACCOUNTING[NUMBER_OF_STATES] =
+    {ACCOUNT_INITIAL, ACCOUNT_POWER_ON, ACCOUNT_ALARM_SIMULATION, ACCOUNT_POWER_OFF};
+
 
 // displays the patterns on the LEDs
 static void Indicate(const indication_t indication)
@@ -181,11 +200,22 @@ static void Indicate(const indication_t indication)
     LEDPattern(LED1, INDICATIONS[indication].LED1_pattern);
 }
 
+// Appends an event to the journal with the minutes and ticks since power up. An event can't wait for the flash
+// token so it's taken whether it's free or not - the tasks after the application's leave the flash for this tick.
+static void Journal(const journal_type_t type, const uint16_t value0, const uint16_t value1)
+{
+    const uint16_t data[JOURNAL_DATA_WORDS] = {value0, value1, Minutes(), Timer()};
+    FlashToken();
+    JournalAppend(type, data);
+}
+
 // Enters the new state by changing the state variable and invoking the state function of the new state
 static void StateTransition(const states_t new_state)
 {
     state_function_t *function;
+    Journal(JOURNAL_STATE, state, new_state);
     state = new_state;
+    EnergyApplicationState(STATE_ACCOUNTING[state]);
     function = STATE_FUNCTIONS[state];
     if (function != NULL)
     {
@@ -197,6 +227,8 @@ static void StateTransition(const states_t new_state)
  * all initialised */
 void InitializeApplication(void)
 {
+    SetPWMRamp0(CHANNEL_0_RAMP_RATE, CHANNEL_0_RAMP_CURVE);
+    SetPWMRamp1(CHANNEL_1_RAMP_RATE, CHANNEL_1_RAMP_CURVE);
     StateTransition(STATE_INITIAL);
 }
 
@@ -234,6 +266,7 @@ void PowerOnState(const state_action_t action)
     static uint16_t button_debounce_counter;
     static switch_mode_t channel_0_mode;
     static modulated_power_level_t channel_0_modulated_power_level;
+    static bool fault_journalled;
     uint16_t eeprom_read_value;
 
     switch (action)
@@ -250,6 +283,7 @@ void PowerOnState(const state_action_t action)
             button_pressed_counter = 0;
             button_debounce_counter = 0;
             last_CAN_time = now;
+            fault_journalled = false;
             break;
         case MAINTAIN_STATE:
             if (CanEcuReceived()) 
@@ -266,14 +300,21 @@ void PowerOnState(const state_action_t action)
                 SetPWMLevel0(CHANNEL_0_OFF, CHANNEL_0_OFF_PWM_MODE);
                 SetPWMLevel1(CHANNEL_1_OFF, CHANNEL_1_OFF_PWM_MODE);
                 SwitchChipOff();
-                DataEEWrite(channel_0_mode, MODE_EEPROM_ADDRESS);
-                DataEEWrite(channel_0_modulated_power_level, MODULATION_LEVEL_EEPROM_ADDRESS);
+                MetersCommit();
+                LoggerFlush(); // the last records of the ride
+                DataEEWriteAsync(channel_0_mode, MODE_EEPROM_ADDRESS);
+                DataEEWriteAsync(channel_0_modulated_power_level, MODULATION_LEVEL_EEPROM_ADDRESS);
                 StateTransition(STATE_ALARM_SIMULATION);
             }
             else if (SwitchChipFault())
             {
                 Indicate(FAULT_INDICATION);
                 LEDsDim(false);
+                if (!fault_journalled)
+                {
+                    Journal(JOURNAL_FAULT, channel_0_mode, channel_0_modulated_power_level);
+                    fault_journalled = true;
+                }
             }
             // early alarm simulation indication if ignition is off and the LED would be off (i.e. if it
             // would be showing the modulated OFF state)
@@ -307,6 +348,7 @@ void PowerOnState(const state_action_t action)
                         {
                             //long button press change the channel power mode
                             if (++channel_0_mode >= NUMBER_OF_POWER_MODES) channel_0_mode = 0;
+                            Journal(JOURNAL_MODE, channel_0_mode, channel_0_modulated_power_level);
                             Indicate(MODE_CHANGE_INDICATION);
                             SetPWMLevel0(CHANNEL_0_PWM_SETTING[channel_0_mode][channel_0_modulated_power_level],CHANNEL_0_PWM_MODE[channel_0_mode][channel_0_modulated_power_level]);     
                         }
@@ -318,6 +360,7 @@ void PowerOnState(const state_action_t action)
                         {
                             //short button press change modulated power level
                             if (++channel_0_modulated_power_level >= NUMBER_OF_MODULATED_POWER_LEVELS) channel_0_modulated_power_level = 0;
+                            Journal(JOURNAL_MODE, channel_0_mode, channel_0_modulated_power_level);
                             SetPWMLevel0(CHANNEL_0_PWM_SETTING[channel_0_mode][channel_0_modulated_power_level],CHANNEL_0_PWM_MODE[channel_0_mode][channel_0_modulated_power_level]);     
                         }
                         if (button_pressed_counter > 0)
@@ -357,7 +400,7 @@ void AlarmSimulationState(const state_action_t action)
             }
             else
 #if (ALARM_SIMULATION_TIME > 0)
-            if ((Minutes() - alarm_start_time) > ALARM_SIMULATION_TIME)
+            if ((uint16_t)(Minutes() - alarm_start_time) > ALARM_SIMULATION_TIME)
 #endif
                 StateTransition(STATE_POWER_OFF);
             break;
@@ -369,16 +412,29 @@ void AlarmSimulationState(const state_action_t action)
 
 void PowerOffState(const state_action_t action)
 {
+    static uint16_t power_off_time;
     switch (action)
     {
         case ENTER_STATE:
-            PORT_POWER = POWER_PORT_OFF;
+            MetersFlush(); // the meters and settings must be in flash before the power goes
+            DataEEFlush(); // (after the meters - their checkpoint is an EEPROM write)
+            power_off_time = Timer();
             break;
         case MAINTAIN_STATE:
             if (CanEcuReceived())
             {
                 StateTransition(STATE_POWER_ON);
             }
+            else
+            {
+                // the records logged since the ride ended (e.g. during the alarm simulation) go in a last page - the
+                // power is only released once it's programmed
+                LoggerFlush();
+                if (LoggerIdle() || ((uint16_t)(Timer() - power_off_time) > LOGGER_DRAIN_DELAY))
+                {
+                    PORT_POWER = POWER_PORT_OFF;
+                }
+            }
             break;
         default:
             break;
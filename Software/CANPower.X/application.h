@@ -19,6 +19,13 @@ extern "C" {
 #endif
 
 
+// Alarm simulation indicated after turning off for this many minutes
+// Set to zero for no alarm simulation indication - goes straight to power removal
+// Alarm simulation draws about 8mA and so would fully flatten a battery within a month
+// or two.
+#define ALARM_SIMULATION_TIME (24*60) // 24 hours
+
+
 /* Must be invoked once shortly after power on after the drivers and services are
  * all initialised */
 void InitializeApplication(void);
@@ -0,0 +1,218 @@
+/*
+ * File:   energy.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Energy accounting.
+ * Integrates the time spent in each CPU mode and in each application state, along with
+ * the time for which each of the power consuming peripherals is enabled and the LED PWM duty.
+ * A per-component current model is applied to the accounted times in order to estimate
+ * the average supply current in each application state and the battery draw for a parked day.
+ * The figures are estimates for comparing firmware builds - the model should be checked against
+ * bench measurements when it matters.
+ *
+ * CPU mode times are measured in timer hardware counts (0.5us) between the EnergyCPUMode calls.
+ * Peripheral enables and LED duty are sampled once per tick by EnergyTasks which then adds
+ * the tick's modelled current to the current application state.
+ *
+ * The current model can be changed by modifying the CPU_MODE_CURRENT and PERIPHERAL_CURRENT
+ * tables and the other current defines.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "energy.h"
+#include "timer.h"
+#include "LEDs.h"
+#include "xc.h"
+
+
+// Current model - estimated supply current (uA) for each component.
+// Values are chosen so that the alarm simulation state comes to about the 8mA measured for it.
+static const uint16_t CPU_MODE_CURRENT[NUMBER_OF_CPU_MODES] =
+    {27000, // CPU_RUN
+    5500,   // CPU_IDLE
+    15000,  // CPU_DOZE
+    50};    // CPU_SLEEP
+static const uint16_t PERIPHERAL_CURRENT[NUMBER_OF_PERIPHERALS] =
+    {40,    // PERIPHERAL_TIMER2
+    40,     // PERIPHERAL_TIMER3
+    30,     // PERIPHERAL_OC1
+    30,     // PERIPHERAL_OC2
+    30,     // PERIPHERAL_OC3
+    300,    // PERIPHERAL_SPI
+    800,    // PERIPHERAL_ECAN
+    2000};  // PERIPHERAL_ADC
+#define LED_CURRENT 5000 // uA for an LED fully on at full brightness
+#define BOARD_CURRENT 1500 // uA for the regulator, CAN transceiver and switch chip quiescent whenever the CPU is powered
+#define POWERED_DOWN_CURRENT 20 // uA with the power latch released and the ignition off
+
+#define ECAN_MODE_DISABLE 1 // ECAN operating mode when disabled
+#define MINUTES_PER_DAY (24*60)
+
+
+// CPU mode accounting
+static CPU_mode_t CPU_mode; // the current mode
+static uint32_t mode_change_count; // TimerCount at the last mode change
+static uint32_t tick_mode_counts[NUMBER_OF_CPU_MODES]; // timer counts in each mode since the last EnergyTasks
+static uint64_t mode_counts[NUMBER_OF_CPU_MODES]; // timer counts in each mode in total
+
+// application state accounting
+static accounting_state_t accounting_state; // the current state
+static uint32_t state_ticks[NUMBER_OF_ACCOUNTING_STATES]; // timer ticks in each state
+static uint64_t state_charge[NUMBER_OF_ACCOUNTING_STATES]; // uA ticks in each state
+
+// peripheral and LED accounting
+static uint32_t peripheral_ticks[NUMBER_OF_PERIPHERALS]; // timer ticks for which each peripheral was enabled
+static uint64_t LED_duty_ticks[NUMBEROFLEDs]; // LED duty summed every timer tick
+
+
+/* Must be called once at initialisation time after the timer has been initialised */
+void InitializeEnergy(void)
+{
+    uint16_t i;
+    for (i=0; i<NUMBER_OF_CPU_MODES; ++i)
+    {
+        tick_mode_counts[i] = 0;
+        mode_counts[i] = 0;
+    }
+    for (i=0; i<NUMBER_OF_ACCOUNTING_STATES; ++i)
+    {
+        state_ticks[i] = 0;
+        state_charge[i] = 0;
+    }
+    for (i=0; i<NUMBER_OF_PERIPHERALS; ++i)
+    {
+        peripheral_ticks[i] = 0;
+    }
+    for (i=0; i<NUMBEROFLEDs; ++i)
+    {
+        LED_duty_ticks[i] = 0;
+    }
+    CPU_mode = CPU_RUN;
+    mode_change_count = TimerCount();
+    accounting_state = ACCOUNT_INITIAL;
+}
+
+
+/* Invoked as the CPU changes mode. Run mode is accounted as doze if doze is enabled. */
+void EnergyCPUMode(const CPU_mode_t mode)
+{
+    uint32_t now = TimerCount();
+    tick_mode_counts[CPU_mode] += now - mode_change_count;
+    mode_change_count = now;
+    CPU_mode = ((mode == CPU_RUN) && CLKDIVbits.DOZEN)?CPU_DOZE:mode;
+}
+
+
+/* Invoked as the application changes state */
+void EnergyApplicationState(const accounting_state_t state)
+{
+    if (state < NUMBER_OF_ACCOUNTING_STATES)
+    {
+        accounting_state = state;
+    }
+}
+
+
+/* Must be invoked once per timer tick - accounts for the tick just gone.
+ * The CPU current is averaged over the mode counts since the last invocation and the
+ * peripherals and LEDs are assumed to have been as they are now for the whole tick. */
+void EnergyTasks(void)
+{
+    uint32_t current = BOARD_CURRENT; // uA for the tick
+    uint64_t CPU_charge = 0; // uA counts since the last invocation
+    uint32_t counts = 0; // timer counts since the last invocation
+    bool enabled[NUMBER_OF_PERIPHERALS];
+    uint16_t i;
+    uint16_t duty;
+
+    EnergyCPUMode(CPU_mode); // bring the current mode's count up to date
+    for (i=0; i<NUMBER_OF_CPU_MODES; ++i)
+    {
+        CPU_charge += (uint64_t)CPU_MODE_CURRENT[i] * tick_mode_counts[i];
+        counts += tick_mode_counts[i];
+        mode_counts[i] += tick_mode_counts[i];
+        tick_mode_counts[i] = 0;
+    }
+    if (counts > 0)
+    {
+        current += (uint32_t)(CPU_charge / counts);
+    }
+
+    enabled[PERIPHERAL_TIMER2] = T2CONbits.TON;
+    enabled[PERIPHERAL_TIMER3] = T3CONbits.TON;
+    enabled[PERIPHERAL_OC1] = (OC1CONbits.OCM != 0);
+    enabled[PERIPHERAL_OC2] = (OC2CONbits.OCM != 0);
+    enabled[PERIPHERAL_OC3] = (OC3CONbits.OCM != 0);
+    enabled[PERIPHERAL_SPI] = _SPIEN;
+    enabled[PERIPHERAL_ECAN] = (C1CTRL1bits.OPMODE != ECAN_MODE_DISABLE);
+    enabled[PERIPHERAL_ADC] = AD1CON1bits.ADON;
+    for (i=0; i<NUMBER_OF_PERIPHERALS; ++i)
+    {
+        if (enabled[i])
+        {
+            current += PERIPHERAL_CURRENT[i];
+            ++peripheral_ticks[i];
+        }
+    }
+
+    for (i=0; i<NUMBEROFLEDs; ++i)
+    {
+        duty = LEDDuty(i);
+        LED_duty_ticks[i] += duty;
+        current += ((uint32_t)LED_CURRENT * duty) / LED_DUTY_FULL;
+    }
+
+    ++state_ticks[accounting_state];
+    state_charge[accounting_state] += current;
+}
+
+
+/* functions return the accounted times in seconds */
+uint32_t EnergyCPUModeTime(const CPU_mode_t mode)
+{
+    return (mode < NUMBER_OF_CPU_MODES)?(uint32_t)(mode_counts[mode] / TIMER_COUNT_FREQUENCY):0;
+}
+
+uint32_t EnergyStateTime(const accounting_state_t state)
+{
+    return (state < NUMBER_OF_ACCOUNTING_STATES)?(state_ticks[state] / TIMER_FREQUENCY):0;
+}
+
+uint32_t EnergyPeripheralTime(const peripheral_t peripheral)
+{
+    return (peripheral < NUMBER_OF_PERIPHERALS)?(peripheral_ticks[peripheral] / TIMER_FREQUENCY):0;
+}
+
+
+/* Returns the LED on time in seconds as if the LED were fully on for that time - i.e. duty weighted */
+uint32_t EnergyLEDTime(const LED_t LED)
+{
+    return (LED < NUMBEROFLEDs)?(uint32_t)(LED_duty_ticks[LED] / LED_DUTY_FULL / TIMER_FREQUENCY):0;
+}
+
+
+/* Returns the estimated average supply current in uA while in the state
+ * or zero if no time has been accounted to the state */
+uint16_t EnergyAverageCurrent(const accounting_state_t state)
+{
+    if ((state >= NUMBER_OF_ACCOUNTING_STATES) || (state_ticks[state] == 0))
+    {
+        return 0;
+    }
+    return (uint16_t)(state_charge[state] / state_ticks[state]);
+}
+
+
+/* Returns the estimated battery draw in uAh for a parked day. I.e. a day starting at ignition off with
+ * alarm_simulation_minutes in the alarm simulation state and the rest of the day with the power latch released.
+ * Alarm simulation current is as measured so far - zero until some alarm simulation has been accounted. */
+uint32_t EnergyParkedChargePerDay(const uint16_t alarm_simulation_minutes)
+{
+    uint32_t alarm_minutes = (alarm_simulation_minutes > MINUTES_PER_DAY)?MINUTES_PER_DAY:alarm_simulation_minutes;
+    return (((uint32_t)EnergyAverageCurrent(ACCOUNT_ALARM_SIMULATION) * alarm_minutes)
+        + ((uint32_t)POWERED_DOWN_CURRENT * (MINUTES_PER_DAY - alarm_minutes))) / 60;
+}
@@ -0,0 +1,86 @@
+/*
+ * File:   energy.h
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Energy accounting.
+ * Integrates the time spent in each CPU mode and in each application state, along with
+ * the time for which each of the power consuming peripherals is enabled and the LED PWM duty.
+ * A per-component current model is applied to the accounted times in order to estimate
+ * the average supply current in each application state and the battery draw for a parked day.
+ * The figures are estimates for comparing firmware builds - the model should be checked against
+ * bench measurements when it matters.
+ *
+ * Timer and LEDs modules must be initialised before this one.
+ * The main loop reports CPU mode changes with EnergyCPUMode and the application reports its
+ * state changes with EnergyApplicationState. EnergyTasks must be invoked once per timer tick.
+ *
+ */
+
+#ifndef ENERGY_H
+#define	ENERGY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "LEDs.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+// CPU modes that are accounted
+typedef enum {CPU_RUN=0, CPU_IDLE, CPU_DOZE, CPU_SLEEP, NUMBER_OF_CPU_MODES} CPU_mode_t;
+
+// application states that are accounted
+typedef enum {ACCOUNT_INITIAL=0, ACCOUNT_POWER_ON, ACCOUNT_ALARM_SIMULATION, ACCOUNT_POWER_OFF,
+    NUMBER_OF_ACCOUNTING_STATES} accounting_state_t;
+
+// peripherals that are accounted
+typedef enum {PERIPHERAL_TIMER2=0, PERIPHERAL_TIMER3, PERIPHERAL_OC1, PERIPHERAL_OC2, PERIPHERAL_OC3,
+    PERIPHERAL_SPI, PERIPHERAL_ECAN, PERIPHERAL_ADC, NUMBER_OF_PERIPHERALS} peripheral_t;
+
+
+/* Must be called once at initialisation time after the timer has been initialised */
+void InitializeEnergy(void);
+
+
+/* Must be invoked once per timer tick - accounts for the tick just gone */
+void EnergyTasks(void);
+
+
+/* Invoked as the CPU changes mode. Run mode is accounted as doze if doze is enabled.
+ * Timer 4 doesn't run in sleep so time in sleep can't be measured - it ends up accounted as zero. */
+void EnergyCPUMode(const CPU_mode_t mode);
+
+
+/* Invoked as the application changes state */
+void EnergyApplicationState(const accounting_state_t state);
+
+
+/* functions return the accounted times in seconds */
+uint32_t EnergyCPUModeTime(const CPU_mode_t mode);
+uint32_t EnergyStateTime(const accounting_state_t state);
+uint32_t EnergyPeripheralTime(const peripheral_t peripheral);
+
+
+/* Returns the LED on time in seconds as if the LED were fully on for that time - i.e. duty weighted */
+uint32_t EnergyLEDTime(const LED_t LED);
+
+
+/* Returns the estimated average supply current in uA while in the state
+ * or zero if no time has been accounted to the state */
+uint16_t EnergyAverageCurrent(const accounting_state_t state);
+
+
+/* Returns the estimated battery draw in uAh for a parked day. I.e. a day starting at ignition off with
+ * alarm_simulation_minutes in the alarm simulation state and the rest of the day with the power latch released */
+uint32_t EnergyParkedChargePerDay(const uint16_t alarm_simulation_minutes);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* ENERGY_H */
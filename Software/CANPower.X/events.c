@@ -0,0 +1,41 @@
+/* 
+ * File:   events.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ * 
+ * Interrupt to task event flags.
+ * One bit per event source. Interrupt routines (or anything else) signal an event by setting its
+ * bit with EventSignal - a single bset instruction so it's atomic whatever the interrupt priority.
+ * Tasks fetch and clear a mask of pending events in one go with EventsFetch so that an
+ * event signalled while a task is looking at its events can't be lost.
+ * 
+ * The PIC24 has no single instruction to fetch and clear a word so EventsFetch holds off
+ * interrupts for the few instructions between reading and clearing.
+ * 
+ */
+
+#include "events.h"
+
+
+// the pending events
+volatile events_t pending_events __attribute__((near));
+
+
+/* Returns those of the events in the mask that are pending and clears them */
+events_t EventsFetch(const events_t mask)
+{
+    events_t events;
+    __builtin_disi(0x3FFF); // interrupts off while fetching and clearing
+    events = pending_events & mask;
+    pending_events &= ~events;
+    DISICNT = 0; // and back on again
+    return events;
+}
+
+
+/* Must be called once at initialisation time before any interrupts are enabled */
+void InitializeEvents(void)
+{
+    pending_events = 0;
+}
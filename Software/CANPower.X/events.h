@@ -0,0 +1,69 @@
+/* 
+ * File:   events.h
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ * 
+ * Interrupt to task event flags.
+ * One bit per event source. Interrupt routines (or anything else) signal an event by setting its
+ * bit with EventSignal - a single bset instruction so it's atomic whatever the interrupt priority.
+ * Tasks fetch and clear a mask of pending events in one go with EventsFetch so that an
+ * event signalled while a task is looking at its events can't be lost.
+ * Events are not counted - an event signalled several times before being fetched is fetched once.
+ * 
+ * Each event should have only one task that fetches it.
+ * 
+ */
+
+#ifndef EVENTS_H
+#define	EVENTS_H
+
+#include <stdint.h>
+#include "xc.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+typedef uint16_t events_t;
+
+// event bit numbers - one for each event source
+#define EVENT_BIT_CAN_ECU 0 // CAN message received from the ECU
+#define EVENT_BIT_CAN_INSTRUMENTS 1 // CAN message received from the instruments
+#define EVENT_BIT_SPI_DONE 2 // SPI transfer complete
+#define EVENT_BIT_TIMER 3 // timer tick
+
+// event masks for fetching
+#define EVENT_CAN_ECU (1 << EVENT_BIT_CAN_ECU)
+#define EVENT_CAN_INSTRUMENTS (1 << EVENT_BIT_CAN_INSTRUMENTS)
+#define EVENT_SPI_DONE (1 << EVENT_BIT_SPI_DONE)
+#define EVENT_TIMER (1 << EVENT_BIT_TIMER)
+
+
+// the pending events - only to be accessed through the functions and macros here
+extern volatile events_t pending_events __attribute__((near));
+
+
+/* Signals the event with the given event bit number (which must be a constant).
+ * Can be used at any interrupt priority. */
+#if defined(__XC16__)
+#define EventSignal(event_bit) __asm__ volatile ("bset _pending_events, #%0" : : "i" (event_bit) : "memory")
+#else
+#define EventSignal(event_bit) (pending_events |= (events_t)(1 << (event_bit)))
+#endif
+
+
+/* Returns those of the events in the mask that are pending and clears them */
+events_t EventsFetch(const events_t mask);
+
+
+/* Must be called once at initialisation time before any interrupts are enabled */
+void InitializeEvents(void);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* EVENTS_H */
@@ -0,0 +1,235 @@
+/*
+ * File:   faults.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Switch chip fault black box.
+ *
+ * A snapshot is journalled as three consecutive records - JOURNAL_SNAPSHOT_0, 1 and 2 each with four
+ * of the snapshot's words. The three are appended together by FaultsTasks so they have consecutive sequence
+ * numbers, which is how they are matched up when the ring is reloaded. A snapshot with a record missing
+ * (cut short by a reset) is dropped.
+ *
+ * The number of the next fault is written to the emulated EEPROM (in the background) along with each snapshot
+ * journalled. At boot it's the later of that and the one after the last snapshot in the journal - whichever of
+ * the two writes a reset cut short.
+ *
+ * FaultCapture is called from the switch chip thread at the moment of the fault so it only copies the snapshot
+ * into the ring. The flash programming (about 1ms for the three records) is left to FaultsTasks on the next
+ * tick that it gets the flash token (see flash.h). Snapshots that haven't been journalled are the newest ones in
+ * the ring - pending counts them.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "faults.h"
+#include "journal.h"
+#include "flash.h"
+#include "EEPROM.h"
+#include "meters.h"
+#include "timer.h"
+#include "CAN.h"
+#include "logger.h"
+#include "xc.h"
+
+
+#define SNAPSHOT_RECORDS 3 // journal records for each snapshot
+#define SNAPSHOT_WORDS (SNAPSHOT_RECORDS * JOURNAL_DATA_WORDS)
+
+#if (FAULTS_EEPROM_ADDRESS < METERS_EEPROM_ADDRESS + METERS_EEPROM_SIZE) || (FAULTS_EEPROM_ADDRESS >= DATA_EE_SIZE)
+#error "FAULTS_EEPROM_ADDRESS must be after the meters checkpoint and within the DATA_EE_SIZE"
+#endif
+
+static fault_snapshot_t ring[FAULT_RING_SIZE];
+static uint8_t ringHead;    // where the next snapshot goes
+static uint8_t ringCount;   // snapshots in the ring
+static uint8_t pending;     // newest snapshots not yet journalled
+static uint16_t number;     // of the next fault
+
+
+/************************************************************************
+ToWords / FromWords
+
+Snapshots are journalled as an array of words in the order of the
+fault_snapshot_t fields.
+************************************************************************/
+static void ToWords(const fault_snapshot_t *const snapshot, uint16_t words[SNAPSHOT_WORDS])
+{
+    words[0] = snapshot->number;
+    words[1] = snapshot->minutes;
+    words[2] = snapshot->timer;
+    words[3] = snapshot->STATR;
+    words[4] = snapshot->DIAGR;
+    words[5] = snapshot->FAULT_0;
+    words[6] = snapshot->FAULT_1;
+    words[7] = snapshot->PWMR_0;
+    words[8] = snapshot->PWMR_1;
+    words[9] = snapshot->level_0;
+    words[10] = snapshot->level_1;
+    words[11] = snapshot->CAN_attributes;
+}
+
+static void FromWords(const uint16_t words[SNAPSHOT_WORDS], fault_snapshot_t *const snapshot)
+{
+    snapshot->number = words[0];
+    snapshot->minutes = words[1];
+    snapshot->timer = words[2];
+    snapshot->STATR = words[3];
+    snapshot->DIAGR = words[4];
+    snapshot->FAULT_0 = words[5];
+    snapshot->FAULT_1 = words[6];
+    snapshot->PWMR_0 = words[7];
+    snapshot->PWMR_1 = words[8];
+    snapshot->level_0 = words[9];
+    snapshot->level_1 = words[10];
+    snapshot->CAN_attributes = words[11];
+}
+
+
+/************************************************************************
+AddToRing
+
+Adds a snapshot to the ring - overwriting the oldest if it is full.
+************************************************************************/
+static void AddToRing(const fault_snapshot_t *const snapshot)
+{
+    ring[ringHead] = *snapshot;
+    ringHead = (ringHead + 1) % FAULT_RING_SIZE;
+    if (ringCount < FAULT_RING_SIZE)
+    {
+        ++ringCount;
+    }
+}
+
+
+/************************************************************************
+InitializeFaults
+
+Reloads the ring with the last snapshots in the journal and carries on
+the fault numbering.
+************************************************************************/
+void InitializeFaults(void)
+{
+    journal_iterator_t iterator;
+    journal_record_t record;
+    fault_snapshot_t snapshot;
+    uint16_t words[SNAPSHOT_WORDS];
+    uint16_t first_sequence = 0; // of the snapshot being matched up
+    uint8_t part = SNAPSHOT_RECORDS; // next record expected - none
+    uint16_t stored = DataEERead(FAULTS_EEPROM_ADDRESS);
+    uint8_t i;
+
+    ringHead = 0;
+    ringCount = 0;
+    pending = 0;
+    number = 0;
+
+    JournalFirst(&iterator);
+    while (JournalNext(&iterator, &record))
+    {
+        if (record.type == JOURNAL_SNAPSHOT_0)
+        {
+            first_sequence = record.sequence;
+            part = 0;
+        }
+        else if ((part >= SNAPSHOT_RECORDS) || (record.type != JOURNAL_SNAPSHOT_0 + part)
+            || (record.sequence != (uint16_t)(first_sequence + part)))
+        {
+            part = SNAPSHOT_RECORDS;
+            continue;
+        }
+        for (i = 0; i < JOURNAL_DATA_WORDS; ++i)
+        {
+            words[part * JOURNAL_DATA_WORDS + i] = record.data[i];
+        }
+        if (++part == SNAPSHOT_RECORDS)
+        {
+            FromWords(words, &snapshot);
+            AddToRing(&snapshot);
+            number = snapshot.number + 1;
+        }
+    }
+
+    // compared as serial numbers - the stored number is unwritten before the first fault
+    if ((stored != ERASED_WORD_VALUE) && ((int16_t)(stored - number) > 0))
+    {
+        number = stored;
+    }
+}
+
+
+/************************************************************************
+FaultsTasks
+
+Journals the oldest snapshot that hasn't been yet - if the flash token
+is free - and stores the number of the fault after it.
+************************************************************************/
+void FaultsTasks(void)
+{
+    uint16_t words[SNAPSHOT_WORDS];
+    uint8_t i;
+
+    if ((pending > 0) && FlashToken())
+    {
+        ToWords(&ring[(ringHead + FAULT_RING_SIZE - pending) % FAULT_RING_SIZE], words);
+        for (i = 0; i < SNAPSHOT_RECORDS; ++i)
+        {
+            JournalAppend(JOURNAL_SNAPSHOT_0 + i, &words[i * JOURNAL_DATA_WORDS]);
+        }
+        DataEEWriteAsync(words[0] + 1, FAULTS_EEPROM_ADDRESS); // programmed by EEPROMTasks
+        --pending;
+    }
+}
+
+
+/************************************************************************
+FaultCapture
+
+Stamps the snapshot and adds it to the ring for FaultsTasks to journal.
+************************************************************************/
+void FaultCapture(fault_snapshot_t *const snapshot)
+{
+    uint16_t data[LOG_DATA_WORDS];
+    snapshot->number = number++;
+    snapshot->minutes = Minutes();
+    snapshot->timer = Timer();
+    snapshot->CAN_attributes = ((uint16_t)CANCounter() << 8)
+        | (CANASCSwitch() ? FAULT_CAN_ASC_SWITCH : 0)
+        | (CANAmbient() ? FAULT_CAN_DARK : 0)
+        | (CANKickstand() ? FAULT_CAN_KICKSTAND : 0);
+    AddToRing(snapshot);
+    if (pending < FAULT_RING_SIZE)
+    {
+        ++pending;
+    }
+    data[0] = snapshot->number;
+    data[1] = snapshot->STATR;
+    data[2] = snapshot->FAULT_0;
+    data[3] = snapshot->FAULT_1;
+    data[4] = snapshot->DIAGR;
+    LogAppend(LOG_FAULT, data); // a RAM copy - to the ride log as well when a flash is fitted
+}
+
+
+/************************************************************************
+FaultsFirst / FaultsNext
+
+Read back through the ring from the latest fault.
+************************************************************************/
+void FaultsFirst(fault_iterator_t *const iterator)
+{
+    *iterator = 0;
+}
+
+bool FaultsNext(fault_iterator_t *const iterator, fault_snapshot_t *const snapshot)
+{
+    if (*iterator >= ringCount)
+    {
+        return false;
+    }
+    *snapshot = ring[(ringHead + FAULT_RING_SIZE - 1 - *iterator) % FAULT_RING_SIZE];
+    ++*iterator;
+    return true;
+}
@@ -0,0 +1,89 @@
+/*
+ * File:   faults.h
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Switch chip fault black box.
+ * The switch chip driver captures a snapshot of the registers it read back and the requested output levels
+ * when it shuts the chip down for a fault. The snapshot is stamped with the time and the CAN attributes and kept
+ * in a RAM ring of the last FAULT_RING_SIZE faults. FaultsTasks then journals it in the background.
+ * At boot the ring is reloaded from the journal so the last faults can be read back cheaply from RAM.
+ * The journal is a ring shared with the other modules so old snapshots are reclaimed - the number of the next fault
+ * is kept in the emulated EEPROM as well so that the numbering carries on regardless.
+ *
+ * The EEPROM and journal must be initialised before this one and the timer and CAN modules before the first capture.
+ * FaultsTasks must be invoked once per timer tick.
+ *
+ */
+
+#ifndef FAULTS_H
+#define	FAULTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+#define FAULT_RING_SIZE 4 // faults kept in RAM
+
+// emulated EEPROM word holding the number of the next fault - after the meters checkpoint
+#define FAULTS_EEPROM_ADDRESS 24
+
+// CAN attribute flags in a snapshot - the CAN counter is in the high byte
+#define FAULT_CAN_ASC_SWITCH 0x0001
+#define FAULT_CAN_DARK 0x0002
+#define FAULT_CAN_KICKSTAND 0x0004
+
+// register value in a snapshot for a register that couldn't be read back
+#define FAULT_REGISTER_UNREAD 0xFFFF
+
+typedef struct
+{
+    uint16_t number;    // counts up with each fault over the life of the unit - filled in by FaultCapture
+    uint16_t minutes;   // Minutes at the fault - filled in by FaultCapture
+    uint16_t timer;     // Timer at the fault - filled in by FaultCapture
+    uint16_t STATR;     // switch chip registers as read back
+    uint16_t DIAGR;
+    uint16_t FAULT_0;
+    uint16_t FAULT_1;
+    uint16_t PWMR_0;
+    uint16_t PWMR_1;
+    uint16_t level_0;   // requested output levels
+    uint16_t level_1;
+    uint16_t CAN_attributes; // FAULT_CAN_ flags and counter - filled in by FaultCapture
+} fault_snapshot_t;
+
+// position of a read back through the ring
+typedef uint8_t fault_iterator_t;
+
+
+/* Must be called once at initialisation time after the EEPROM and journal - reloads the ring */
+void InitializeFaults(void);
+
+
+/* Must be invoked once per timer tick - journals a snapshot captured since the last invocation */
+void FaultsTasks(void);
+
+
+/* Invoked by the switch chip driver with the registers and levels filled in. Stamps the snapshot and adds it
+ * to the ring - overwriting the oldest. Only copies to RAM. */
+void FaultCapture(fault_snapshot_t *const snapshot);
+
+
+/* Starts a read back at the latest fault */
+void FaultsFirst(fault_iterator_t *const iterator);
+
+
+/* Reads the next fault back in time - returns false once there are no more */
+bool FaultsNext(fault_iterator_t *const iterator, fault_snapshot_t *const snapshot);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* FAULTS_H */
@@ -0,0 +1,32 @@
+/*
+ * File:   flash.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * The flash operation token - see flash.h.
+ * The token is freed by FlashTasks rather than by the timer tick changing because an erase itself lasts more than
+ * two ticks - the next module would otherwise find a new tick and erase straight after it.
+ *
+ */
+
+#include "flash.h"
+
+
+static bool token; // free for a flash operation this tick
+
+
+/* Must be invoked once per timer tick before the tasks that take the token - frees it for the tick */
+void FlashTasks(void)
+{
+    token = true;
+}
+
+
+/* Takes the token for a flash operation - returns false if it has already been taken this tick */
+bool FlashToken(void)
+{
+    bool taken = token;
+    token = false;
+    return taken;
+}
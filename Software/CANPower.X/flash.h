@@ -0,0 +1,41 @@
+/*
+ * File:   flash.h
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * The token that the modules erasing or programming the program memory flash in the background take turns with -
+ * the EEPROM emulation, the journal, the hour meters and the fault black box.
+ * A page erase stalls the CPU for about 23ms with the interrupts held off and the 64ms watchdog is only cleared
+ * when the main loop idles, so two or three erases in the same tick would be too many. A module takes the token
+ * before it starts a flash operation (an erase or a burst of programming) and leaves the operation for a later
+ * tick if it has already been taken - so there's at most one a tick.
+ * The flushes before the power is cut don't take it - they clear the watchdog themselves.
+ *
+ * FlashTasks must be invoked once per timer tick before any of the tasks that take the token.
+ *
+ */
+
+#ifndef FLASH_H
+#define	FLASH_H
+
+#include <stdbool.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+/* Must be invoked once per timer tick before the tasks that take the token - frees it for the tick */
+void FlashTasks(void);
+
+
+/* Takes the token for a flash operation - returns false if it has already been taken this tick */
+bool FlashToken(void);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* FLASH_H */
@@ -18,10 +18,17 @@ extern "C" {
 
 // If the clock frequency is changed check that the system timer and CAN baud rate dividers still
 // work as integers etc.
-// SPI Chip Select control software delays are also likely to need tweaking.
+// The SPI chip select timings are derived from FCY and checked at compile time (see SPI.c).
 #define FOSC 32000000 // primary oscillator frequency
 #define FCY (FOSC/2)   // system clock frequency
 
+// converts a time in ns to a whole number of instruction cycles - rounded up so as to be at least as long
+#define NS_TO_CYCLES(ns) (((ns) * (FCY / 1000UL) + 999999UL) / 1000000UL)
+
+// timer 3 - the switch chip hardware PWM clock (see MC06XSD200.c) which also paces the SPI words (see SPI.c)
+#define PWM_CLOCK_PERIOD 66 // uS - 15KHz
+#define PWM_TIMER_PERIOD (FCY * PWM_CLOCK_PERIOD / 2 / 1000000) // PR3 - half the PWM period at prescaler 1
+
     
 /* must be called early on in the initialisation sequence in order to
  * configure the system clock */
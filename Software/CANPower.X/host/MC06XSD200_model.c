@@ -0,0 +1,212 @@
+/*
+ * File:   MC06XSD200_model.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Host model of the NXP MC06XSD200 dual power switch SPI register interface.
+ * See MC06XSD200_model.h.
+ *
+ */
+
+#include "MC06XSD200_model.h"
+#include "xc.h"
+#include "../hardware.h"
+
+
+#define CHANNEL_BIT 0x2000
+#define ADDRESS_SHIFT 10
+#define ADDRESS_MASK 0x0007
+#define DATA_MASK 0x01FF
+#define NORMAL_MODE 0x0200
+#define READ_REGISTER_MASK 0x0007
+#define PWM_ON 0x0100
+#define GCR_CSNS_0 0x0001 // current sense of channel 0
+#define GCR_CSNS_1 0x0002 // current sense of channel 1
+
+// fastest SCK the chip takes - any faster and it samples each bit a bit late
+#ifndef MC06XSD200_MODEL_MAXIMUM_CLOCK
+#define MC06XSD200_MODEL_MAXIMUM_CLOCK 8000000UL
+#endif
+
+// register numbers as read back
+enum {STATR=0, FAULTR, PWMR, CONFR, OCR, RETRYR, GCR, DIAGR, NUMBER_OF_REGISTERS};
+
+// readback register written by each write address (zero for write addresses not modelled)
+static const uint8_t WRITE_REGISTER[8] = {0, PWMR, CONFR, 0, OCR, RETRYR, GCR, 0};
+
+// fault register bits reported for an injected fault and the status register bit for a fault on either channel
+#define FAULT_OVERCURRENT 0x0004
+#define STATUS_FAULT 0x0004
+
+static bool awake;
+static bool normal; // normal mode entered on the first GCR write after wake
+static uint16_t registers[2][NUMBER_OF_REGISTERS]; // data bits of each register for each channel
+static bool faults[2];
+static uint16_t selected; // the read command of the previous word
+static uint32_t parity_errors;
+static uint32_t words;
+
+
+static bool OddParity(uint16_t word)
+{
+    uint8_t count = 0;
+    while (word)
+    {
+        count += word & 1;
+        word >>= 1;
+    }
+    return count & 1;
+}
+
+
+static void ResetRegisters(void)
+{
+    uint8_t channel, r;
+    for (channel=0; channel<2; ++channel)
+    {
+        for (r=0; r<NUMBER_OF_REGISTERS; ++r)
+        {
+            registers[channel][r] = 0;
+        }
+    }
+    normal = false;
+    selected = STATR;
+}
+
+
+void MC06XSD200ModelReset(void)
+{
+    awake = false;
+    faults[0] = false;
+    faults[1] = false;
+    parity_errors = 0;
+    words = 0;
+    ResetRegisters();
+}
+
+
+void MC06XSD200ModelWake(const bool wake)
+{
+    if (awake && !wake)
+    {
+        ResetRegisters();
+    }
+    awake = wake;
+}
+
+
+/* returns the register selected by the read command as clocked out */
+static uint16_t Response(const uint16_t command)
+{
+    uint8_t channel = (command & CHANNEL_BIT)?1:0;
+    uint8_t r = command & READ_REGISTER_MASK;
+    uint16_t data = registers[channel][r];
+    switch (r)
+    {
+        case STATR:
+            data = (faults[0] || faults[1])?STATUS_FAULT:0;
+            break;
+        case FAULTR:
+            data = faults[channel]?FAULT_OVERCURRENT:0;
+            break;
+        default:
+            break;
+    }
+    return (command & CHANNEL_BIT) | ((uint16_t)r << ADDRESS_SHIFT) | (normal?NORMAL_MODE:0) | (data & DATA_MASK);
+}
+
+
+uint16_t MC06XSD200ModelTransfer(const uint16_t word_sent)
+{
+    uint16_t word = word_sent;
+    uint16_t response;
+    uint8_t address;
+    bool late; // the SCK is too fast - both directions are out by a bit
+    ++words;
+    if (!awake)
+    {
+        return 0;
+    }
+    late = (FCY / HostSPIClockDivider()) > MC06XSD200_MODEL_MAXIMUM_CLOCK;
+    if (late)
+    {
+        word <<= 1;
+    }
+    response = late ? (Response(selected) >> 1) : Response(selected);
+    if (OddParity(word))
+    {
+        ++parity_errors;
+        return response;
+    }
+    address = (word >> ADDRESS_SHIFT) & ADDRESS_MASK;
+    if (address == 0) // read command
+    {
+        selected = word;
+    }
+    else
+    {
+        if (WRITE_REGISTER[address] == GCR)
+        {
+            registers[0][GCR] = word & DATA_MASK;
+            normal = true;
+        }
+        else if (WRITE_REGISTER[address] != 0)
+        {
+            registers[(word & CHANNEL_BIT)?1:0][WRITE_REGISTER[address]] = word & DATA_MASK;
+        }
+        selected = STATR;
+    }
+    return response;
+}
+
+
+uint16_t MC06XSD200ModelOutput(const uint8_t channel)
+{
+    uint16_t PWM;
+    if ((channel > 1) || !awake || !normal || faults[channel])
+    {
+        return 0;
+    }
+    PWM = registers[channel][PWMR];
+    return (PWM & PWM_ON)?((PWM & 0x00FF) + 1):0;
+}
+
+
+int8_t MC06XSD200ModelSenseChannel(void)
+{
+    if (!awake || !normal)
+    {
+        return -1;
+    }
+    switch (registers[0][GCR] & (GCR_CSNS_0 | GCR_CSNS_1))
+    {
+        case GCR_CSNS_0:
+            return 0;
+        case GCR_CSNS_1:
+            return 1;
+        default:
+            return -1;
+    }
+}
+
+
+void MC06XSD200ModelFault(const uint8_t channel, const bool fault)
+{
+    if (channel < 2)
+    {
+        faults[channel] = fault;
+    }
+}
+
+
+uint32_t MC06XSD200ModelParityErrors(void)
+{
+    return parity_errors;
+}
+
+
+uint32_t MC06XSD200ModelWords(void)
+{
+    return words;
+}
@@ -0,0 +1,66 @@
+/*
+ * File:   MC06XSD200_model.h
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Host model of the NXP MC06XSD200 dual power switch SPI register interface.
+ * Only used by the host build.
+ *
+ * Each 16 bit word transferred is either a register write (address in bits 10-12, channel in bit 13,
+ * data in bits 0-8) or a read command (address bits zero, register number in bits 0-2). The word
+ * returned during a transfer is the register selected by the previous read command (status after
+ * a write) with the channel, register address and normal mode bits set as the real chip returns them.
+ * Words with odd parity are counted and ignored.
+ * Above the chip's maximum SCK rate the words are received and returned a bit out.
+ *
+ * The chip only responds while awake (OUTPUT_WAKE high) and returns to its reset values when put
+ * to sleep. A fault can be injected on either channel which then shows in the fault and status
+ * registers and turns the channel's output off.
+ *
+ * The current sense output (CSNS) follows the channel selected by the GCR current sense bits - bit 0 for
+ * channel 0 and bit 1 for channel 1.
+ *
+ */
+
+#ifndef MC06XSD200_MODEL_H
+#define	MC06XSD200_MODEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+/* resets the model to asleep with all registers at their reset values */
+void MC06XSD200ModelReset(void);
+
+/* sets the wake (not reset) input. Going to sleep resets the registers. */
+void MC06XSD200ModelWake(const bool awake);
+
+/* transfers one word - returns the word clocked out by the chip */
+uint16_t MC06XSD200ModelTransfer(const uint16_t word);
+
+/* returns the output level of the channel from 0 (off) to 256 (fully on) */
+uint16_t MC06XSD200ModelOutput(const uint8_t channel);
+
+/* returns the channel (0 or 1) the current sense output follows - -1 if none */
+int8_t MC06XSD200ModelSenseChannel(void);
+
+/* injects (or clears) a fault condition on the channel */
+void MC06XSD200ModelFault(const uint8_t channel, const bool fault);
+
+/* returns the number of words received with a parity error since the model was reset */
+uint32_t MC06XSD200ModelParityErrors(void);
+
+/* returns the number of words transferred since the model was reset */
+uint32_t MC06XSD200ModelWords(void);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* MC06XSD200_MODEL_H */
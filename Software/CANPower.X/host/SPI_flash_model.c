@@ -0,0 +1,193 @@
+/*
+ * File:   SPI_flash_model.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Host model of a 1MB JEDEC SPI NOR flash.
+ * See SPI_flash_model.h.
+ *
+ */
+
+#include <string.h>
+#include "SPI_flash_model.h"
+
+
+// commands
+#define WRITE_ENABLE 0x06
+#define READ_STATUS 0x05
+#define READ_DATA 0x03
+#define PAGE_PROGRAM 0x02
+#define SECTOR_ERASE 0x20
+#define READ_JEDEC_ID 0x9F
+
+#define STATUS_BUSY 0x01
+#define STATUS_WRITE_ENABLED 0x02
+#define PAGE_SIZE 256
+#define SECTOR_SIZE 4096
+#define ADDRESS_BYTES 3
+
+static const uint8_t JEDEC_ID[3] = {0xEF, 0x40, 0x14}; // Winbond, SPI NOR, 2^20 bytes
+
+static uint8_t memory[SPI_FLASH_MODEL_SIZE];
+static bool fitted;
+static bool write_enabled;
+static uint64_t now; // time of the last select
+static uint64_t busy_until;
+static uint32_t programs, erases;
+
+// the command in progress
+static uint32_t bytes; // received since the select
+static uint8_t command;
+static uint32_t address;
+static uint8_t page[PAGE_SIZE]; // page program data as received
+static bool ignored; // command received while busy
+
+
+void SPIFlashModelErase(void)
+{
+    memset(memory, 0xFF, sizeof(memory));
+    write_enabled = false;
+    busy_until = 0;
+    programs = 0;
+    erases = 0;
+}
+
+
+void SPIFlashModelFit(const bool fit)
+{
+    fitted = fit;
+}
+
+
+bool SPIFlashModelFitted(void)
+{
+    return fitted;
+}
+
+
+static bool Busy(void)
+{
+    return now < busy_until;
+}
+
+
+void SPIFlashModelSelect(const uint64_t time)
+{
+    now = time;
+    bytes = 0;
+    address = 0;
+    ignored = false;
+}
+
+
+void SPIFlashModelDeselect(void)
+{
+    if (ignored || (bytes == 0))
+    {
+        return;
+    }
+    switch (command)
+    {
+        case WRITE_ENABLE:
+            write_enabled = true;
+            break;
+        case PAGE_PROGRAM:
+            if (write_enabled && (bytes > 1 + ADDRESS_BYTES))
+            {
+                uint32_t base = address & (SPI_FLASH_MODEL_SIZE - PAGE_SIZE);
+                uint16_t i;
+                for (i=0; i<PAGE_SIZE; ++i)
+                {
+                    memory[base + i] &= page[i];
+                }
+                write_enabled = false;
+                busy_until = now + SPI_FLASH_MODEL_PROGRAM_TIME;
+                ++programs;
+            }
+            break;
+        case SECTOR_ERASE:
+            if (write_enabled && (bytes == 1 + ADDRESS_BYTES))
+            {
+                memset(&memory[address & (SPI_FLASH_MODEL_SIZE - SECTOR_SIZE)], 0xFF, SECTOR_SIZE);
+                write_enabled = false;
+                busy_until = now + SPI_FLASH_MODEL_ERASE_TIME;
+                ++erases;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+
+/* one byte of the command in progress - returns the byte clocked out */
+static uint8_t Byte(const uint8_t in)
+{
+    uint32_t index = bytes++;
+    if (index == 0)
+    {
+        command = in;
+        ignored = Busy() && (command != READ_STATUS);
+        if (command == PAGE_PROGRAM)
+        {
+            memset(page, 0xFF, sizeof(page));
+        }
+        return 0xFF;
+    }
+    if (ignored)
+    {
+        return 0xFF;
+    }
+    switch (command)
+    {
+        case READ_JEDEC_ID:
+            return (index <= sizeof(JEDEC_ID)) ? JEDEC_ID[index - 1] : 0xFF;
+        case READ_STATUS:
+            return (Busy() ? STATUS_BUSY : 0) | (write_enabled ? STATUS_WRITE_ENABLED : 0);
+        case READ_DATA:
+        case PAGE_PROGRAM:
+        case SECTOR_ERASE:
+            if (index <= ADDRESS_BYTES)
+            {
+                address = ((address << 8) | in) & (SPI_FLASH_MODEL_SIZE - 1);
+                return 0xFF;
+            }
+            if (command == READ_DATA)
+            {
+                return memory[(address + index - 1 - ADDRESS_BYTES) & (SPI_FLASH_MODEL_SIZE - 1)];
+            }
+            if (command == PAGE_PROGRAM)
+            {
+                page[(address + index - 1 - ADDRESS_BYTES) % PAGE_SIZE] &= in;
+            }
+            return 0xFF;
+        default:
+            return 0xFF;
+    }
+}
+
+
+uint16_t SPIFlashModelTransfer(const uint16_t word)
+{
+    uint16_t out = (uint16_t)Byte(word >> 8) << 8;
+    return out | Byte(word & 0xFF);
+}
+
+
+const uint8_t *SPIFlashModelMemory(void)
+{
+    return memory;
+}
+
+
+uint32_t SPIFlashModelPrograms(void)
+{
+    return programs;
+}
+
+
+uint32_t SPIFlashModelErases(void)
+{
+    return erases;
+}
@@ -0,0 +1,68 @@
+/*
+ * File:   SPI_flash_model.h
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Host model of a 1MB JEDEC SPI NOR flash (W25Q80 style - JEDEC ID EF 40 14) for the data logger on CS1.
+ * Only used by the host build.
+ *
+ * Words are transferred 16 bits at a time most significant byte first. A command is the bytes between
+ * a select and a deselect: read JEDEC ID (9F), read status (05 - write in progress bit 0, write enable
+ * latch bit 1), write enable (06), read data (03), page program (02) and 4KB sector erase (20) - the last
+ * three with a three byte address. A page program ANDs its data into the page (wrapping within it) and
+ * a page program or sector erase happens at the deselect if the write enable latch was set. The flash is
+ * then busy for the datasheet typical time, during which anything but a read status is ignored.
+ *
+ * The memory keeps its contents until erased with SPIFlashModelErase. While not fitted the model is
+ * never selected and the SPI input floats high.
+ *
+ */
+
+#ifndef SPI_FLASH_MODEL_H
+#define	SPI_FLASH_MODEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+#define SPI_FLASH_MODEL_SIZE 0x100000 // bytes
+#define SPI_FLASH_MODEL_PROGRAM_TIME 700000ULL // ns - typical page program
+#define SPI_FLASH_MODEL_ERASE_TIME 45000000ULL // ns - typical sector erase
+
+
+/* erases the whole memory as a new part */
+void SPIFlashModelErase(void);
+
+/* fits or removes the flash */
+void SPIFlashModelFit(const bool fitted);
+
+/* returns true if the flash is fitted */
+bool SPIFlashModelFitted(void);
+
+/* chip select active at the time in ns - starts a command */
+void SPIFlashModelSelect(const uint64_t time);
+
+/* chip select inactive - ends the command and starts any program or erase */
+void SPIFlashModelDeselect(void);
+
+/* transfers one word - returns the word clocked out by the flash */
+uint16_t SPIFlashModelTransfer(const uint16_t word);
+
+/* returns the memory contents */
+const uint8_t *SPIFlashModelMemory(void);
+
+/* returns the numbers of page programs and sector erases since the memory was erased */
+uint32_t SPIFlashModelPrograms(void);
+uint32_t SPIFlashModelErases(void);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* SPI_FLASH_MODEL_H */
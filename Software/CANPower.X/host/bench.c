@@ -0,0 +1,380 @@
+/*
+ * File:   bench.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Host microbenchmarks of the firmware hot spots.
+ * Built and run by the host build (make -C host bench).
+ *
+ * Each benchmark runs a firmware function many times against the simulated register file and
+ * reports the host wall time per invocation along with the modelled operations per invocation:
+ * program memory table reads and writes, word and row programs, page erases, SPI words and the interrupts
+ * taken for the SPI transfers.
+ * Host times are only good for comparing builds on the same workstation - the modelled
+ * operation counts are what carry over to the target.
+ *
+ * The switch chip and CAN module sources are included directly so that the benchmarks can get
+ * at their static state (the Parity function and the CAN DMA buffers). The EEPROM source is included
+ * with a larger emulated EEPROM so as to have room for a settings block.
+ *
+ * The flash stall column is the CPU stall for the flash operations at the datasheet times.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "xc.h"
+#include "MC06XSD200_model.h"
+#include "../MC06XSD200.c"
+#include "../CAN.c"
+#define SETTINGS_BLOCK_SIZE 16 // emulated EEPROM size for the benchmarks
+#define DATA_EE_SIZE SETTINGS_BLOCK_SIZE
+#include "../EEPROM.c"
+#include "../LEDs.h"
+#include "../ports.h"
+#include "../timer.h"
+#include "../events.h"
+#include "../journal.h"
+#include "../flash.h"
+#include "../ADC.h"
+
+
+// interrupt routines of the modules linked in
+void _T4Interrupt(void);
+void _OC4Interrupt(void);
+void _DMA1Interrupt(void);
+void _DMA2Interrupt(void);
+
+
+// sink for results so that the compiler can't optimise the work away
+static volatile uint32_t sink;
+
+
+typedef struct
+{
+    const char *name;
+    void (*setup)(void);
+    void (*function)(void);
+    uint32_t iterations;
+} benchmark_t;
+
+
+// interrupts taken by the SPI transfers
+static uint32_t SPI_interrupts;
+
+
+/* completes any SPI transfer in progress against the switch chip model - the start interrupt
+ * at its output compare 4 match and then the DMA of all of the words */
+static void RunSPI(void)
+{
+    if (!SPIIdle() && _OC4IE)
+    {
+        TMR3 = OC4R;
+        _OC4IF = 1;
+        _OC4Interrupt();
+        ++SPI_interrupts;
+    }
+    if (HostSPIDMATransfer(MC06XSD200ModelTransfer) > 0)
+    {
+        _DMA1Interrupt();
+        ++SPI_interrupts;
+    }
+}
+
+
+// *****************************************************************************
+// Parity
+static uint16_t parity_word;
+
+static void ParitySetup(void)
+{
+    parity_word = 0;
+}
+
+static void ParityBenchmark(void)
+{
+    sink += Parity(parity_word++);
+}
+
+
+// *****************************************************************************
+// CAN receive interrupt - alternating ECU and instruments messages
+static uint16_t can_vector;
+
+static void CANSetup(void)
+{
+    InitializeEvents();
+    InitializeCAN();
+    memset(dma_buffers, 0, sizeof(dma_buffers));
+    dma_buffers[0][2] = 8;
+    dma_buffers[0][5] = 0x0600;
+    dma_buffers[1][2] = 8;
+    dma_buffers[1][3] = 0x8000;
+    dma_buffers[1][4] = 0x0012;
+    can_vector = 0;
+}
+
+static void CANBenchmark(void)
+{
+    _ICODE = can_vector;
+    can_vector ^= 1;
+    _C1Interrupt();
+    sink += EventsFetch(EVENT_CAN_ECU | EVENT_CAN_INSTRUMENTS);
+}
+
+
+// *****************************************************************************
+// EEPROM
+static uint16_t EEPROM_data;
+
+static void EEPROMSetup(void)
+{
+    HostFlashErase();
+    InitializeEEPROM();
+    DataEEWrite(0x1234, 0);
+    DataEEWrite(0x5678, 1);
+    DataEEFlush(); // the first page is started by a pack
+    EEPROM_data = 0;
+}
+
+static void BootSetup(void)
+{
+    EEPROMSetup();
+    // the worst case boot scans a nearly full page
+    while (nextFree < (NUMBER_OF_INSTRUCTIONS_IN_PAGE - INITIALIZATION_PACK_COUNT))
+    {
+        DataEEWrite(EEPROM_data, EEPROM_data & 1);
+        ++EEPROM_data;
+    }
+}
+
+static void InitializeEEPROMBenchmark(void)
+{
+    InitializeEEPROM();
+}
+
+static void DataEEReadBenchmark(void)
+{
+    sink += DataEERead(EEPROM_data++ & 1);
+}
+
+static void DataEEWriteBenchmark(void)
+{
+    DataEEWrite(EEPROM_data, EEPROM_data & 1);
+    FlashTasks();
+    EEPROMTasks(); // a write per tick - packs are run on in the background
+    ++EEPROM_data;
+}
+
+static void DataEEWriteBlockBenchmark(void)
+{
+    uint8_t addr;
+    // a settings block as single writes
+    for (addr=0; addr<SETTINGS_BLOCK_SIZE; ++addr)
+    {
+        DataEEWrite(EEPROM_data++, addr);
+    }
+    DataEEFlush(); // each block a separate save - including any pack it causes
+}
+
+static void DataEECommitBlockBenchmark(void)
+{
+    uint8_t addr;
+    // a settings block as a group
+    DataEEBegin();
+    for (addr=0; addr<SETTINGS_BLOCK_SIZE; ++addr)
+    {
+        DataEEStage(EEPROM_data++, addr);
+    }
+    DataEECommit();
+    DataEEFlush();
+}
+
+static void DataEEWriteAsyncBenchmark(void)
+{
+    uint16_t i;
+    // the same address written several times a tick - only the last value is programmed
+    for (i=0; i<4; ++i)
+    {
+        DataEEWriteAsync(EEPROM_data++, 0);
+    }
+    FlashTasks();
+    EEPROMTasks();
+}
+
+
+// *****************************************************************************
+// journal - a record a tick
+static uint16_t journal_data[JOURNAL_DATA_WORDS];
+
+static void JournalSetup(void)
+{
+    HostFlashErase();
+    InitializeJournal();
+}
+
+static void JournalAppendBenchmark(void)
+{
+    ++journal_data[0];
+    FlashTasks();
+    JournalAppend(JOURNAL_STATE, journal_data);
+    JournalTasks();
+}
+
+
+// *****************************************************************************
+// LEDs - a tick on every invocation
+static void LEDSetup(void)
+{
+    InitializeTimer();
+    InitializeLEDs();
+    LEDPattern(LED0, LED_FLASH_4HZ);
+    LEDPattern(LED1, LED_ON_BLIPS_3);
+}
+
+static void LEDBenchmark(void)
+{
+    _T4Interrupt();
+    LEDTasks();
+}
+
+
+// *****************************************************************************
+// switch chip - a tick on every invocation once the chip is ready
+static void SwitchSetup(void)
+{
+    uint16_t tick;
+    InitializeTimer();
+    InitializeEvents();
+    InitializeSPI();
+    MC06XSD200ModelReset();
+    InitializeMC06XSD200();
+    SetPWMLevel0(128, SLOW_PWM);
+    SetPWMLevel1(200, FAST_PWM);
+    SwitchChipOn();
+    for (tick = 0; (tick < 100) && (state != READY); ++tick)
+    {
+        _T4Interrupt();
+        MC06XSD200Tasks();
+        MC06XSD200Thread();
+        MC06XSD200ModelWake(PORT_OUTPUT_WAKE == OUTPUT_WAKE_PORT_ACTIVE);
+        RunSPI();
+        MC06XSD200Thread();
+        RunSPI();
+        MC06XSD200Thread();
+    }
+    if (state != READY)
+    {
+        fprintf(stderr, "switch chip didn't become ready\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void SwitchBenchmark(void)
+{
+    _T4Interrupt();
+    MC06XSD200Tasks();
+    MC06XSD200Thread();
+    RunSPI();
+    MC06XSD200Thread();
+    RunSPI();
+    MC06XSD200Thread();
+}
+
+
+// *****************************************************************************
+// ADC DMA interrupt - a block of current sense conversions on every invocation (8 blocks a PWM period)
+static uint16_t conversion;
+
+static uint16_t Conversion(void)
+{
+    return conversion++ & 0x03FF;
+}
+
+static void ADCSetup(void)
+{
+    InitializeADC();
+    ADCStart();
+}
+
+static void ADCBenchmark(void)
+{
+    uint32_t sum;
+    HostADCDMABlock(Conversion);
+    _DMA2Interrupt();
+    if (ADCPeriod(&sum))
+    {
+        sink += sum;
+    }
+}
+
+
+static const benchmark_t benchmarks[] =
+{
+    {"Parity", ParitySetup, ParityBenchmark, 1000000},
+    {"_C1Interrupt", CANSetup, CANBenchmark, 1000000},
+    {"InitializeEEPROM", BootSetup, InitializeEEPROMBenchmark, 20000},
+    {"DataEERead", EEPROMSetup, DataEEReadBenchmark, 100000},
+    {"DataEEWrite", EEPROMSetup, DataEEWriteBenchmark, 20000},
+    {"DataEEWriteAsync", EEPROMSetup, DataEEWriteAsyncBenchmark, 20000},
+    {"DataEEWrite x16", EEPROMSetup, DataEEWriteBlockBenchmark, 2000},
+    {"DataEECommit x16", EEPROMSetup, DataEECommitBlockBenchmark, 2000},
+    {"JournalAppend", JournalSetup, JournalAppendBenchmark, 20000},
+    {"LEDTasks", LEDSetup, LEDBenchmark, 1000000},
+    {"MC06XSD200Tasks", SwitchSetup, SwitchBenchmark, 100000},
+    {"_DMA2Interrupt", ADCSetup, ADCBenchmark, 1000000},
+};
+
+
+static double Seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + (now.tv_nsec / 1e9);
+}
+
+
+int main(int argc, char *argv[])
+{
+    uint16_t b;
+    uint32_t i;
+    double start, elapsed, n;
+    uint32_t words;
+    uint32_t interrupts;
+    host_statistics_t before;
+
+    printf("%-16s %10s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "benchmark", "iterations", "ns/call",
+        "tblrd", "tblwt", "wordprog", "rowprog", "erase", "stall us", "SPI words", "SPI ISRs");
+    for (b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); ++b)
+    {
+        if ((argc > 1) && (strcmp(argv[1], benchmarks[b].name) != 0))
+        {
+            continue;
+        }
+        benchmarks[b].setup();
+        before = host_statistics;
+        words = MC06XSD200ModelWords();
+        interrupts = SPI_interrupts;
+        start = Seconds();
+        for (i = 0; i < benchmarks[b].iterations; ++i)
+        {
+            benchmarks[b].function();
+        }
+        elapsed = Seconds() - start;
+        n = benchmarks[b].iterations;
+        printf("%-16s %10u %10.1f %10.3f %10.3f %10.3f %10.3f %10.5f %10.1f %10.3f %10.3f\n", benchmarks[b].name,
+            benchmarks[b].iterations, elapsed * 1e9 / n,
+            (host_statistics.table_reads - before.table_reads) / n,
+            (host_statistics.table_writes - before.table_writes) / n,
+            (host_statistics.word_programs - before.word_programs) / n,
+            (host_statistics.row_programs - before.row_programs) / n,
+            (host_statistics.page_erases - before.page_erases) / n,
+            (host_statistics.flash_stall - before.flash_stall) / n,
+            (MC06XSD200ModelWords() - words) / n,
+            (SPI_interrupts - interrupts) / n);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,307 @@
+/*
+ * File:   journal_stress.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Randomised power failure stress test of the event journal.
+ * Built and run by the host build (make -C host stress).
+ *
+ * Usage: journal_stress [-c cycles] [-s seed] [-f flash_file]
+ *
+ * Each cycle boots the journal (InitializeJournal), reads it back from the tail to the head and then
+ * makes random appends (JournalAppend) and timer ticks (FlashTasks and JournalTasks) until a power
+ * failure cuts it short. The power failure is scheduled at a random NVM operation of the cycle with a
+ * random number of the words of that operation done - so records are cut short before their CRC is
+ * programmed and ahead pages are left part erased. Some cycles end with a clean reset instead. The share
+ * of ticks is random for each cycle so that the head sometimes catches up with the ahead page and the
+ * erase is made by the append. Enough records are appended for the pages and the sequence numbers to
+ * wrap many times.
+ *
+ * Every append attempt is given an id which is written in its data along with a check word - so each
+ * record identifies the attempt. After a boot every record read back must be one that was appended
+ * with the sequence number it was given, the records must come in the order they were appended with
+ * their sequence numbers increasing (as serial numbers) and the next sequence number must follow on from
+ * the last record. Every append that completed within the last JOURNAL_PAGES - 2 pages of slots (counting
+ * the slots of records cut short) must be read back. Every boot must be bounded: no flash stall at all.
+ *
+ * The journal source is included directly so that the test can see the head slot when the power fails.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "xc.h"
+#include "../journal.c"
+
+
+#define DEFAULT_CYCLES 100000UL
+#define MAXIMUM_OPERATIONS 400 // random calls per cycle before a clean reset
+#define MAXIMUM_NVM_OPERATIONS 800 // power fails at up to this many NVM operations into a cycle
+#define CLEAN_RESET_PERCENT 5
+
+// the slots whose completed records are always kept - the head page and the full pages before it
+#define RETAINED_SLOTS ((JOURNAL_PAGES - 2) * JOURNAL_SLOTS)
+
+// append attempts remembered - many more than the journal holds
+#define ATTEMPTS 65536UL
+
+
+typedef struct
+{
+    uint32_t id;
+    uint16_t sequence;
+    uint8_t type;
+    bool completed;     // JournalAppend returned
+    bool slot;          // it took a slot - completed or cut short part way through
+    bool read;          // read back at the last boot
+} attempt_t;
+
+static attempt_t attempts[ATTEMPTS];
+static uint32_t next_id;                    // of the next append attempt
+static volatile bool appending;             // an append is in progress when the power fails
+
+static jmp_buf power_fail;
+static uint32_t failures;
+static uint32_t appends;
+static uint32_t torn;                       // records cut short in a slot
+static uint32_t records_minimum = UINT32_MAX;   // read back at a boot once the journal has wrapped
+static uint32_t records_maximum;
+
+
+static void Data(const uint32_t id, uint16_t data[JOURNAL_DATA_WORDS])
+{
+    data[0] = id & 0xFFFF;
+    data[1] = id >> 16;
+    data[2] = ~data[0];
+    data[3] = (uint16_t)(id * 40503UL);
+}
+
+
+static uint32_t Random(const uint32_t range)
+{
+    return (uint32_t)(((uint64_t)rand() * range) / ((uint64_t)RAND_MAX + 1));
+}
+
+
+// a record cut short has taken its slot if anything of it was programmed
+static void PowerFail(void)
+{
+    if (appending && (headSlot < JOURNAL_SLOTS) && !SlotFree(headPage, headSlot))
+    {
+        attempts[(next_id - 1) % ATTEMPTS].slot = true;
+        ++torn;
+    }
+    longjmp(power_fail, 1);
+}
+
+
+// checks the records read back after a boot
+static void Check(const uint32_t cycle)
+{
+    journal_iterator_t iterator;
+    journal_record_t record;
+    uint16_t data[JOURNAL_DATA_WORDS];
+    attempt_t *attempt;
+    uint32_t id;
+    uint32_t last_id = 0;
+    uint16_t last_sequence = 0;
+    uint32_t records = 0;
+    uint32_t slots = 0;
+
+    for (id = (next_id > ATTEMPTS)?(next_id - ATTEMPTS):0; id < next_id; ++id)
+    {
+        attempts[id % ATTEMPTS].read = false;
+    }
+
+    JournalFirst(&iterator);
+    while (JournalNext(&iterator, &record))
+    {
+        id = record.data[0] | ((uint32_t)record.data[1] << 16);
+        attempt = &attempts[id % ATTEMPTS];
+        Data(id, data);
+        if ((id >= next_id) || (attempt->id != id) || (memcmp(data, record.data, sizeof(data)) != 0)
+            || (record.type != attempt->type) || (record.sequence != attempt->sequence))
+        {
+            printf("cycle %lu: record %u type %u data %04X %04X %04X %04X wasn't appended\n", (unsigned long)cycle,
+                record.sequence, record.type, record.data[0], record.data[1], record.data[2], record.data[3]);
+            ++failures;
+        }
+        else if ((records > 0) && ((id <= last_id) || ((int16_t)(record.sequence - last_sequence) <= 0)))
+        {
+            printf("cycle %lu: record %u (append %lu) read after record %u (append %lu)\n", (unsigned long)cycle,
+                record.sequence, (unsigned long)id, last_sequence, (unsigned long)last_id);
+            ++failures;
+        }
+        else
+        {
+            attempt->read = true;
+        }
+        last_id = id;
+        last_sequence = record.sequence;
+        ++records;
+    }
+
+    if ((records > 0) && (JournalSequence() != (uint16_t)(last_sequence + 1)))
+    {
+        printf("cycle %lu: next sequence %u after record %u\n", (unsigned long)cycle, JournalSequence(),
+            last_sequence);
+        ++failures;
+    }
+
+    // the completed appends of the retained slots - newest first
+    for (id = next_id; (id > 0) && ((next_id - id) < ATTEMPTS) && (slots < RETAINED_SLOTS); --id)
+    {
+        attempt = &attempts[(id - 1) % ATTEMPTS];
+        if (attempt->slot)
+        {
+            ++slots;
+            if (attempt->completed && !attempt->read)
+            {
+                printf("cycle %lu: record %u (append %lu) lost\n", (unsigned long)cycle, attempt->sequence,
+                    (unsigned long)attempt->id);
+                ++failures;
+            }
+        }
+    }
+
+    if (appends > (JOURNAL_PAGES * JOURNAL_SLOTS))
+    {
+        records_minimum = (records < records_minimum)?records:records_minimum;
+    }
+    records_maximum = (records > records_maximum)?records:records_maximum;
+}
+
+
+static void Append(void)
+{
+    attempt_t *attempt = &attempts[next_id % ATTEMPTS];
+    uint16_t data[JOURNAL_DATA_WORDS];
+
+    attempt->id = next_id;
+    attempt->sequence = JournalSequence();
+    attempt->type = next_id % NUMBER_OF_JOURNAL_TYPES;
+    attempt->completed = false;
+    attempt->slot = false;
+    attempt->read = false;
+    Data(next_id, data);
+    ++next_id;
+
+    appending = true;
+    JournalAppend(attempt->type, data);
+    appending = false;
+    attempt->completed = true;
+    attempt->slot = true;
+    ++appends;
+}
+
+
+static void Tick(void)
+{
+    FlashTasks();
+    JournalTasks();
+}
+
+
+// runs a cycle from boot until the power fails or it's reset
+static void Cycle(const uint32_t cycle)
+{
+    volatile uint16_t operations;
+    uint32_t ticks = Random(100);  // percentage of the calls
+    uint64_t start;
+
+    appending = false;
+    if (Random(100) >= CLEAN_RESET_PERCENT)
+    {
+        HostFlashPowerFail(1 + Random(MAXIMUM_NVM_OPERATIONS), Random(NUMBER_OF_INSTRUCTIONS_IN_PAGE + 1));
+    }
+    if (setjmp(power_fail) == 0)
+    {
+        start = host_statistics.flash_stall;
+        InitializeJournal();
+        if (host_statistics.flash_stall != start)
+        {
+            printf("cycle %lu: boot stalled for %lu us\n", (unsigned long)cycle,
+                (unsigned long)(host_statistics.flash_stall - start));
+            ++failures;
+        }
+        Check(cycle);
+        for (operations = 0; operations < MAXIMUM_OPERATIONS; ++operations)
+        {
+            if (Random(100) < ticks)
+            {
+                Tick();
+            }
+            else
+            {
+                Append();
+            }
+        }
+    }
+    HostFlashPowerFail(0, 0);
+}
+
+
+int main(int argc, char *argv[])
+{
+    uint32_t cycles = DEFAULT_CYCLES;
+    uint32_t seed = 1;
+    const char *flash_file = NULL;
+    uint32_t cycle;
+    uint16_t page;
+    int i;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "-c") == 0) && (i + 1 < argc))
+        {
+            cycles = strtoul(argv[++i], NULL, 0);
+        }
+        else if ((strcmp(argv[i], "-s") == 0) && (i + 1 < argc))
+        {
+            seed = strtoul(argv[++i], NULL, 0);
+        }
+        else if ((strcmp(argv[i], "-f") == 0) && (i + 1 < argc))
+        {
+            flash_file = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-c cycles] [-s seed] [-f flash_file]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ((flash_file != NULL) && !HostFlashMap(flash_file))
+    {
+        perror(flash_file);
+        return EXIT_FAILURE;
+    }
+    HostFlashErase();
+    srand(seed);
+    host_power_fail_hook = PowerFail;
+    for (cycle = 0; cycle < cycles; ++cycle)
+    {
+        Cycle(cycle);
+    }
+    // a last boot to check the last cycle
+    InitializeJournal();
+    Check(cycle);
+
+    printf("%lu cycles (seed %lu), %lu failures\n", (unsigned long)cycles, (unsigned long)seed,
+        (unsigned long)failures);
+    printf("%lu appends (%lu sequence wraps), %lu records cut short\n", (unsigned long)appends,
+        (unsigned long)(appends >> 16), (unsigned long)torn);
+    printf("records read back: minimum %lu, maximum %lu, retained slots %u\n",
+        (unsigned long)((records_minimum == UINT32_MAX)?0:records_minimum), (unsigned long)records_maximum,
+        RETAINED_SLOTS);
+    printf("page erases:");
+    for (page = 0; page < JOURNAL_PAGES; ++page)
+    {
+        printf(" %lu", (unsigned long)HostFlashEraseCount(__builtin_tbladdress(&journalPages) + (JOURNAL_PAGE_SIZE * page)));
+    }
+    printf("\n");
+    return (failures == 0)?EXIT_SUCCESS:EXIT_FAILURE;
+}
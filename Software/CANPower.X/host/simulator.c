@@ -0,0 +1,1005 @@
+/*
+ * File:   simulator.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Discrete event board simulator.
+ * Built and run by the host build (make -C host simulate).
+ *
+ * Runs the complete firmware (main.c built with main renamed to FirmwareMain) against models of
+ * timer 4, the ECAN module and its DMA buffers, the SPI with the MC06XSD200 switch chip (CS0) and an SPI NOR
+ * flash for the data logger (CS1), the ADC and its DMA of the switch chip current sense, and the program flash.
+ * Virtual time advances from one event to the next every time that the firmware idles - a timer tick,
+ * an SPI word completing, a CAN message arriving, a DMA block of ADC conversions or a scenario step - so a day
+ * runs in a few seconds.
+ * The firmware runs in zero virtual time between idles.
+ *
+ * The CPU is powered while the ignition is on or the power latch (PORT_POWER) is held on. When
+ * neither is the case the firmware is stopped and restarted from reset the next time the ignition
+ * comes on. The flash (and so the emulated EEPROM) and the SPI flash keep their contents over power cycles.
+ *
+ * Usage: simulator [-t trace_file] scenario_file
+ *
+ * A scenario is a text file with one step per line. Each line is a time followed by a command.
+ * Times are absolute or, with a leading '+', relative to the previous step and have units of
+ * ms, s, min or h (which can be combined - 1h30min). '#' starts a comment. Commands are:
+ *   ignition on|off           ECU (20ms) and instruments (100ms) CAN messages start or stop
+ *   asc press|release         ASC switch state in the ECU messages
+ *   kickstand out|in          kickstand state in the ECU messages
+ *   ambient dark|light        ambient light state in the instruments messages
+ *   fault <channel> on|off    injects or clears a switch chip fault
+ *   flash fitted|removed      SPI flash on CS1 - found by the logger at the next boot (removed to start with)
+ *   load <channel> <mA>       load current drawn by the switch output while it is on (0 to start with)
+ *   expect channel <channel> on|off|<level>|<minimum>-<maximum>
+ *                             switch output level (0-256) now
+ *   expect duty <channel> <minimum>-<maximum>
+ *                             average switch output level (percent) over the last SLOW_PWM cycle
+ *   expect led <LED> on|off|dim|flashing|steady
+ *                             LED now (dim is on but not at full brightness)
+ *                             or over the last 6 seconds (flashing - at least two changes, steady - none)
+ *   expect power on|off       CPU powered
+ *   expect faults <count>|<minimum>-<maximum>
+ *                             switch chip faults that can be read back from the black box
+ *   expect fault number <number>|<minimum>-<maximum>
+ *                             number of the latest fault that can be read back from the black box (-1 if none)
+ *   expect log records|dropped <count>|<minimum>-<maximum>
+ *                             log records in the SPI flash, or dropped by the logger since the last boot
+ *   expect current <channel> <mA>|<minimum>-<maximum>
+ *                             load current last measured by the firmware
+ *   expect energy <channel> <Ws>|<minimum>-<maximum>
+ *                             energy delivered by the switch output since the last boot as measured by the firmware
+ *   expect meter <channel> time|energy <s>|<Wh>|<minimum>-<maximum>
+ *                             lifetime on time or energy of the switch output from the firmware's hour meters
+ *   end                       ends the simulation
+ * The simulator exits with failure if any expectation isn't met.
+ *
+ * The current sense output follows the load current of the channel selected in the switch chip while its
+ * output is on in the PWM cycle - each ADC conversion is at the end of a timer 3 period so two per PWM clock.
+ *
+ * The trace file gets a line for every change of the LED duties, switch outputs and CPU power.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+#include "xc.h"
+#include "MC06XSD200_model.h"
+#include "SPI_flash_model.h"
+#include "../ports.h"
+#include "../timer.h"
+#include "../LEDs.h"
+#include "../SPI.h"
+#include "../MC06XSD200.h"
+#include "../energy.h"
+#include "../faults.h"
+#include "../logger.h"
+#include "../ADC.h"
+#include "../hardware.h"
+#include "../application.h"
+#include "../meters.h"
+#include "../journal.h"
+
+
+// the firmware's entry point and interrupt routines
+int FirmwareMain(void);
+void _T4Interrupt(void);
+void _OC4Interrupt(void);
+void _DMA1Interrupt(void);
+void _DMA2Interrupt(void);
+void _C1Interrupt(void);
+
+
+// virtual time in ns
+typedef uint64_t sim_time_t;
+#define NEVER UINT64_MAX
+#define NS_PER_MS 1000000ULL
+#define NS_PER_S 1000000000ULL
+#define TIMER_COUNT_TIME (NS_PER_S / TIMER_COUNT_FREQUENCY)
+
+// model timings
+#define SPI_WORD_TIME ((PR3 + 1) * NS_PER_S / FCY) // the DMA sends a CS0 word each timer 3 period
+#define SPI_BURST_WORD_TIME (16 * HostSPIClockDivider() * NS_PER_S / FCY) // CS1 words back to back - 16 bits
+#define ADC_BLOCK_TIME ((DMA2CNT + 1) * (PR3 + 1) * NS_PER_S / FCY) // a conversion each timer 3 period
+#define DMA_REQUEST_FORCE 0x8000
+#define ECU_PERIOD (20 * NS_PER_MS)
+#define INSTRUMENTS_PERIOD (100 * NS_PER_MS)
+#define SLOW_PWM_CYCLE (256 * TIMER_PERIOD * NS_PER_MS)
+#define FLASHING_WINDOW (6 * NS_PER_S) // longer than the slow blips repeat
+
+// CAN receive buffers as allocated by the CAN module
+#define ECU_BUFFER 0
+#define INSTRUMENTS_BUFFER 1
+#define ECU_IDENTIFIER 0x10C
+#define INSTRUMENTS_IDENTIFIER 0x3FF
+
+// switch chip current sense - load current over the sense ratio into the sense resistor
+#define CURRENT_SENSE_RATIO 4500
+#define CURRENT_SENSE_RESISTOR 2200 // ohms
+
+// why the firmware was stopped
+#define POWERED_DOWN 1
+#define FINISHED 2
+
+
+// *****************************************************************************
+// board state
+
+static sim_time_t now;
+static sim_time_t last_tick, next_tick;
+static sim_time_t spi_start, spi_end;
+static sim_time_t spi_started, spi_transaction_time; // the last SPI transaction
+static uint16_t spi_transaction_words;
+static sim_time_t next_ECU, next_instruments;
+static sim_time_t next_ADC_block;
+static uint32_t conversions; // ADC conversions - the timer 3 periods while converting
+static uint16_t loads[2]; // mA
+
+static bool ignition, asc_pressed, kickstand_out, dark;
+static uint8_t instruments_counter;
+
+static bool running; // firmware running - CPU powered
+static jmp_buf stop;
+static uint32_t boots;
+
+
+// *****************************************************************************
+// traces - the recent history of each traced signal
+
+typedef enum {SIGNAL_LED0=0, SIGNAL_LED1, SIGNAL_CHANNEL0, SIGNAL_CHANNEL1, SIGNAL_POWER, NUMBER_OF_SIGNALS} signal_id_t;
+static const char *const SIGNAL_NAMES[NUMBER_OF_SIGNALS] = {"LED0", "LED1", "channel0", "channel1", "power"};
+
+#define HISTORY 64
+typedef struct
+{
+    uint16_t value;
+    uint16_t count; // changes recorded - up to HISTORY
+    uint16_t newest; // index of the newest change
+    sim_time_t times[HISTORY];
+    uint16_t values[HISTORY];
+} signal_t;
+static signal_t signals[NUMBER_OF_SIGNALS];
+static FILE *trace_file;
+
+
+static void Record(const signal_id_t id, const uint16_t value)
+{
+    signal_t *signal = &signals[id];
+    if ((signal->count > 0) && (signal->value == value))
+    {
+        return;
+    }
+    signal->newest = (signal->newest + 1) % HISTORY;
+    signal->times[signal->newest] = now;
+    signal->values[signal->newest] = value;
+    if (signal->count < HISTORY)
+    {
+        ++signal->count;
+    }
+    signal->value = value;
+    if (trace_file != NULL)
+    {
+        fprintf(trace_file, "%.3f %s %u\n", (double)now / NS_PER_S, SIGNAL_NAMES[id], value);
+    }
+}
+
+
+/* records the current state of the outputs */
+static void Sample(void)
+{
+    Record(SIGNAL_LED0, running?LEDDuty(LED0):0);
+    Record(SIGNAL_LED1, running?LEDDuty(LED1):0);
+    Record(SIGNAL_CHANNEL0, MC06XSD200ModelOutput(0));
+    Record(SIGNAL_CHANNEL1, MC06XSD200ModelOutput(1));
+    Record(SIGNAL_POWER, running);
+}
+
+
+/* returns the average value of the signal over the window up to now */
+static double Average(const signal_id_t id, const sim_time_t window)
+{
+    const signal_t *signal = &signals[id];
+    sim_time_t start = (now > window)?(now - window):0;
+    sim_time_t end = now;
+    double sum = 0;
+    uint16_t i, index;
+    for (i = 0; (i < signal->count) && (end > start); ++i)
+    {
+        index = (signal->newest + HISTORY - i) % HISTORY;
+        sim_time_t from = (signal->times[index] > start)?signal->times[index]:start;
+        sum += (double)signal->values[index] * (end - from);
+        end = from;
+    }
+    return (now > start)?(sum / (now - start)):signal->value;
+}
+
+
+/* returns the number of changes of the signal over the window up to now */
+static uint16_t Changes(const signal_id_t id, const sim_time_t window)
+{
+    const signal_t *signal = &signals[id];
+    sim_time_t start = (now > window)?(now - window):0;
+    uint16_t i, changes = 0;
+    for (i = 0; i < signal->count; ++i)
+    {
+        if (signal->times[(signal->newest + HISTORY - i) % HISTORY] > start)
+        {
+            ++changes;
+        }
+    }
+    return changes;
+}
+
+
+/* returns the number of faults that the black box can read back */
+static uint16_t Faults(void)
+{
+    fault_iterator_t iterator;
+    fault_snapshot_t snapshot;
+    uint16_t count = 0;
+    FaultsFirst(&iterator);
+    while (FaultsNext(&iterator, &snapshot))
+    {
+        ++count;
+    }
+    return count;
+}
+
+
+/* returns the number of the latest fault that the black box can read back - -1 if there isn't one */
+static int FaultNumber(void)
+{
+    fault_iterator_t iterator;
+    fault_snapshot_t snapshot;
+    FaultsFirst(&iterator);
+    return FaultsNext(&iterator, &snapshot) ? snapshot.number : -1;
+}
+
+
+/* returns the number of log records in the SPI flash - records are big endian words in the flash */
+static uint32_t LogRecords(void)
+{
+    const uint8_t *memory = SPIFlashModelMemory();
+    uint32_t address, count = 0;
+    for (address = 0; address < SPI_FLASH_MODEL_SIZE; address += LOG_RECORD_WORDS * 2)
+    {
+        if (((memory[address] << 8) | memory[address + 1]) < NUMBER_OF_LOG_TYPES)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+
+/* returns the records dropped by the logger since the last boot */
+static uint32_t LogDropped(void)
+{
+    logger_statistics_t statistics;
+    LoggerStatistics(&statistics);
+    return statistics.dropped;
+}
+
+
+// *****************************************************************************
+// scenario
+
+typedef enum {STEP_IGNITION, STEP_ASC, STEP_KICKSTAND, STEP_AMBIENT, STEP_FAULT,
+    STEP_FLASH, STEP_LOAD, STEP_EXPECT_CHANNEL, STEP_EXPECT_DUTY, STEP_EXPECT_LED, STEP_EXPECT_POWER,
+    STEP_EXPECT_FAULTS, STEP_EXPECT_FAULT_NUMBER, STEP_EXPECT_LOG, STEP_EXPECT_CURRENT, STEP_EXPECT_ENERGY, STEP_EXPECT_METER,
+    STEP_END} step_type_t;
+typedef enum {LED_EXPECT_ON, LED_EXPECT_OFF, LED_EXPECT_DIM, LED_EXPECT_FLASHING, LED_EXPECT_STEADY} LED_expectation_t;
+
+typedef struct
+{
+    sim_time_t time;
+    step_type_t type;
+    unsigned line;
+    int arguments[4];
+} step_t;
+
+static step_t *steps;
+static unsigned number_of_steps, next_step;
+static unsigned expectations, failures;
+
+
+/* parses a time with its units - e.g. 90s or 1h30min. Relative to previous if it starts with '+'.
+ * Returns false if invalid. */
+static bool ParseTime(const char *text, const sim_time_t previous, sim_time_t *const time)
+{
+    char *units;
+    double value, total = 0;
+    size_t length;
+    bool relative = (*text == '+');
+    if (relative)
+    {
+        ++text;
+    }
+    do
+    {
+        value = strtod(text, &units);
+        if (units == text) return false;
+        length = strspn(units, "abcdefghijklmnopqrstuvwxyz");
+        if ((length == 2) && (strncmp(units, "ms", 2) == 0)) total += value * NS_PER_MS;
+        else if ((length == 1) && (*units == 's')) total += value * NS_PER_S;
+        else if ((length == 3) && (strncmp(units, "min", 3) == 0)) total += value * 60.0 * NS_PER_S;
+        else if ((length == 1) && (*units == 'h')) total += value * 3600.0 * NS_PER_S;
+        else if ((length == 0) && (value == 0) && (*units == '\0')) {}
+        else return false;
+        text = units + length;
+    } while (*text != '\0');
+    *time = (relative?previous:0) + (sim_time_t)total;
+    return true;
+}
+
+
+/* returns the index of the word in the list or -1 */
+static int Choice(const char *word, const char *const *choices)
+{
+    int i;
+    for (i = 0; (word != NULL) && (choices[i] != NULL); ++i)
+    {
+        if (strcmp(word, choices[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/* parses a level range - a single level, on, off or minimum-maximum */
+static bool ParseRange(const char *text, int *const minimum, int *const maximum)
+{
+    if (text == NULL) return false;
+    if (strcmp(text, "on") == 0) {*minimum = PWM_FULL_ON; *maximum = PWM_FULL_ON; return true;}
+    if (strcmp(text, "off") == 0) {*minimum = PWM_FULL_OFF; *maximum = PWM_FULL_OFF; return true;}
+    if (sscanf(text, "%d-%d", minimum, maximum) == 2) return true;
+    if (sscanf(text, "%d", minimum) == 1) {*maximum = *minimum; return true;}
+    return false;
+}
+
+
+static void LoadScenario(const char *const file_name)
+{
+    static const char *const ON_OFF[] = {"off", "on", NULL};
+    static const char *const ASC[] = {"release", "press", NULL};
+    static const char *const KICKSTAND[] = {"in", "out", NULL};
+    static const char *const AMBIENT[] = {"light", "dark", NULL};
+    static const char *const LED_STATES[] = {"on", "off", "dim", "flashing", "steady", NULL};
+    static const char *const FLASH[] = {"removed", "fitted", NULL};
+    static const char *const LOG[] = {"records", "dropped", NULL};
+    static const char *const METER[] = {"time", "energy", NULL};
+    char line[256];
+    char *time, *command, *what, *argument1, *argument2, *argument3;
+    sim_time_t previous = 0;
+    unsigned line_number = 0;
+    step_t step;
+    bool ok;
+    FILE *file = fopen(file_name, "r");
+    if (file == NULL)
+    {
+        perror(file_name);
+        exit(EXIT_FAILURE);
+    }
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        ++line_number;
+        line[strcspn(line, "#")] = '\0';
+        time = strtok(line, " \t\r\n");
+        if (time == NULL)
+        {
+            continue;
+        }
+        command = strtok(NULL, " \t\r\n");
+        what = strtok(NULL, " \t\r\n");
+        argument1 = strtok(NULL, " \t\r\n");
+        argument2 = strtok(NULL, " \t\r\n");
+        argument3 = strtok(NULL, " \t\r\n");
+        memset(&step, 0, sizeof(step));
+        step.line = line_number;
+        ok = ParseTime(time, previous, &step.time) && (command != NULL);
+        if (!ok) {}
+        else if (strcmp(command, "ignition") == 0)
+        {
+            step.type = STEP_IGNITION;
+            ok = (step.arguments[0] = Choice(what, ON_OFF)) >= 0;
+        }
+        else if (strcmp(command, "asc") == 0)
+        {
+            step.type = STEP_ASC;
+            ok = (step.arguments[0] = Choice(what, ASC)) >= 0;
+        }
+        else if (strcmp(command, "kickstand") == 0)
+        {
+            step.type = STEP_KICKSTAND;
+            ok = (step.arguments[0] = Choice(what, KICKSTAND)) >= 0;
+        }
+        else if (strcmp(command, "ambient") == 0)
+        {
+            step.type = STEP_AMBIENT;
+            ok = (step.arguments[0] = Choice(what, AMBIENT)) >= 0;
+        }
+        else if (strcmp(command, "fault") == 0)
+        {
+            step.type = STEP_FAULT;
+            ok = (what != NULL) && ((step.arguments[0] = atoi(what)) <= 1)
+                && ((step.arguments[1] = Choice(argument1, ON_OFF)) >= 0);
+        }
+        else if (strcmp(command, "flash") == 0)
+        {
+            step.type = STEP_FLASH;
+            ok = (step.arguments[0] = Choice(what, FLASH)) >= 0;
+        }
+        else if (strcmp(command, "load") == 0)
+        {
+            step.type = STEP_LOAD;
+            ok = (what != NULL) && ((step.arguments[0] = atoi(what)) <= 1)
+                && (argument1 != NULL) && ((step.arguments[1] = atoi(argument1)) >= 0);
+        }
+        else if ((strcmp(command, "expect") == 0) && (what != NULL))
+        {
+            ++expectations;
+            if (strcmp(what, "channel") == 0)
+            {
+                step.type = STEP_EXPECT_CHANNEL;
+                ok = (argument1 != NULL) && ((step.arguments[0] = atoi(argument1)) <= 1)
+                    && ParseRange(argument2, &step.arguments[1], &step.arguments[2]);
+            }
+            else if (strcmp(what, "duty") == 0)
+            {
+                step.type = STEP_EXPECT_DUTY;
+                ok = (argument1 != NULL) && ((step.arguments[0] = atoi(argument1)) <= 1)
+                    && ParseRange(argument2, &step.arguments[1], &step.arguments[2]);
+            }
+            else if (strcmp(what, "led") == 0)
+            {
+                step.type = STEP_EXPECT_LED;
+                ok = (argument1 != NULL) && ((step.arguments[0] = atoi(argument1)) < NUMBEROFLEDs)
+                    && ((step.arguments[1] = Choice(argument2, LED_STATES)) >= 0);
+            }
+            else if (strcmp(what, "power") == 0)
+            {
+                step.type = STEP_EXPECT_POWER;
+                ok = (step.arguments[0] = Choice(argument1, ON_OFF)) >= 0;
+            }
+            else if (strcmp(what, "faults") == 0)
+            {
+                step.type = STEP_EXPECT_FAULTS;
+                ok = ParseRange(argument1, &step.arguments[1], &step.arguments[2]);
+            }
+            else if ((strcmp(what, "fault") == 0) && (argument1 != NULL) && (strcmp(argument1, "number") == 0))
+            {
+                step.type = STEP_EXPECT_FAULT_NUMBER;
+                ok = ParseRange(argument2, &step.arguments[1], &step.arguments[2]);
+            }
+            else if (strcmp(what, "log") == 0)
+            {
+                step.type = STEP_EXPECT_LOG;
+                ok = ((step.arguments[0] = Choice(argument1, LOG)) >= 0)
+                    && ParseRange(argument2, &step.arguments[1], &step.arguments[2]);
+            }
+            else if ((strcmp(what, "current") == 0) || (strcmp(what, "energy") == 0))
+            {
+                step.type = (strcmp(what, "current") == 0) ? STEP_EXPECT_CURRENT : STEP_EXPECT_ENERGY;
+                ok = (argument1 != NULL) && ((step.arguments[0] = atoi(argument1)) <= 1)
+                    && ParseRange(argument2, &step.arguments[1], &step.arguments[2]);
+            }
+            else if (strcmp(what, "meter") == 0)
+            {
+                step.type = STEP_EXPECT_METER;
+                ok = (argument1 != NULL) && ((step.arguments[0] = atoi(argument1)) <= 1)
+                    && ((step.arguments[3] = Choice(argument2, METER)) >= 0)
+                    && ParseRange(argument3, &step.arguments[1], &step.arguments[2]);
+            }
+            else
+            {
+                ok = false;
+            }
+        }
+        else if (strcmp(command, "end") == 0)
+        {
+            step.type = STEP_END;
+        }
+        else
+        {
+            ok = false;
+        }
+        if (!ok || (step.time < previous))
+        {
+            fprintf(stderr, "%s:%u: invalid step\n", file_name, line_number);
+            exit(EXIT_FAILURE);
+        }
+        previous = step.time;
+        steps = realloc(steps, (number_of_steps + 1) * sizeof(step_t));
+        steps[number_of_steps++] = step;
+    }
+    fclose(file);
+    if ((number_of_steps == 0) || (steps[number_of_steps - 1].type != STEP_END))
+    {
+        fprintf(stderr, "%s: scenario must finish with an end step\n", file_name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+static void Expect(const step_t *const step, const bool met, const char *const what, const double value)
+{
+    if (!met)
+    {
+        ++failures;
+        fprintf(stderr, "%.3fs line %u: expected %s - was %.1f\n", (double)now / NS_PER_S, step->line, what, value);
+    }
+}
+
+
+/* performs the step - returns true if it is the end */
+static bool Step(const step_t *const step)
+{
+    char what[64];
+    double value;
+    uint16_t changes;
+    switch (step->type)
+    {
+        case STEP_IGNITION:
+            ignition = step->arguments[0];
+            next_ECU = ignition?(now + NS_PER_MS):NEVER;
+            next_instruments = ignition?(now + 2 * NS_PER_MS):NEVER;
+            break;
+        case STEP_ASC:
+            asc_pressed = step->arguments[0];
+            break;
+        case STEP_KICKSTAND:
+            kickstand_out = step->arguments[0];
+            break;
+        case STEP_AMBIENT:
+            dark = step->arguments[0];
+            break;
+        case STEP_FAULT:
+            MC06XSD200ModelFault(step->arguments[0], step->arguments[1]);
+            break;
+        case STEP_FLASH:
+            SPIFlashModelFit(step->arguments[0]);
+            break;
+        case STEP_LOAD:
+            loads[step->arguments[0]] = step->arguments[1];
+            break;
+        case STEP_EXPECT_CHANNEL:
+            value = signals[SIGNAL_CHANNEL0 + step->arguments[0]].value;
+            snprintf(what, sizeof(what), "channel %d level %d-%d", step->arguments[0], step->arguments[1], step->arguments[2]);
+            Expect(step, (value >= step->arguments[1]) && (value <= step->arguments[2]), what, value);
+            break;
+        case STEP_EXPECT_DUTY:
+            value = Average(SIGNAL_CHANNEL0 + step->arguments[0], SLOW_PWM_CYCLE) * 100 / PWM_FULL_ON;
+            snprintf(what, sizeof(what), "channel %d duty %d-%d%%", step->arguments[0], step->arguments[1], step->arguments[2]);
+            Expect(step, (value >= step->arguments[1]) && (value <= step->arguments[2]), what, value);
+            break;
+        case STEP_EXPECT_LED:
+            value = signals[SIGNAL_LED0 + step->arguments[0]].value;
+            changes = Changes(SIGNAL_LED0 + step->arguments[0], FLASHING_WINDOW);
+            switch (step->arguments[1])
+            {
+                case LED_EXPECT_ON:
+                    snprintf(what, sizeof(what), "LED%d on", step->arguments[0]);
+                    Expect(step, value > 0, what, value);
+                    break;
+                case LED_EXPECT_OFF:
+                    snprintf(what, sizeof(what), "LED%d off", step->arguments[0]);
+                    Expect(step, value == 0, what, value);
+                    break;
+                case LED_EXPECT_DIM:
+                    snprintf(what, sizeof(what), "LED%d dim", step->arguments[0]);
+                    Expect(step, (value > 0) && (value < LED_DUTY_FULL), what, value);
+                    break;
+                case LED_EXPECT_FLASHING:
+                    snprintf(what, sizeof(what), "LED%d changes >= 2", step->arguments[0]);
+                    Expect(step, changes >= 2, what, changes);
+                    break;
+                case LED_EXPECT_STEADY:
+                    snprintf(what, sizeof(what), "LED%d changes == 0", step->arguments[0]);
+                    Expect(step, changes == 0, what, changes);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case STEP_EXPECT_POWER:
+            Expect(step, running == step->arguments[0], step->arguments[0]?"power on":"power off", running);
+            break;
+        case STEP_EXPECT_FAULTS:
+            value = Faults();
+            snprintf(what, sizeof(what), "faults %d-%d", step->arguments[1], step->arguments[2]);
+            Expect(step, (value >= step->arguments[1]) && (value <= step->arguments[2]), what, value);
+            break;
+        case STEP_EXPECT_FAULT_NUMBER:
+            value = FaultNumber();
+            snprintf(what, sizeof(what), "fault number %d-%d", step->arguments[1], step->arguments[2]);
+            Expect(step, (value >= step->arguments[1]) && (value <= step->arguments[2]), what, value);
+            break;
+        case STEP_EXPECT_LOG:
+            value = (step->arguments[0] == 0) ? LogRecords() : LogDropped();
+            snprintf(what, sizeof(what), "log %s %d-%d", (step->arguments[0] == 0) ? "records" : "dropped",
+                step->arguments[1], step->arguments[2]);
+            Expect(step, (value >= step->arguments[1]) && (value <= step->arguments[2]), what, value);
+            break;
+        case STEP_EXPECT_CURRENT:
+            value = running ? SwitchChannelCurrent(step->arguments[0]) : 0;
+            snprintf(what, sizeof(what), "channel %d current %d-%dmA", step->arguments[0], step->arguments[1],
+                step->arguments[2]);
+            Expect(step, (value >= step->arguments[1]) && (value <= step->arguments[2]), what, value);
+            break;
+        case STEP_EXPECT_ENERGY:
+            value = running ? SwitchChannelEnergy(step->arguments[0]) : 0;
+            snprintf(what, sizeof(what), "channel %d energy %d-%dWs", step->arguments[0], step->arguments[1],
+                step->arguments[2]);
+            Expect(step, (value >= step->arguments[1]) && (value <= step->arguments[2]), what, value);
+            break;
+        case STEP_EXPECT_METER:
+            if (step->arguments[3] == 0)
+            {
+                value = running ? MeterOnTime(step->arguments[0]) : 0;
+                snprintf(what, sizeof(what), "channel %d meter time %d-%ds", step->arguments[0], step->arguments[1],
+                    step->arguments[2]);
+            }
+            else
+            {
+                value = running ? MeterEnergy(step->arguments[0]) : 0;
+                snprintf(what, sizeof(what), "channel %d meter energy %d-%dWh", step->arguments[0],
+                    step->arguments[1], step->arguments[2]);
+            }
+            Expect(step, (value >= step->arguments[1]) && (value <= step->arguments[2]), what, value);
+            break;
+        case STEP_END:
+            return true;
+    }
+    return false;
+}
+
+
+// *****************************************************************************
+// peripheral models
+
+static bool Powered(void)
+{
+    return ignition || (PORT_POWER == POWER_PORT_ON);
+}
+
+
+/* the SPI slave selected - the switch chip unless CS1 is active (the input floats high if the SPI flash
+ * isn't fitted) */
+static uint16_t SPISlave(const uint16_t word)
+{
+    if (PORT_CS1 == CS1_PORT_ACTIVE)
+    {
+        return SPIFlashModelFitted() ? SPIFlashModelTransfer(word) : 0xFFFF;
+    }
+    return MC06XSD200ModelTransfer(word);
+}
+
+
+/* an ADC conversion of the switch chip current sense - the load current of the channel selected while its
+ * output is on in the PWM cycle of 2 * PWM_FULL_ON conversions */
+static uint16_t SenseConversion(void)
+{
+    int8_t channel = MC06XSD200ModelSenseChannel();
+    uint16_t phase = conversions++ % (2 * PWM_FULL_ON);
+    if ((channel < 0) || (phase >= 2 * MC06XSD200ModelOutput(channel)))
+    {
+        return 0;
+    }
+    return (uint64_t)loads[channel] * CURRENT_SENSE_RESISTOR * ADC_FULL_SCALE
+        / ((uint64_t)CURRENT_SENSE_RATIO * ADC_REFERENCE_MV);
+}
+
+
+/* delivers a CAN message to the receive buffer through the DMA and interrupts */
+static void ReceiveCAN(const uint16_t buffer_number, const uint16_t identifier, const uint16_t data[4])
+{
+    volatile uint16_t *buffer = HostDMAAddress(DMA3STA);
+    if ((buffer == NULL) || !DMA3CONbits.CHEN)
+    {
+        return;
+    }
+    buffer += buffer_number * 8;
+    buffer[0] = identifier << 2;
+    buffer[1] = 0;
+    buffer[2] = 8;
+    buffer[3] = data[0];
+    buffer[4] = data[1];
+    buffer[5] = data[2];
+    buffer[6] = data[3];
+    C1RXFUL1 |= 1 << buffer_number;
+    _ICODE = buffer_number;
+    _RBIF = 1;
+    _C1IF = 1;
+    if (_C1IE)
+    {
+        _C1Interrupt();
+    }
+}
+
+
+static void ECUMessage(void)
+{
+    uint16_t data[4] = {0, 0, 0, 0};
+    data[2] = (kickstand_out?0x0800:0x0400) | (asc_pressed?0x0200:0x0100);
+    ReceiveCAN(ECU_BUFFER, ECU_IDENTIFIER, data);
+}
+
+
+static void InstrumentsMessage(void)
+{
+    uint16_t data[4] = {0, 0, 0, 0};
+    data[0] = dark?0x8000:0x4000;
+    data[1] = instruments_counter;
+    if ((now / INSTRUMENTS_PERIOD) % (NS_PER_S / INSTRUMENTS_PERIOD) == 0)
+    {
+        ++instruments_counter;
+    }
+    ReceiveCAN(INSTRUMENTS_BUFFER, INSTRUMENTS_IDENTIFIER, data);
+}
+
+
+static sim_time_t Earliest(const sim_time_t a, const sim_time_t b)
+{
+    return (a < b)?a:b;
+}
+
+
+/* Invoked whenever the firmware idles. Advances virtual time to the next event that would
+ * wake the CPU performing any scenario steps on the way. */
+static void SimulatorIdle(void)
+{
+    sim_time_t next;
+    bool flash_selected;
+    uint16_t words;
+    Sample();
+    while (true)
+    {
+        if (!Powered())
+        {
+            longjmp(stop, POWERED_DOWN);
+        }
+        MC06XSD200ModelWake(PORT_OUTPUT_WAKE == OUTPUT_WAKE_PORT_ACTIVE);
+        if (T4CONbits.TON && (next_tick == NEVER))
+        {
+            last_tick = now;
+            next_tick = now + (PR4 + 1) * TIMER_COUNT_TIME;
+        }
+        // a busy SPI waiting on its start interrupt gets it half way through a timer 3 period
+        if (SPIIdle())
+        {
+            spi_start = NEVER;
+            spi_end = NEVER;
+        }
+        else if (_OC4IE && (spi_start == NEVER))
+        {
+            spi_started = now;
+            spi_start = now + SPI_WORD_TIME / 2;
+        }
+        else if (DMA0REQ & DMA_REQUEST_FORCE)
+        {
+            spi_started = now;
+            // a CS1 transfer has had its first word forced and the rest follow on
+            DMA0REQ &= ~DMA_REQUEST_FORCE;
+            spi_end = now + (DMA0CNT + 1) * SPI_BURST_WORD_TIME;
+        }
+        // the ADC converts on the timer 3 period match while it and its DMA channel are on
+        if (!T3CONbits.TON || !AD1CON1bits.ADON || !DMA2CONbits.CHEN)
+        {
+            next_ADC_block = NEVER;
+        }
+        else if (next_ADC_block == NEVER)
+        {
+            next_ADC_block = now + ADC_BLOCK_TIME;
+        }
+
+        next = Earliest(Earliest(Earliest(next_tick, spi_start), Earliest(spi_end, next_ADC_block)),
+            Earliest(next_ECU, next_instruments));
+        if (steps[next_step].time <= next)
+        {
+            now = steps[next_step].time;
+            if (Step(&steps[next_step++]))
+            {
+                longjmp(stop, FINISHED);
+            }
+            Sample();
+            continue; // scenario steps aren't interrupts - keep idling
+        }
+        now = next;
+        if (now == next_tick)
+        {
+            last_tick = now;
+            next_tick = now + (PR4 + 1) * TIMER_COUNT_TIME;
+            TMR4 = 0;
+            _T4IF = 1;
+            if (_T4IE)
+            {
+                _T4Interrupt();
+            }
+        }
+        else if (now == spi_start)
+        {
+            // the start interrupt at its match - the DMA then runs a word each period from the next one
+            spi_start = NEVER;
+            TMR3 = OC4R;
+            _OC4IF = 1;
+            _OC4Interrupt();
+            if (DMA0CONbits.CHEN)
+            {
+                spi_end = now + SPI_WORD_TIME / 2 + (DMA0CNT + 1) * SPI_WORD_TIME;
+            }
+        }
+        else if (now == spi_end)
+        {
+            spi_end = NEVER;
+            spi_transaction_time = now - spi_started;
+            spi_transaction_words = DMA0CNT + 1;
+            // CS1 is held active by the firmware until the completion interrupt
+            flash_selected = (PORT_CS1 == CS1_PORT_ACTIVE) && SPIFlashModelFitted();
+            if (flash_selected)
+            {
+                SPIFlashModelSelect(now);
+            }
+            words = HostSPIDMATransfer(SPISlave);
+            if (flash_selected)
+            {
+                SPIFlashModelDeselect();
+            }
+            if ((words > 0) && _DMA1IE)
+            {
+                _DMA1Interrupt();
+            }
+        }
+        else if (now == next_ADC_block)
+        {
+            next_ADC_block += ADC_BLOCK_TIME;
+            if ((HostADCDMABlock(SenseConversion) > 0) && _DMA2IE)
+            {
+                _DMA2Interrupt();
+            }
+        }
+        else if (now == next_ECU)
+        {
+            next_ECU += ECU_PERIOD;
+            ECUMessage();
+        }
+        else
+        {
+            next_instruments += INSTRUMENTS_PERIOD;
+            InstrumentsMessage();
+        }
+        break;
+    }
+    TMR4 = (now - last_tick) / TIMER_COUNT_TIME;
+}
+
+
+/* runs the firmware from reset until the power goes or the scenario ends.
+ * Returns true if the scenario has ended */
+static bool RunFirmware(void)
+{
+    int reason;
+    ++boots;
+    LATA = 0;
+    LATB = 0;
+    LATC = 0;
+    T4CONbits.TON = 0;
+    TMR4 = 0;
+    next_tick = NEVER;
+    spi_start = NEVER;
+    spi_end = NEVER;
+    next_ADC_block = NEVER;
+    DMACS1 = 0;
+    running = true;
+    reason = setjmp(stop);
+    if (reason == 0)
+    {
+        FirmwareMain();
+    }
+    running = false;
+    MC06XSD200ModelWake(false);
+    Sample();
+    return reason == FINISHED;
+}
+
+
+/* advances to the next scenario step with the CPU unpowered.
+ * Returns true if the scenario has ended */
+static bool PoweredDown(void)
+{
+    now = steps[next_step].time;
+    if (Step(&steps[next_step++]))
+    {
+        return true;
+    }
+    Sample();
+    return false;
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *scenario = NULL;
+    struct timespec start, end;
+    double wall_time;
+    bool finished = false;
+    int i;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "-t") == 0) && (i + 1 < argc))
+        {
+            trace_file = fopen(argv[++i], "w");
+            if (trace_file == NULL)
+            {
+                perror(argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        {
+            scenario = argv[i];
+        }
+    }
+    if (scenario == NULL)
+    {
+        fprintf(stderr, "usage: %s [-t trace_file] scenario_file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    LoadScenario(scenario);
+
+    HostFlashErase();
+    MC06XSD200ModelReset();
+    SPIFlashModelErase();
+    host_idle_hook = SimulatorIdle;
+    next_ECU = NEVER;
+    next_instruments = NEVER;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!finished)
+    {
+        finished = Powered()?RunFirmware():PoweredDown();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    wall_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%s: %.1f simulated hours in %.2f seconds, %u boots\n", scenario,
+        (double)now / NS_PER_S / 3600, wall_time, boots);
+    printf("  last boot: power on %lus, alarm simulation %lus, power off %lus, switch chip on latency %.2fms\n",
+        (unsigned long)EnergyStateTime(ACCOUNT_POWER_ON), (unsigned long)EnergyStateTime(ACCOUNT_ALARM_SIMULATION),
+        (unsigned long)EnergyStateTime(ACCOUNT_POWER_OFF), (double)SwitchChipOnLatency() * TIMER_COUNT_TIME / NS_PER_MS);
+    printf("  last boot average current: power on %uuA, alarm simulation %uuA, power off %uuA\n",
+        EnergyAverageCurrent(ACCOUNT_POWER_ON), EnergyAverageCurrent(ACCOUNT_ALARM_SIMULATION),
+        EnergyAverageCurrent(ACCOUNT_POWER_OFF));
+    if (EnergyStateTime(ACCOUNT_ALARM_SIMULATION) > 0)
+    {
+        // the parked day estimate needs the alarm simulation current
+        printf("  parked day (%u minutes alarm simulation) %luuAh\n", ALARM_SIMULATION_TIME,
+            (unsigned long)EnergyParkedChargePerDay(ALARM_SIMULATION_TIME));
+    }
+    printf("  journal sequence %u\n", JournalSequence());
+    printf("  switch chip SPI words %lu, parity errors %lu, flash page erases %lu\n",
+        (unsigned long)MC06XSD200ModelWords(), (unsigned long)MC06XSD200ModelParityErrors(),
+        (unsigned long)host_statistics.page_erases);
+    printf("  SPI clock %.0fkHz (switch chip), last transaction %u words in %.1fus\n",
+        (double)FCY / SPIClockDivider(SPI_CS0) / 1000, spi_transaction_words, (double)spi_transaction_time / 1000);
+    if (SPIFlashModelFitted())
+    {
+        logger_statistics_t statistics;
+        LoggerStatistics(&statistics);
+        printf("  SPI flash log records %lu, page programs %lu, sector erases %lu\n", (unsigned long)LogRecords(),
+            (unsigned long)SPIFlashModelPrograms(), (unsigned long)SPIFlashModelErases());
+        printf("  last boot: logged %lu, dropped %lu, page buffer to flash latency max %.0fms\n",
+            (unsigned long)statistics.records, (unsigned long)statistics.dropped,
+            (double)statistics.maximum_latency * TIMER_PERIOD);
+    }
+    printf("  %u expectations, %u failed\n", expectations, failures);
+    if (trace_file != NULL)
+    {
+        fclose(trace_file);
+    }
+    return (failures == 0)?EXIT_SUCCESS:EXIT_FAILURE;
+}
@@ -0,0 +1,407 @@
+/*
+ * File:   stress.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Randomised power failure stress test of the EEPROM emulation.
+ * Built and run by the host build (make -C host stress).
+ *
+ * Usage: stress [-c cycles] [-s seed] [-f flash_file]
+ *
+ * Each cycle boots the emulation (InitializeEEPROM), checks every address against what has been
+ * written, and then makes random writes (DataEEWrite, DataEEWriteAsync, DataEEBegin/Stage/Commit),
+ * timer ticks (EEPROMTasks) and flushes until a power failure cuts it short. The power failure is
+ * scheduled at a random NVM operation of the cycle with a random number of the words of that
+ * operation done. Some cycles end with a clean reset instead.
+ *
+ * A value is committed once the emulation holds it in flash - the address isn't pending and there's
+ * no pack in progress that hasn't committed. After a boot each address must read a committed
+ * value or one written since - never an older one or one that wasn't written. The last group written
+ * must read all or none of its values if none of them have been written since.
+ *
+ * Every boot must be bounded: no flash stall at all (stale pages are erased in the background) and no
+ * more than BOOT_TABLE_READS_MAXIMUM table reads - the page headers and one page scan. The erase counts the
+ * emulation has kept must never be more than the erases made.
+ *
+ * The flash stall of each call is recorded and the distributions reported at the end along with the
+ * page erase counts. The flash can be mapped onto a file (-f) to look at it afterwards - it's erased at the start.
+ *
+ * The EEPROM source is included directly so that the test can see whether a value is committed.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "xc.h"
+#define DATA_EE_SIZE 16
+#include "../EEPROM.c"
+
+
+#define DEFAULT_CYCLES 1000000UL
+#define MAXIMUM_OPERATIONS 400 // random calls per cycle before a clean reset
+#define MAXIMUM_NVM_OPERATIONS 80 // power fails at up to this many NVM operations into a cycle
+#define CLEAN_RESET_PERCENT 5
+
+// four reads of each page header, two of each erase count and at most four reads of each location of the
+// active page (its own two and the two of a commit record when it's a group record)
+#define BOOT_TABLE_READS_MAXIMUM ((NUM_DATA_EE_PAGES * 6) + ((NUMBER_OF_INSTRUCTIONS_IN_PAGE - HEADER_LOCATIONS) * 4))
+
+
+// calls whose flash stall is recorded
+typedef enum {CALL_INITIALIZE=0, CALL_WRITE, CALL_WRITE_ASYNC, CALL_COMMIT, CALL_TASKS, CALL_FLUSH,
+    NUMBER_OF_CALLS} call_t;
+static const char *const CALL_NAMES[NUMBER_OF_CALLS] =
+    {"InitializeEEPROM", "DataEEWrite", "DataEEWriteAsync", "DataEECommit", "EEPROMTasks", "DataEEFlush"};
+
+// stall histograms in 1us bins with the last for anything longer
+#define HISTOGRAM_BINS 200001
+static uint32_t histograms[NUMBER_OF_CALLS][HISTOGRAM_BINS];
+static uint64_t stall_totals[NUMBER_OF_CALLS];
+
+
+// Every write to an address is given the next sequence number for the address which determines
+// the value written - so each value identifies the write. Sequence 0 is the unwritten value.
+static uint32_t latest[DATA_EE_SIZE];       // last written
+static uint32_t committed[DATA_EE_SIZE];    // last known to be in flash
+
+// the last group written
+static uint8_t group_count;
+static uint8_t group_addrs[DATA_EE_SIZE];
+static uint32_t group_sequences[DATA_EE_SIZE];
+
+static jmp_buf power_fail;
+static uint32_t failures;
+static uint32_t boot_reads_maximum;
+
+
+static uint16_t Value(const uint32_t sequence)
+{
+    return (sequence == 0)?ERASED_WORD_VALUE:(uint16_t)(sequence % ERASED_WORD_VALUE);
+}
+
+
+static uint32_t Random(const uint32_t range)
+{
+    return (uint32_t)(((uint64_t)rand() * range) / ((uint64_t)RAND_MAX + 1));
+}
+
+
+static void PowerFail(void)
+{
+    longjmp(power_fail, 1);
+}
+
+
+// records the flash stall of a call made since the stall was at start
+static void Stall(const call_t call, const uint64_t start)
+{
+    uint64_t stall = host_statistics.flash_stall - start;
+    ++histograms[call][(stall < (HISTOGRAM_BINS - 1))?stall:(HISTOGRAM_BINS - 1)];
+    stall_totals[call] += stall;
+}
+
+
+// checks that a boot was bounded
+static void Boot(const uint32_t cycle, const uint64_t start, const uint32_t reads_start)
+{
+    uint32_t reads = host_statistics.table_reads - reads_start;
+    uint64_t stall = host_statistics.flash_stall - start;
+
+    if ((stall != 0) || (reads > BOOT_TABLE_READS_MAXIMUM))
+    {
+        printf("cycle %lu: boot stalled for %lu us with %lu table reads\n", (unsigned long)cycle,
+            (unsigned long)stall, (unsigned long)reads);
+        ++failures;
+    }
+    boot_reads_maximum = (reads > boot_reads_maximum)?reads:boot_reads_maximum;
+}
+
+
+// the latest values that the emulation has in flash are committed - a write cut short by a power
+// failure never gets to the cache
+static void Committed(void)
+{
+    uint8_t addr;
+    if (!packing || (activePage == packedPage))
+    {
+        for (addr = 0; addr < DATA_EE_SIZE; ++addr)
+        {
+            if (!pending[addr] && (values[addr] == Value(latest[addr])))
+            {
+                committed[addr] = latest[addr];
+            }
+        }
+    }
+}
+
+
+// checks the values after a boot and takes them as committed
+static void Check(const uint32_t cycle)
+{
+    uint8_t addr;
+    uint8_t i;
+    uint8_t found = 0;
+    uint16_t value;
+    uint32_t sequence;
+    uint8_t page;
+    bool group_unchanged = (group_count > 0);
+
+    for (i = 0; i < group_count; ++i)
+    {
+        group_unchanged = group_unchanged && (latest[group_addrs[i]] == group_sequences[i]);
+    }
+    for (addr = 0; addr < DATA_EE_SIZE; ++addr)
+    {
+        value = DataEERead(addr);
+        for (sequence = committed[addr]; (sequence <= latest[addr]) && (Value(sequence) != value); ++sequence);
+        if (sequence > latest[addr])
+        {
+            printf("cycle %lu: address %u reads 0x%04X - committed 0x%04X, latest 0x%04X\n", (unsigned long)cycle,
+                addr, value, Value(committed[addr]), Value(latest[addr]));
+            ++failures;
+        }
+        else
+        {
+            committed[addr] = sequence;
+        }
+    }
+    if (group_unchanged)
+    {
+        for (i = 0; i < group_count; ++i)
+        {
+            found += (committed[group_addrs[i]] == group_sequences[i]);
+        }
+        if ((found != 0) && (found != group_count))
+        {
+            printf("cycle %lu: %u of a group of %u values read back\n", (unsigned long)cycle, found, group_count);
+            ++failures;
+        }
+    }
+    group_count = 0;
+
+    for (page = 0; page < NUM_DATA_EE_PAGES; ++page)
+    {
+        if (eraseCounts[page] > HostFlashEraseCount(__builtin_tbladdress(&emulationPages) + (DEE_PAGE_SIZE * page)))
+        {
+            printf("cycle %lu: page %u erase count %u is more than its erases\n", (unsigned long)cycle, page,
+                eraseCounts[page]);
+            ++failures;
+        }
+    }
+}
+
+
+static void Write(void)
+{
+    uint8_t addr = Random(DATA_EE_SIZE);
+    uint64_t start = host_statistics.flash_stall;
+    DataEEWrite(Value(++latest[addr]), addr);
+    Stall(CALL_WRITE, start);
+}
+
+
+static void WriteAsync(void)
+{
+    uint8_t addr = Random(DATA_EE_SIZE);
+    uint64_t start = host_statistics.flash_stall;
+    DataEEWriteAsync(Value(++latest[addr]), addr);
+    Stall(CALL_WRITE_ASYNC, start);
+}
+
+
+static void Group(void)
+{
+    uint8_t count = 1 + Random(DATA_EE_SIZE);
+    uint8_t addr;
+    uint64_t start;
+
+    // each address at most once so that every one staged changes
+    group_count = 0;
+    DataEEBegin();
+    for (addr = 0; addr < DATA_EE_SIZE; ++addr)
+    {
+        if (Random(DATA_EE_SIZE) < count)
+        {
+            group_addrs[group_count] = addr;
+            group_sequences[group_count] = ++latest[addr];
+            DataEEStage(Value(latest[addr]), addr);
+            ++group_count;
+        }
+    }
+    start = host_statistics.flash_stall;
+    DataEECommit();
+    Stall(CALL_COMMIT, start);
+}
+
+
+static void Tick(void)
+{
+    uint64_t start = host_statistics.flash_stall;
+    FlashTasks();
+    EEPROMTasks();
+    Stall(CALL_TASKS, start);
+}
+
+
+static void Flush(void)
+{
+    uint64_t start = host_statistics.flash_stall;
+    DataEEFlush();
+    Stall(CALL_FLUSH, start);
+}
+
+
+// runs a cycle from boot until the power fails or it's reset
+static void Cycle(const uint32_t cycle)
+{
+    volatile uint16_t operations;
+    uint32_t choice;
+    uint64_t start;
+    uint32_t reads;
+
+    if (Random(100) >= CLEAN_RESET_PERCENT)
+    {
+        HostFlashPowerFail(1 + Random(MAXIMUM_NVM_OPERATIONS), Random(NUMBER_OF_INSTRUCTIONS_IN_PAGE + 1));
+    }
+    if (setjmp(power_fail) == 0)
+    {
+        start = host_statistics.flash_stall;
+        reads = host_statistics.table_reads;
+        InitializeEEPROM();
+        Stall(CALL_INITIALIZE, start);
+        Boot(cycle, start, reads);
+        Check(cycle);
+        Committed();
+        for (operations = 0; operations < MAXIMUM_OPERATIONS; ++operations)
+        {
+            choice = Random(100);
+            if (choice < 30)
+            {
+                Write();
+            }
+            else if (choice < 50)
+            {
+                WriteAsync();
+            }
+            else if (choice < 60)
+            {
+                Group();
+            }
+            else if (choice < 97)
+            {
+                Tick();
+            }
+            else
+            {
+                Flush();
+            }
+            Committed();
+        }
+    }
+    HostFlashPowerFail(0, 0);
+}
+
+
+static uint32_t Percentile(const uint32_t *const histogram, const uint32_t count, const double fraction)
+{
+    uint32_t bin;
+    uint64_t total = 0;
+    for (bin = 0; bin < HISTOGRAM_BINS; ++bin)
+    {
+        total += histogram[bin];
+        if (total >= (fraction * count))
+        {
+            break;
+        }
+    }
+    return bin;
+}
+
+
+int main(int argc, char *argv[])
+{
+    uint32_t cycles = DEFAULT_CYCLES;
+    uint32_t seed = 1;
+    const char *flash_file = NULL;
+    uint32_t cycle;
+    uint32_t count;
+    uint32_t bin;
+    uint32_t maximum;
+    uint16_t call;
+    uint16_t page;
+    EEPROM_wear_t wear;
+    int i;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "-c") == 0) && (i + 1 < argc))
+        {
+            cycles = strtoul(argv[++i], NULL, 0);
+        }
+        else if ((strcmp(argv[i], "-s") == 0) && (i + 1 < argc))
+        {
+            seed = strtoul(argv[++i], NULL, 0);
+        }
+        else if ((strcmp(argv[i], "-f") == 0) && (i + 1 < argc))
+        {
+            flash_file = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-c cycles] [-s seed] [-f flash_file]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ((flash_file != NULL) && !HostFlashMap(flash_file))
+    {
+        perror(flash_file);
+        return EXIT_FAILURE;
+    }
+    HostFlashErase();
+    srand(seed);
+    host_power_fail_hook = PowerFail;
+    for (cycle = 0; cycle < cycles; ++cycle)
+    {
+        Cycle(cycle);
+    }
+    // a last boot to check the last cycle
+    InitializeEEPROM();
+    Check(cycle);
+
+    printf("%lu cycles (seed %lu), %lu failures\n", (unsigned long)cycles, (unsigned long)seed,
+        (unsigned long)failures);
+    printf("%-18s %10s %10s %10s %10s %10s %10s\n", "flash stall (us)", "calls", "mean", "median",
+        "99%", "99.9%", "maximum");
+    for (call = 0; call < NUMBER_OF_CALLS; ++call)
+    {
+        count = 0;
+        maximum = 0;
+        for (bin = 0; bin < HISTOGRAM_BINS; ++bin)
+        {
+            count += histograms[call][bin];
+            maximum = (histograms[call][bin] > 0)?bin:maximum;
+        }
+        printf("%-18s %10lu %10.1f %10lu %10lu %10lu %10lu\n", CALL_NAMES[call], (unsigned long)count,
+            (count > 0)?((double)stall_totals[call] / count):0.0,
+            (unsigned long)Percentile(histograms[call], count, 0.5),
+            (unsigned long)Percentile(histograms[call], count, 0.99),
+            (unsigned long)Percentile(histograms[call], count, 0.999), (unsigned long)maximum);
+    }
+    printf("boot table reads: maximum %lu, bound %lu\n", (unsigned long)boot_reads_maximum,
+        (unsigned long)BOOT_TABLE_READS_MAXIMUM);
+    DataEEWear(&wear);
+    printf("wear: minimum %u, maximum %u, mean %u erases - %u erases, %lu packs and %lu writes remaining\n",
+        wear.minimum_erases, wear.maximum_erases, wear.mean_erases, wear.remaining_erases,
+        (unsigned long)wear.remaining_packs, (unsigned long)wear.remaining_writes);
+    printf("page erases:");
+    for (page = 0; page < NUM_DATA_EE_PAGES; ++page)
+    {
+        printf(" %lu", (unsigned long)HostFlashEraseCount(__builtin_tbladdress(&emulationPages) + (DEE_PAGE_SIZE * page)));
+    }
+    printf("\n");
+    return (failures == 0)?EXIT_SUCCESS:EXIT_FAILURE;
+}
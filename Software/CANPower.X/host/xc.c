@@ -0,0 +1,475 @@
+/*
+ * File:   xc.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Host (workstation) implementation of the simulated register file and the
+ * XC16 builtins declared in host/xc.h.
+ *
+ * Program memory is emulated as an array of 24 bit instruction words the size of the
+ * eeprom_emulation and journal regions of the linker script. Each object passed to __builtin_tbladdress
+ * is allocated its own page aligned part of the region in the order that they are first seen.
+ * Erase sets a page to all ones, programming can only clear bits. Row programming takes
+ * the write latches for the row, word programming takes the latch last written.
+ * The array can be mapped onto a file (HostFlashMap) so that its contents outlast the process.
+ * Each NVM operation adds its datasheet time to the stall total and each page erase is counted.
+ * A power failure can be scheduled at any NVM operation - only the words of it up to the failure
+ * are done before the power fail hook is invoked.
+ *
+ * Objects passed to __builtin_dmaoffset are given offsets in the order that they are first seen
+ * so that a simulation can find them again (HostDMAAddress) to play the part of the DMA controller.
+ *
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "xc.h"
+
+
+// *****************************************************************************
+// register file
+volatile OSCCON_t OSCCON_sfr;
+volatile CLKDIV_t CLKDIV_sfr;
+volatile uint16_t PLLFBD;
+volatile host_interrupts_t host_interrupts;
+volatile uint16_t DISICNT;
+volatile T2CON_t T2CON_sfr;
+volatile T3CON_t T3CON_sfr;
+volatile T4CON_t T4CON_sfr;
+volatile T5CON_t T5CON_sfr;
+volatile uint16_t TMR2, TMR3, TMR4, TMR5, PR2, PR3, PR4, PR5;
+volatile OC1CON_t OC1CON_sfr;
+volatile OC2CON_t OC2CON_sfr;
+volatile OC3CON_t OC3CON_sfr;
+volatile OC4CON_t OC4CON_sfr;
+volatile uint16_t OC1R, OC1RS, OC2R, OC2RS, OC3R, OC3RS, OC4R, OC4RS;
+volatile SPI1STAT_t SPI1STAT_sfr;
+volatile SPI1CON1_t SPI1CON1_sfr;
+volatile SPI1CON2_t SPI1CON2_sfr;
+volatile uint16_t SPI1BUF;
+volatile LATA_t LATA_sfr;
+volatile LATB_t LATB_sfr;
+volatile LATC_t LATC_sfr;
+volatile PORTA_t PORTA_sfr;
+volatile PORTB_t PORTB_sfr;
+volatile PORTC_t PORTC_sfr;
+volatile uint16_t TRISA, TRISB, TRISC, ODCA, ODCB, ODCC;
+volatile uint16_t _SDI1R, _C1RXR;
+volatile uint16_t _RP9R, _RP11R, _RP12R, _RP13R, _RP15R, _RP19R, _RP20R, _RP22R;
+volatile C1CTRL1_t C1CTRL1_sfr;
+volatile C1CFG1_t C1CFG1_sfr;
+volatile C1CFG2_t C1CFG2_sfr;
+volatile C1FCTRL_t C1FCTRL_sfr;
+volatile uint16_t _TXEN0, _TXEN1, _TXEN2, _TXEN3, _TXEN4, _TXEN5, _TXEN6, _TXEN7;
+volatile C1RXM0SID_t C1RXM0SID_sfr;
+volatile C1RXF0SID_t C1RXF0SID_sfr;
+volatile C1RXF1SID_t C1RXF1SID_sfr;
+volatile C1RXF2SID_t C1RXF2SID_sfr;
+volatile C1RXF3SID_t C1RXF3SID_sfr;
+volatile C1RXF4SID_t C1RXF4SID_sfr;
+volatile C1RXF5SID_t C1RXF5SID_sfr;
+volatile C1RXF6SID_t C1RXF6SID_sfr;
+volatile C1RXF7SID_t C1RXF7SID_sfr;
+volatile C1RXF8SID_t C1RXF8SID_sfr;
+volatile C1RXF9SID_t C1RXF9SID_sfr;
+volatile C1RXF10SID_t C1RXF10SID_sfr;
+volatile C1RXF11SID_t C1RXF11SID_sfr;
+volatile C1RXF12SID_t C1RXF12SID_sfr;
+volatile C1RXF13SID_t C1RXF13SID_sfr;
+volatile C1RXF14SID_t C1RXF14SID_sfr;
+volatile C1RXF15SID_t C1RXF15SID_sfr;
+volatile uint16_t C1FMSKSEL1, C1FMSKSEL2;
+volatile uint16_t _F0BP, _F1BP, _F2BP, _F3BP, _F4BP, _F5BP, _F6BP, _F7BP,
+    _F8BP, _F9BP, _F10BP, _F11BP, _F12BP, _F13BP, _F14BP, _F15BP;
+volatile uint16_t _FLTEN0, _FLTEN1, _FLTEN2, _FLTEN3, _FLTEN4, _FLTEN5, _FLTEN6, _FLTEN7,
+    _FLTEN8, _FLTEN9, _FLTEN10, _FLTEN11, _FLTEN12, _FLTEN13, _FLTEN14, _FLTEN15;
+volatile uint16_t C1RXFUL1, C1RXD;
+volatile uint16_t _ICODE, _RBIF, _RBIE;
+volatile uint16_t DMACS0;
+volatile DMACS1_t DMACS1_sfr;
+volatile DMA0CON_t DMA0CON_sfr;
+volatile DMA1CON_t DMA1CON_sfr;
+volatile DMA2CON_t DMA2CON_sfr;
+volatile DMA3CON_t DMA3CON_sfr;
+volatile uint16_t DMA0REQ, DMA0STA, DMA0STB, DMA0PAD, DMA0CNT;
+volatile uint16_t DMA1REQ, DMA1STA, DMA1STB, DMA1PAD, DMA1CNT;
+volatile uint16_t DMA2REQ, DMA2STA, DMA2STB, DMA2PAD, DMA2CNT;
+volatile uint16_t DMA3REQ, DMA3STA, DMA3STB, DMA3PAD, DMA3CNT;
+volatile AD1CON1_t AD1CON1_sfr;
+volatile AD1CON2_t AD1CON2_sfr;
+volatile AD1CON3_t AD1CON3_sfr;
+volatile AD1CON4_t AD1CON4_sfr;
+volatile AD1CHS0_t AD1CHS0_sfr;
+volatile uint16_t AD1PCFGL, AD1CSSL, ADC1BUF0;
+volatile uint16_t NVMCON, NVMKEY, TBLPAG;
+
+
+host_statistics_t host_statistics;
+static void NoHook(void) {}
+static void NoNVMHook(const uint16_t nvmcon) {(void)nvmcon;}
+void (*host_idle_hook)(void) = NoHook;
+void (*host_nvm_hook)(const uint16_t nvmcon) = NoNVMHook;
+void (*host_power_fail_hook)(void) = NoHook;
+
+
+// *****************************************************************************
+// oscillator - clock switches and locks immediately
+void __builtin_write_OSCCONH(const uint8_t value)
+{
+    OSCCON_sfr.word = (OSCCON_sfr.word & 0x00FF) | ((uint16_t)value << 8);
+}
+
+void __builtin_write_OSCCONL(const uint8_t value)
+{
+    OSCCON_sfr.word = (OSCCON_sfr.word & 0xFF00) | value;
+    if (OSCCONbits.OSWEN)
+    {
+        OSCCONbits.COSC = OSCCONbits.NOSC;
+        OSCCONbits.OSWEN = 0;
+        OSCCONbits.LOCK = 1;
+    }
+}
+
+
+void __builtin_disi(const uint16_t cycles)
+{
+    DISICNT = cycles;
+}
+
+
+void Idle(void)
+{
+    ++host_statistics.idles;
+    host_idle_hook();
+}
+
+
+void Sleep(void)
+{
+    Idle();
+}
+
+
+// *****************************************************************************
+// program memory
+
+#define INSTRUCTIONS_IN_ROW 64
+#define INSTRUCTIONS_IN_PAGE 512
+#define ERASE 0x4042
+#define PROGRAM_ROW 0x4001
+#define PROGRAM_WORD 0x4003
+#define ERASED_INSTRUCTION 0xFFFFFFUL
+
+#define FLASH_INSTRUCTIONS (HOST_FLASH_LENGTH / 2)
+#define FLASH_PAGES (FLASH_INSTRUCTIONS / INSTRUCTIONS_IN_PAGE)
+
+// flash instruction words - one per two program memory addresses - in memory unless mapped onto a file
+static uint32_t flash_memory[FLASH_INSTRUCTIONS];
+static uint32_t *flash = flash_memory;
+
+// erases of each page
+static uint32_t erase_counts[FLASH_PAGES];
+
+// scheduled power failure - the number of NVM operations to go (zero for none) and the words done of that one
+static uint32_t power_fail_countdown;
+static uint16_t power_fail_words;
+
+// write latches and the address that each was last written to
+static uint32_t latches[INSTRUCTIONS_IN_ROW];
+static uint32_t latch_address;
+
+// objects allocated to the flash region by __builtin_tbladdress
+#define MAXIMUM_OBJECTS 8
+static struct {const void *object; uint32_t address;} objects[MAXIMUM_OBJECTS];
+static uint32_t next_object_address = HOST_FLASH_ORIGIN;
+
+
+static uint32_t Address(const uint16_t offset)
+{
+    return (((uint32_t)TBLPAG << 16) | offset) & ~1UL;
+}
+
+static uint32_t* Instruction(const uint32_t address)
+{
+    static uint32_t unimplemented;
+    if ((address >= HOST_FLASH_ORIGIN) && (address < (HOST_FLASH_ORIGIN + HOST_FLASH_LENGTH)))
+    {
+        return &flash[(address - HOST_FLASH_ORIGIN) / 2];
+    }
+    unimplemented = 0;
+    return &unimplemented;
+}
+
+
+uint32_t HostTblAddress(const void *const object, const uint32_t size)
+{
+    uint16_t i;
+    for (i = 0; (i < MAXIMUM_OBJECTS) && (objects[i].object != NULL); ++i)
+    {
+        if (objects[i].object == object)
+        {
+            return objects[i].address;
+        }
+    }
+    if (i < MAXIMUM_OBJECTS)
+    {
+        objects[i].object = object;
+        objects[i].address = next_object_address;
+        next_object_address += (size + (INSTRUCTIONS_IN_PAGE * 2) - 1) & ~((uint32_t)INSTRUCTIONS_IN_PAGE * 2 - 1);
+        return objects[i].address;
+    }
+    return 0;
+}
+
+
+uint16_t __builtin_tblrdl(const uint16_t offset)
+{
+    ++host_statistics.table_reads;
+    return *Instruction(Address(offset)) & 0xFFFF;
+}
+
+
+uint8_t __builtin_tblrdh(const uint16_t offset)
+{
+    ++host_statistics.table_reads;
+    return (*Instruction(Address(offset)) >> 16) & 0xFF;
+}
+
+
+void __builtin_tblwtl(const uint16_t offset, const uint16_t data)
+{
+    ++host_statistics.table_writes;
+    latch_address = Address(offset);
+    uint32_t *latch = &latches[(latch_address / 2) % INSTRUCTIONS_IN_ROW];
+    *latch = (*latch & 0xFF0000UL) | data;
+}
+
+
+void __builtin_tblwth(const uint16_t offset, const uint8_t data)
+{
+    ++host_statistics.table_writes;
+    latch_address = Address(offset);
+    uint32_t *latch = &latches[(latch_address / 2) % INSTRUCTIONS_IN_ROW];
+    *latch = (*latch & 0x00FFFFUL) | ((uint32_t)data << 16);
+}
+
+
+void __builtin_write_NVM(void)
+{
+    uint32_t address;
+    uint16_t i;
+    uint16_t words = UINT16_MAX; // words of the operation that get done
+    bool power_fail = false;
+
+    if ((power_fail_countdown > 0) && (--power_fail_countdown == 0))
+    {
+        power_fail = true;
+        words = power_fail_words;
+    }
+    switch (NVMCON)
+    {
+        case ERASE:
+            ++host_statistics.page_erases;
+            host_statistics.flash_stall += HOST_PAGE_ERASE_TIME;
+            address = latch_address & ~((uint32_t)INSTRUCTIONS_IN_PAGE * 2 - 1);
+            if (address >= HOST_FLASH_ORIGIN)
+            {
+                ++erase_counts[((address - HOST_FLASH_ORIGIN) / 2) / INSTRUCTIONS_IN_PAGE];
+            }
+            for (i = 0; (i < INSTRUCTIONS_IN_PAGE) && (i < words); ++i)
+            {
+                *Instruction(address + (i * 2)) = ERASED_INSTRUCTION;
+            }
+            break;
+        case PROGRAM_ROW:
+            ++host_statistics.row_programs;
+            host_statistics.flash_stall += HOST_ROW_PROGRAM_TIME;
+            address = latch_address & ~((uint32_t)INSTRUCTIONS_IN_ROW * 2 - 1);
+            for (i = 0; (i < INSTRUCTIONS_IN_ROW) && (i < words); ++i)
+            {
+                *Instruction(address + (i * 2)) &= latches[i];
+            }
+            break;
+        case PROGRAM_WORD:
+            ++host_statistics.word_programs;
+            host_statistics.flash_stall += HOST_WORD_PROGRAM_TIME;
+            if (words > 0)
+            {
+                *Instruction(latch_address) &= latches[(latch_address / 2) % INSTRUCTIONS_IN_ROW];
+            }
+            break;
+        default:
+            break;
+    }
+    for (i = 0; i < INSTRUCTIONS_IN_ROW; ++i)
+    {
+        latches[i] = ERASED_INSTRUCTION;
+    }
+    if (power_fail)
+    {
+        host_power_fail_hook();
+    }
+    host_nvm_hook(NVMCON);
+}
+
+
+void HostFlashErase(void)
+{
+    uint32_t i;
+    for (i = 0; i < FLASH_INSTRUCTIONS; ++i)
+    {
+        flash[i] = ERASED_INSTRUCTION;
+    }
+    for (i = 0; i < INSTRUCTIONS_IN_ROW; ++i)
+    {
+        latches[i] = ERASED_INSTRUCTION;
+    }
+    for (i = 0; i < FLASH_PAGES; ++i)
+    {
+        erase_counts[i] = 0;
+    }
+}
+
+
+bool HostFlashMap(const char *const path)
+{
+    struct stat status;
+    void *mapped;
+    uint32_t i;
+    bool created;
+    int file = open(path, O_RDWR | O_CREAT, 0644);
+
+    if (file < 0)
+    {
+        return false;
+    }
+    created = (fstat(file, &status) == 0) && (status.st_size < (off_t)sizeof(flash_memory));
+    if (created && (ftruncate(file, sizeof(flash_memory)) != 0))
+    {
+        close(file);
+        return false;
+    }
+    mapped = mmap(NULL, sizeof(flash_memory), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    close(file);
+    if (mapped == MAP_FAILED)
+    {
+        return false;
+    }
+    flash = mapped;
+    if (created)
+    {
+        for (i = 0; i < FLASH_INSTRUCTIONS; ++i)
+        {
+            flash[i] = ERASED_INSTRUCTION;
+        }
+    }
+    return true;
+}
+
+
+uint32_t HostFlashEraseCount(const uint32_t address)
+{
+    return ((address >= HOST_FLASH_ORIGIN) && (address < (HOST_FLASH_ORIGIN + HOST_FLASH_LENGTH)))
+        ? erase_counts[((address - HOST_FLASH_ORIGIN) / 2) / INSTRUCTIONS_IN_PAGE] : 0;
+}
+
+
+void HostFlashPowerFail(const uint32_t operation, const uint16_t words)
+{
+    power_fail_countdown = operation;
+    power_fail_words = words;
+}
+
+
+uint32_t HostFlashRead(const uint32_t address)
+{
+    return *Instruction(address & ~1UL);
+}
+
+
+// *****************************************************************************
+// DMA RAM - objects are given offsets in the order that they are first seen
+
+#define MAXIMUM_DMA_OBJECTS 8
+#define DMA_OFFSET_STEP 0x100
+static volatile void *DMA_objects[MAXIMUM_DMA_OBJECTS];
+
+
+uint16_t HostDMAOffset(volatile void *const object)
+{
+    uint16_t i;
+    for (i = 0; (i < MAXIMUM_DMA_OBJECTS) && (DMA_objects[i] != NULL); ++i)
+    {
+        if (DMA_objects[i] == object)
+        {
+            return i * DMA_OFFSET_STEP;
+        }
+    }
+    if (i < MAXIMUM_DMA_OBJECTS)
+    {
+        DMA_objects[i] = object;
+        return i * DMA_OFFSET_STEP;
+    }
+    return 0;
+}
+
+
+volatile void* HostDMAAddress(const uint16_t offset)
+{
+    uint16_t i = offset / DMA_OFFSET_STEP;
+    return (i < MAXIMUM_DMA_OBJECTS)?DMA_objects[i]:NULL;
+}
+
+
+uint16_t HostSPIDMATransfer(uint16_t (*const slave)(const uint16_t word))
+{
+    volatile uint16_t *transmit = HostDMAAddress(DMA0STA);
+    volatile uint16_t *receive = HostDMAAddress(DMA1STA);
+    uint16_t i, words;
+    if ((transmit == NULL) || (receive == NULL) || !DMA0CONbits.CHEN || !DMA1CONbits.CHEN)
+    {
+        return 0;
+    }
+    words = DMA0CNT + 1;
+    for (i = 0; i < words; ++i)
+    {
+        SPI1BUF = transmit[i];
+        SPI1BUF = slave(SPI1BUF);
+        receive[i] = SPI1BUF;
+    }
+    DMA0CONbits.CHEN = 0;
+    DMA1CONbits.CHEN = 0;
+    _DMA1IF = 1;
+    return words;
+}
+
+
+uint16_t HostSPIClockDivider(void)
+{
+    static const uint16_t PRIMARY_PRESCALE[4] = {64, 16, 4, 1};
+    return PRIMARY_PRESCALE[_PPRE] * (8 - _SPRE);
+}
+
+
+uint16_t HostADCDMABlock(uint16_t (*const converter)(void))
+{
+    volatile uint16_t *buffer = HostDMAAddress(DMACS1bits.PPST2 ? DMA2STB : DMA2STA);
+    uint16_t i, conversions;
+    if ((buffer == NULL) || !AD1CON1bits.ADON || !DMA2CONbits.CHEN)
+    {
+        return 0;
+    }
+    conversions = DMA2CNT + 1;
+    for (i = 0; i < conversions; ++i)
+    {
+        ADC1BUF0 = converter();
+        buffer[i] = ADC1BUF0;
+    }
+    DMACS1bits.PPST2 ^= 1;
+    _DMA2IF = 1;
+    return conversions;
+}
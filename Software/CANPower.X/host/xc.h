@@ -0,0 +1,485 @@
+/*
+ * File:   xc.h
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Host (workstation) stand in for the XC16 device header.
+ * Only used by the host build (see host/Makefile) - never by the MPLAB project.
+ *
+ * Declares a simulated register file with the names, bit fields and bit aliases that
+ * the firmware modules use for the PIC24HJ128GP504 so that the module sources compile
+ * unchanged with the host compiler. Registers with bit fields are a union of the
+ * whole register and its bits so that both views stay consistent.
+ * A few bits that the hardware drives (clock switch complete, PLL lock, ECAN operating
+ * mode) are aliased to the bits that request them so that the initialisation
+ * busy-waits complete immediately.
+ *
+ * The XC16 builtins used by the firmware are implemented in host/xc.c. Program memory
+ * (table read/write and NVM) is emulated over a simulated flash array with erase to 0xFF,
+ * program only clearing bits, and a count of each kind of access for benchmarking. NVM operations
+ * are timed at the datasheet figures and a power failure can be injected at any of them.
+ *
+ */
+
+#ifndef HOST_XC_H
+#define	HOST_XC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+// XC16 attributes that mean nothing to the host compiler
+#define interrupt(x)
+#define near
+
+
+// Register with a word view and a named bits view
+#define HOST_SFR(name, fields) \
+    typedef union {uint16_t word; struct {fields} bits;} name##_t; \
+    extern volatile name##_t name##_sfr
+
+// Register with just a word view
+#define HOST_SFR_WORD(name) extern volatile uint16_t name
+
+
+// 16 single bit fields named after the port
+#define HOST_PORT_BITS(p) unsigned p##0:1; unsigned p##1:1; unsigned p##2:1; unsigned p##3:1; \
+    unsigned p##4:1; unsigned p##5:1; unsigned p##6:1; unsigned p##7:1; \
+    unsigned p##8:1; unsigned p##9:1; unsigned p##10:1; unsigned p##11:1; \
+    unsigned p##12:1; unsigned p##13:1; unsigned p##14:1; unsigned p##15:1;
+
+
+// *****************************************************************************
+// Oscillator
+HOST_SFR(OSCCON, unsigned OSWEN:1; unsigned LPOSCEN:1; unsigned :1; unsigned CF:1; unsigned :1; unsigned LOCK:1;
+    unsigned IOLOCK:1; unsigned CLKLOCK:1; unsigned NOSC:3; unsigned :1; unsigned COSC:3; unsigned :1;);
+#define OSCCON OSCCON_sfr.word
+#define OSCCONbits OSCCON_sfr.bits
+#define OSCCONL (OSCCON_sfr.word & 0x00FF)
+#define _OSCCON_IOLOCK_MASK 0x0040
+HOST_SFR(CLKDIV, unsigned PLLPRE:5; unsigned :1; unsigned PLLPOST:2; unsigned FRCDIV:3; unsigned DOZEN:1;
+    unsigned DOZE:3; unsigned ROI:1;);
+#define CLKDIV CLKDIV_sfr.word
+#define CLKDIVbits CLKDIV_sfr.bits
+#define _PLLPRE CLKDIVbits.PLLPRE
+#define _PLLPOST CLKDIVbits.PLLPOST
+#define _DOZEN CLKDIVbits.DOZEN
+#define _DOZE CLKDIVbits.DOZE
+HOST_SFR_WORD(PLLFBD);
+
+
+// *****************************************************************************
+// Interrupt controller - flags, enables and priorities of the sources in use
+typedef struct
+{
+    unsigned T4IF:1, T4IE:1, T4IP:3;
+    unsigned T5IF:1, T5IE:1, T5IP:3;
+    unsigned SPI1IF:1, SPI1IE:1, SPI1IP:3;
+    unsigned C1IF:1, C1IE:1, C1IP:3;
+    unsigned DMA0IF:1, DMA0IE:1, DMA0IP:3;
+    unsigned DMA1IF:1, DMA1IE:1, DMA1IP:3;
+    unsigned DMA2IF:1, DMA2IE:1, DMA2IP:3;
+    unsigned AD1IF:1, AD1IE:1, AD1IP:3;
+    unsigned OC4IF:1, OC4IE:1, OC4IP:3;
+} host_interrupts_t;
+extern volatile host_interrupts_t host_interrupts;
+#define _T4IF host_interrupts.T4IF
+#define _T4IE host_interrupts.T4IE
+#define _T4IP host_interrupts.T4IP
+#define _T5IF host_interrupts.T5IF
+#define _T5IE host_interrupts.T5IE
+#define _T5IP host_interrupts.T5IP
+#define _SPI1IF host_interrupts.SPI1IF
+#define _SPI1IE host_interrupts.SPI1IE
+#define _SPI1IP host_interrupts.SPI1IP
+#define _C1IF host_interrupts.C1IF
+#define _C1IE host_interrupts.C1IE
+#define _C1IP host_interrupts.C1IP
+#define _DMA0IF host_interrupts.DMA0IF
+#define _DMA0IE host_interrupts.DMA0IE
+#define _DMA0IP host_interrupts.DMA0IP
+#define _DMA1IF host_interrupts.DMA1IF
+#define _DMA1IE host_interrupts.DMA1IE
+#define _DMA1IP host_interrupts.DMA1IP
+#define _DMA2IF host_interrupts.DMA2IF
+#define _DMA2IE host_interrupts.DMA2IE
+#define _DMA2IP host_interrupts.DMA2IP
+#define _AD1IF host_interrupts.AD1IF
+#define _AD1IE host_interrupts.AD1IE
+#define _AD1IP host_interrupts.AD1IP
+#define _OC4IF host_interrupts.OC4IF
+#define _OC4IE host_interrupts.OC4IE
+#define _OC4IP host_interrupts.OC4IP
+HOST_SFR_WORD(DISICNT);
+
+
+// *****************************************************************************
+// Timers
+#define HOST_TIMER_FIELDS unsigned :1; unsigned TCS:1; unsigned TSYNC:1; unsigned T32:1; unsigned TCKPS:2; \
+    unsigned TGATE:1; unsigned :6; unsigned TSIDL:1; unsigned :1; unsigned TON:1;
+HOST_SFR(T2CON, HOST_TIMER_FIELDS);
+HOST_SFR(T3CON, HOST_TIMER_FIELDS);
+HOST_SFR(T4CON, HOST_TIMER_FIELDS);
+HOST_SFR(T5CON, HOST_TIMER_FIELDS);
+#define T2CON T2CON_sfr.word
+#define T2CONbits T2CON_sfr.bits
+#define T3CON T3CON_sfr.word
+#define T3CONbits T3CON_sfr.bits
+#define T4CON T4CON_sfr.word
+#define T4CONbits T4CON_sfr.bits
+#define T5CON T5CON_sfr.word
+#define T5CONbits T5CON_sfr.bits
+HOST_SFR_WORD(TMR2);
+HOST_SFR_WORD(TMR3);
+HOST_SFR_WORD(TMR4);
+HOST_SFR_WORD(TMR5);
+HOST_SFR_WORD(PR2);
+HOST_SFR_WORD(PR3);
+HOST_SFR_WORD(PR4);
+HOST_SFR_WORD(PR5);
+
+
+// *****************************************************************************
+// Output compares
+#define HOST_OC_FIELDS unsigned OCM:3; unsigned OCTSEL:1; unsigned OCFLT:1; unsigned :8; unsigned OCSIDL:1; unsigned :2;
+HOST_SFR(OC1CON, HOST_OC_FIELDS);
+HOST_SFR(OC2CON, HOST_OC_FIELDS);
+HOST_SFR(OC3CON, HOST_OC_FIELDS);
+HOST_SFR(OC4CON, HOST_OC_FIELDS);
+#define OC1CON OC1CON_sfr.word
+#define OC1CONbits OC1CON_sfr.bits
+#define OC2CON OC2CON_sfr.word
+#define OC2CONbits OC2CON_sfr.bits
+#define OC3CON OC3CON_sfr.word
+#define OC3CONbits OC3CON_sfr.bits
+#define OC4CON OC4CON_sfr.word
+#define OC4CONbits OC4CON_sfr.bits
+HOST_SFR_WORD(OC1R);
+HOST_SFR_WORD(OC1RS);
+HOST_SFR_WORD(OC2R);
+HOST_SFR_WORD(OC2RS);
+HOST_SFR_WORD(OC3R);
+HOST_SFR_WORD(OC3RS);
+HOST_SFR_WORD(OC4R);
+HOST_SFR_WORD(OC4RS);
+
+
+// *****************************************************************************
+// SPI 1
+HOST_SFR(SPI1STAT, unsigned SPIRBF:1; unsigned SPITBF:1; unsigned :4; unsigned SPIROV:1; unsigned :6;
+    unsigned SPISIDL:1; unsigned :1; unsigned SPIEN:1;);
+HOST_SFR(SPI1CON1, unsigned PPRE:2; unsigned SPRE:3; unsigned MSTEN:1; unsigned CKP:1; unsigned SSEN:1;
+    unsigned CKE:1; unsigned SMP:1; unsigned MODE16:1; unsigned DISSDO:1; unsigned DISSCK:1; unsigned :3;);
+HOST_SFR(SPI1CON2, unsigned :1; unsigned FRMDLY:1; unsigned :11; unsigned FRMPOL:1; unsigned SPIFSD:1; unsigned FRMEN:1;);
+#define SPI1STAT SPI1STAT_sfr.word
+#define SPI1STATbits SPI1STAT_sfr.bits
+#define SPI1CON1 SPI1CON1_sfr.word
+#define SPI1CON1bits SPI1CON1_sfr.bits
+#define SPI1CON2 SPI1CON2_sfr.word
+#define SPI1CON2bits SPI1CON2_sfr.bits
+#define _SPIRBF SPI1STATbits.SPIRBF
+#define _SPITBF SPI1STATbits.SPITBF
+#define _SPIROV SPI1STATbits.SPIROV
+#define _SPISIDL SPI1STATbits.SPISIDL
+#define _SPIEN SPI1STATbits.SPIEN
+#define _PPRE SPI1CON1bits.PPRE
+#define _SPRE SPI1CON1bits.SPRE
+#define _MSTEN SPI1CON1bits.MSTEN
+#define _CKP SPI1CON1bits.CKP
+#define _SSEN SPI1CON1bits.SSEN
+#define _CKE SPI1CON1bits.CKE
+#define _SMP SPI1CON1bits.SMP
+#define _DISSDO SPI1CON1bits.DISSDO
+#define _DISSCK SPI1CON1bits.DISSCK
+#define _FRMDLY SPI1CON2bits.FRMDLY
+#define _FRMPOL SPI1CON2bits.FRMPOL
+#define _SPIFSD SPI1CON2bits.SPIFSD
+#define _FRMEN SPI1CON2bits.FRMEN
+HOST_SFR_WORD(SPI1BUF);
+
+
+// *****************************************************************************
+// I/O ports
+HOST_SFR(LATA, HOST_PORT_BITS(LATA));
+HOST_SFR(LATB, HOST_PORT_BITS(LATB));
+HOST_SFR(LATC, HOST_PORT_BITS(LATC));
+HOST_SFR(PORTA, HOST_PORT_BITS(RA));
+HOST_SFR(PORTB, HOST_PORT_BITS(RB));
+HOST_SFR(PORTC, HOST_PORT_BITS(RC));
+#define LATA LATA_sfr.word
+#define LATB LATB_sfr.word
+#define LATC LATC_sfr.word
+#define PORTA PORTA_sfr.word
+#define PORTB PORTB_sfr.word
+#define PORTC PORTC_sfr.word
+#define _LATA7 LATA_sfr.bits.LATA7
+#define _LATA10 LATA_sfr.bits.LATA10
+#define _LATB10 LATB_sfr.bits.LATB10
+#define _LATB12 LATB_sfr.bits.LATB12
+#define _LATC3 LATC_sfr.bits.LATC3
+#define _LATC4 LATC_sfr.bits.LATC4
+#define _LATC5 LATC_sfr.bits.LATC5
+#define _LATC6 LATC_sfr.bits.LATC6
+#define _RA7 PORTA_sfr.bits.RA7
+#define _RB7 PORTB_sfr.bits.RB7
+#define _RB12 PORTB_sfr.bits.RB12
+#define _RB13 PORTB_sfr.bits.RB13
+HOST_SFR_WORD(TRISA);
+HOST_SFR_WORD(TRISB);
+HOST_SFR_WORD(TRISC);
+HOST_SFR_WORD(ODCA);
+HOST_SFR_WORD(ODCB);
+HOST_SFR_WORD(ODCC);
+
+
+// *****************************************************************************
+// Peripheral pin select
+extern volatile uint16_t _SDI1R, _C1RXR;
+extern volatile uint16_t _RP9R, _RP11R, _RP12R, _RP13R, _RP15R, _RP19R, _RP20R, _RP22R;
+#define _RPOUT_C1TX 16
+#define _RPOUT_SDO1 7
+#define _RPOUT_SCK1OUT 8
+#define _RPOUT_SS1OUT 9
+#define _RPOUT_OC1 18
+#define _RPOUT_OC2 19
+#define _RPOUT_OC3 20
+#define _RPOUT_OC4 21
+
+
+// *****************************************************************************
+// ECAN 1
+HOST_SFR(C1CTRL1, unsigned WIN:1; unsigned :2; unsigned CANCAP:1; unsigned :1; unsigned OPMODE:3;
+    unsigned REQOP:3; unsigned CANCKS:1; unsigned ABAT:1; unsigned CSIDL:1; unsigned :2;);
+#define C1CTRL1 C1CTRL1_sfr.word
+#define C1CTRL1bits C1CTRL1_sfr.bits
+#define _WIN C1CTRL1bits.WIN
+#define _CANCAP C1CTRL1bits.CANCAP
+#define _REQOP C1CTRL1bits.REQOP
+#define _OPMODE C1CTRL1bits.REQOP // mode changes take effect immediately
+HOST_SFR(C1CFG1, unsigned BRP:6; unsigned SJW:2; unsigned :8;);
+HOST_SFR(C1CFG2, unsigned PRSEG:3; unsigned SEG1PH:3; unsigned SAM:1; unsigned SEG2PHTS:1; unsigned SEG2PH:3;
+    unsigned :3; unsigned WAKFIL:1; unsigned :1;);
+HOST_SFR(C1FCTRL, unsigned FSA:5; unsigned :8; unsigned DMABS:3;);
+#define _BRP C1CFG1_sfr.bits.BRP
+#define _SJW C1CFG1_sfr.bits.SJW
+#define _PRSEG C1CFG2_sfr.bits.PRSEG
+#define _SEG1PH C1CFG2_sfr.bits.SEG1PH
+#define _SAM C1CFG2_sfr.bits.SAM
+#define _SEG2PHTS C1CFG2_sfr.bits.SEG2PHTS
+#define _SEG2PH C1CFG2_sfr.bits.SEG2PH
+#define _FSA C1FCTRL_sfr.bits.FSA
+#define _DMABS C1FCTRL_sfr.bits.DMABS
+extern volatile uint16_t _TXEN0, _TXEN1, _TXEN2, _TXEN3, _TXEN4, _TXEN5, _TXEN6, _TXEN7;
+#define HOST_CAN_SID_FIELDS unsigned :3; unsigned EXIDE:1; unsigned MIDE:1; unsigned SID:11;
+HOST_SFR(C1RXM0SID, HOST_CAN_SID_FIELDS);
+#define C1RXM0SIDbits C1RXM0SID_sfr.bits
+HOST_SFR(C1RXF0SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF1SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF2SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF3SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF4SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF5SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF6SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF7SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF8SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF9SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF10SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF11SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF12SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF13SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF14SID, HOST_CAN_SID_FIELDS);
+HOST_SFR(C1RXF15SID, HOST_CAN_SID_FIELDS);
+#define C1RXF0SIDbits C1RXF0SID_sfr.bits
+#define C1RXF1SIDbits C1RXF1SID_sfr.bits
+#define C1RXF2SIDbits C1RXF2SID_sfr.bits
+#define C1RXF3SIDbits C1RXF3SID_sfr.bits
+#define C1RXF4SIDbits C1RXF4SID_sfr.bits
+#define C1RXF5SIDbits C1RXF5SID_sfr.bits
+#define C1RXF6SIDbits C1RXF6SID_sfr.bits
+#define C1RXF7SIDbits C1RXF7SID_sfr.bits
+#define C1RXF8SIDbits C1RXF8SID_sfr.bits
+#define C1RXF9SIDbits C1RXF9SID_sfr.bits
+#define C1RXF10SIDbits C1RXF10SID_sfr.bits
+#define C1RXF11SIDbits C1RXF11SID_sfr.bits
+#define C1RXF12SIDbits C1RXF12SID_sfr.bits
+#define C1RXF13SIDbits C1RXF13SID_sfr.bits
+#define C1RXF14SIDbits C1RXF14SID_sfr.bits
+#define C1RXF15SIDbits C1RXF15SID_sfr.bits
+HOST_SFR_WORD(C1FMSKSEL1);
+HOST_SFR_WORD(C1FMSKSEL2);
+extern volatile uint16_t _F0BP, _F1BP, _F2BP, _F3BP, _F4BP, _F5BP, _F6BP, _F7BP,
+    _F8BP, _F9BP, _F10BP, _F11BP, _F12BP, _F13BP, _F14BP, _F15BP;
+extern volatile uint16_t _FLTEN0, _FLTEN1, _FLTEN2, _FLTEN3, _FLTEN4, _FLTEN5, _FLTEN6, _FLTEN7,
+    _FLTEN8, _FLTEN9, _FLTEN10, _FLTEN11, _FLTEN12, _FLTEN13, _FLTEN14, _FLTEN15;
+HOST_SFR_WORD(C1RXFUL1);
+HOST_SFR_WORD(C1RXD);
+extern volatile uint16_t _ICODE, _RBIF, _RBIE;
+
+
+// *****************************************************************************
+// DMA
+HOST_SFR_WORD(DMACS0);
+HOST_SFR(DMACS1, unsigned PPST0:1; unsigned PPST1:1; unsigned PPST2:1; unsigned PPST3:1; unsigned :4;
+    unsigned LSTCH:4; unsigned :4;);
+#define DMACS1 DMACS1_sfr.word
+#define DMACS1bits DMACS1_sfr.bits
+#define HOST_DMA_CON_FIELDS unsigned MODE:2; unsigned :2; unsigned AMODE:2; unsigned :5; unsigned NULLW:1; \
+    unsigned HALF:1; unsigned DIR:1; unsigned SIZE:1; unsigned CHEN:1;
+#define HOST_DMA_CHANNEL(x) \
+    HOST_SFR(DMA##x##CON, HOST_DMA_CON_FIELDS); \
+    HOST_SFR_WORD(DMA##x##REQ); \
+    HOST_SFR_WORD(DMA##x##STA); \
+    HOST_SFR_WORD(DMA##x##STB); \
+    HOST_SFR_WORD(DMA##x##PAD); \
+    HOST_SFR_WORD(DMA##x##CNT)
+HOST_DMA_CHANNEL(0);
+HOST_DMA_CHANNEL(1);
+HOST_DMA_CHANNEL(2);
+HOST_DMA_CHANNEL(3);
+#define DMA0CON DMA0CON_sfr.word
+#define DMA0CONbits DMA0CON_sfr.bits
+#define DMA1CON DMA1CON_sfr.word
+#define DMA1CONbits DMA1CON_sfr.bits
+#define DMA2CON DMA2CON_sfr.word
+#define DMA2CONbits DMA2CON_sfr.bits
+#define DMA3CON DMA3CON_sfr.word
+#define DMA3CONbits DMA3CON_sfr.bits
+
+
+// *****************************************************************************
+// ADC 1
+HOST_SFR(AD1CON1, unsigned DONE:1; unsigned SAMP:1; unsigned ASAM:1; unsigned SIMSAM:1; unsigned :1;
+    unsigned SSRC:3; unsigned FORM:2; unsigned AD12B:1; unsigned :1; unsigned ADDMABM:1; unsigned ADSIDL:1;
+    unsigned :1; unsigned ADON:1;);
+HOST_SFR(AD1CON2, unsigned ALTS:1; unsigned BUFM:1; unsigned SMPI:4; unsigned :1; unsigned BUFS:1;
+    unsigned CHPS:2; unsigned CSCNA:1; unsigned :2; unsigned VCFG:3;);
+HOST_SFR(AD1CON3, unsigned ADCS:8; unsigned SAMC:5; unsigned :2; unsigned ADRC:1;);
+HOST_SFR(AD1CON4, unsigned DMABL:3; unsigned :13;);
+HOST_SFR(AD1CHS0, unsigned CH0SA:5; unsigned :2; unsigned CH0NA:1; unsigned CH0SB:5; unsigned :2; unsigned CH0NB:1;);
+#define AD1CON1 AD1CON1_sfr.word
+#define AD1CON1bits AD1CON1_sfr.bits
+#define AD1CON2 AD1CON2_sfr.word
+#define AD1CON2bits AD1CON2_sfr.bits
+#define AD1CON3 AD1CON3_sfr.word
+#define AD1CON3bits AD1CON3_sfr.bits
+#define AD1CON4 AD1CON4_sfr.word
+#define AD1CON4bits AD1CON4_sfr.bits
+#define AD1CHS0 AD1CHS0_sfr.word
+#define AD1CHS0bits AD1CHS0_sfr.bits
+HOST_SFR_WORD(AD1PCFGL);
+HOST_SFR_WORD(AD1CSSL);
+HOST_SFR_WORD(ADC1BUF0);
+
+
+// *****************************************************************************
+// Program memory access
+HOST_SFR_WORD(NVMCON);
+HOST_SFR_WORD(NVMKEY);
+HOST_SFR_WORD(TBLPAG);
+
+
+// *****************************************************************************
+// Builtins and instructions
+
+// the flash region that the emulation covers - the size of the eeprom_emulation and journal memory regions
+// of the linker script together
+#define HOST_FLASH_ORIGIN 0x10000UL
+#define HOST_FLASH_LENGTH 0x6600UL
+
+// NVM operation times (us) - middle of the PIC24HJ128GP504 datasheet ranges
+#define HOST_WORD_PROGRAM_TIME 48
+#define HOST_ROW_PROGRAM_TIME 1530
+#define HOST_PAGE_ERASE_TIME 23300
+
+uint16_t __builtin_tblrdl(const uint16_t offset);
+uint8_t __builtin_tblrdh(const uint16_t offset);
+void __builtin_tblwtl(const uint16_t offset, const uint16_t data);
+void __builtin_tblwth(const uint16_t offset, const uint8_t data);
+void __builtin_write_NVM(void);
+void __builtin_disi(const uint16_t cycles);
+void __builtin_write_OSCCONH(const uint8_t value);
+void __builtin_write_OSCCONL(const uint8_t value);
+uint32_t HostTblAddress(const void *const object, const uint32_t size);
+#define __builtin_tbladdress(object) HostTblAddress((object), sizeof(*(object)))
+uint16_t HostDMAOffset(volatile void *const object);
+#define __builtin_dmaoffset(object) HostDMAOffset((volatile void *)(object))
+
+void Idle(void);
+void Sleep(void);
+#define Nop() ((void)0)
+#define ClrWdt() ((void)0)
+
+
+// *****************************************************************************
+// Host model statistics and hooks
+
+typedef struct
+{
+    uint32_t table_reads; // __builtin_tblrdl/__builtin_tblrdh
+    uint32_t table_writes; // __builtin_tblwtl/__builtin_tblwth
+    uint32_t word_programs; // NVM PROGRAM_WORD operations
+    uint32_t row_programs; // NVM PROGRAM_ROW operations
+    uint32_t page_erases; // NVM page erase operations
+    uint64_t flash_stall; // us of CPU stall for the NVM operations
+    uint32_t idles; // Idle() invocations
+} host_statistics_t;
+extern host_statistics_t host_statistics;
+
+// Invoked by Idle() so that a simulation can advance time and run interrupts.
+// Defaults to doing nothing.
+extern void (*host_idle_hook)(void);
+
+// Invoked at the end of every NVM operation with the NVMCON value.
+// Defaults to doing nothing.
+extern void (*host_nvm_hook)(const uint16_t nvmcon);
+
+// Invoked when a scheduled power failure happens - should not return (longjmp out of the firmware).
+// Defaults to doing nothing - the firmware carries on with the operation cut short.
+extern void (*host_power_fail_hook)(void);
+
+// resets the simulated flash to fully erased with no erases counted
+void HostFlashErase(void);
+
+// maps the simulated flash onto a file so that it is kept - a new file starts erased.
+// Returns false if the file couldn't be mapped (the flash stays in memory).
+bool HostFlashMap(const char *const path);
+
+// returns the number of times that the page containing the address has been erased
+uint32_t HostFlashEraseCount(const uint32_t address);
+
+// schedules a power failure at the operation'th NVM operation from now (1 for the next, 0 cancels)
+// with only the first words of it done (its whole page/row/word if more) before the power fail hook
+void HostFlashPowerFail(const uint32_t operation, const uint16_t words);
+
+// direct access to the simulated flash instruction words (24 bits each)
+uint32_t HostFlashRead(const uint32_t address);
+
+// returns the object in DMA RAM at the offset given by __builtin_dmaoffset - NULL if none
+volatile void* HostDMAAddress(const uint16_t offset);
+
+// plays the DMA controller for an SPI1 transfer set up on DMA channel 0 (transmit buffer to SPI1BUF) and
+// channel 1 (SPI1BUF to receive buffer) with each word going through the slave's transfer function.
+// Both channels are one-shot so they are disabled at the end and the channel 1 interrupt flag is set.
+// Returns the number of words - zero if the channels weren't enabled.
+uint16_t HostSPIDMATransfer(uint16_t (*const slave)(const uint16_t word));
+
+// returns the SCK divider (FCY/SCK) that the SPI1 primary and secondary prescales are set to
+uint16_t HostSPIClockDivider(void);
+
+// plays the ADC and DMA channel 2 (ADC1BUF0 to the ping-pong buffers) for a block of DMA2CNT + 1 conversions
+// with each conversion result from the converter. Switches the ping-pong buffer (DMACS1 PPST2) and sets the
+// channel 2 interrupt flag at the end of the block. Returns the number of conversions - zero if the ADC or
+// the channel isn't enabled.
+uint16_t HostADCDMABlock(uint16_t (*const converter)(void));
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* HOST_XC_H */
@@ -14,6 +14,7 @@
 #define TIMER_INTERRUPT_PRIORITY 2
 #define SPI_INTERRUPT_PRIORITY 3
 #define CAN_INTERRUPT_PRIORITY 4
+#define ADC_INTERRUPT_PRIORITY 1
 
 
 
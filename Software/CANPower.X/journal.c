@@ -0,0 +1,487 @@
+/*
+ * File:   journal.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Append-only event journal in flash program memory.
+ * The journal has its own pages (the .journal section) so that it doesn't disturb the EEPROM emulation.
+ * Each page is divided into slots of JOURNAL_RECORD_LOCATIONS locations - one record to a slot:
+ *  location 0 - type (high byte) and data word 0 (low word)
+ *  location 1 - sequence number low byte (high byte) and data word 1 (low word)
+ *  location 2 - sequence number high byte (high byte) and data word 2 (low word)
+ *  location 3 - CRC-8 of the type, sequence number and data (high byte) and data word 3 (low word)
+ * A record is programmed a location at a time with the CRC last so that a record cut short by a reset is
+ * seen as corrupt and skipped. A slot is free while its location 0 is erased.
+ *
+ * Records are appended to successive slots of the head page and then of the next page round. The page after
+ * the head page is erased ahead of time by JournalTasks - once it's been checked and it has the flash token (see
+ * flash.h) - so appends don't normally stall for an erase. The ahead page is the oldest so its records are lost
+ * when it's erased - the journal holds between JOURNAL_PAGES - 2 and JOURNAL_PAGES - 1 pages of records.
+ *
+ * InitializeJournal finds the head page from the sequence number of the first record in each page (the latest
+ * one) and scans the head page for the first free slot - the head. The tail is the start of the first page after
+ * the head page that has records. Nothing is erased or programmed at initialisation. If the journal is empty the
+ * first append erases the first page (unless JournalTasks has already) before starting it.
+ *
+ */
+
+
+#include <stdbool.h>
+#include "journal.h"
+#include "flash.h"
+
+
+// User defined constants
+#define JOURNAL_PAGES           4
+
+
+#if JOURNAL_PAGES < 2
+    #error Minimum number of journal pages is 2
+#endif
+
+#if JOURNAL_DATA_WORDS != 4
+    #error A journal record is four locations - one data word in each
+#endif
+
+
+// NVMCON values
+#define ERASE               0x4042
+#define PROGRAM_WORD        0x4003
+
+
+// Internal constants
+#define	NUMBER_OF_INSTRUCTIONS_IN_PAGE  512
+#define	NUMBER_OF_INSTRUCTIONS_IN_ROW   64
+#define JOURNAL_RECORD_LOCATIONS        4
+#define JOURNAL_SLOTS                   (NUMBER_OF_INSTRUCTIONS_IN_PAGE / JOURNAL_RECORD_LOCATIONS)
+#define ERASED_WORD                     0xFFFF
+#define ERASED_BYTE                     0xFF
+#define CRC_POLYNOMIAL                  0x07
+
+
+uint8_t journalPages[JOURNAL_PAGES][NUMBER_OF_INSTRUCTIONS_IN_PAGE * 2]
+    __attribute__ ((space(prog), aligned(NUMBER_OF_INSTRUCTIONS_IN_PAGE * 2), section(".journal"), noload));
+
+#define JOURNAL_PAGE_SIZE (sizeof(journalPages[0]))
+
+#define JOURNAL_PAGE_TBL(page) ((__builtin_tbladdress(&journalPages) + (JOURNAL_PAGE_SIZE * (page))) >> 16)
+#define JOURNAL_PAGE_OFFSET(page) ((__builtin_tbladdress(&journalPages) + (JOURNAL_PAGE_SIZE * (page))) & 0xFFFF)
+
+
+// RAM cache of the head and tail
+static uint8_t  headPage;
+static uint8_t  headSlot;                   // the next free slot of the head page - JOURNAL_SLOTS if full
+static uint8_t  tailPage;                   // the oldest record - the same as the head if there are none
+static uint8_t  tailSlot;
+static uint16_t sequence;                   // of the next record
+
+// the page ahead of the head page - see JournalTasks
+static bool     aheadErased;
+static uint16_t aheadChecked;               // number of locations of the ahead page found to be erased
+
+
+static uint8_t  NextPage(const uint8_t page);
+static uint8_t  RecordCRC(const journal_record_t *const record);
+static void     EraseJournalPage(const uint8_t page);
+static void     ProgramLocation(const uint8_t page, const uint16_t location, const uint8_t high, const uint16_t low);
+static bool     SlotFree(const uint8_t page, const uint8_t slot);
+static bool     ReadRecord(const uint8_t page, const uint8_t slot, journal_record_t *const record);
+static bool     FirstRecord(const uint8_t page, journal_record_t *const record);
+static void     EraseAhead(void);
+
+
+static uint8_t NextPage(const uint8_t page)
+{
+    return (page < (JOURNAL_PAGES - 1))?(page + 1):0;
+}
+
+
+/************************************************************************
+RecordCRC
+
+Returns the CRC-8 of the type, sequence number and data of a record -
+never the erased value so that a record whose CRC location wasn't
+programmed is never valid.
+************************************************************************/
+static uint8_t RecordCRC(const journal_record_t *const record)
+{
+    uint8_t bytes[3 + (JOURNAL_DATA_WORDS * 2)];
+    uint8_t crc = 0;
+    uint8_t i;
+    uint8_t bit;
+
+    bytes[0] = record->type;
+    bytes[1] = record->sequence & 0xFF;
+    bytes[2] = record->sequence >> 8;
+    for (i = 0; i < JOURNAL_DATA_WORDS; ++i)
+    {
+        bytes[3 + (i * 2)] = record->data[i] & 0xFF;
+        bytes[4 + (i * 2)] = record->data[i] >> 8;
+    }
+    for (i = 0; i < sizeof(bytes); ++i)
+    {
+        crc ^= bytes[i];
+        for (bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc & 0x80)?((crc << 1) ^ CRC_POLYNOMIAL):(crc << 1);
+        }
+    }
+    return (crc == ERASED_BYTE)?(ERASED_BYTE - 1):crc;
+}
+
+
+/************************************************************************
+EraseJournalPage
+
+This routine erases the selected page.
+
+Side Effects:	CPU stall occurs for the erase.
+************************************************************************/
+static void EraseJournalPage(const uint8_t page)
+{
+    uint16_t offset;
+
+    TBLPAG = JOURNAL_PAGE_TBL(page);
+    offset = JOURNAL_PAGE_OFFSET(page);
+
+    NVMCON = ERASE;
+    __builtin_tblwtl(offset, offset);
+
+    __builtin_disi(5);
+    __builtin_write_NVM();
+}
+
+
+/************************************************************************
+ProgramLocation
+
+This routine programs a single location of a page with the high byte
+and low word given.
+
+Side Effects:	CPU stall occurs for flash programming.
+************************************************************************/
+static void ProgramLocation(const uint8_t page, const uint16_t location, const uint8_t high, const uint16_t low)
+{
+    uint16_t offset;
+
+    TBLPAG = JOURNAL_PAGE_TBL(page);
+    offset = JOURNAL_PAGE_OFFSET(page) + (location * 2);
+
+    NVMCON = PROGRAM_WORD;
+    __builtin_tblwtl(offset, low);
+    __builtin_tblwth(offset, high);
+
+    __builtin_disi(5);
+    __builtin_write_NVM();
+
+    Nop();
+    Nop();
+}
+
+
+/************************************************************************
+SlotFree
+
+Returns true if nothing has been programmed into the slot.
+************************************************************************/
+static bool SlotFree(const uint8_t page, const uint8_t slot)
+{
+    uint16_t offset;
+
+    TBLPAG = JOURNAL_PAGE_TBL(page);
+    offset = JOURNAL_PAGE_OFFSET(page) + (slot * JOURNAL_RECORD_LOCATIONS * 2);
+    return (__builtin_tblrdh(offset) == ERASED_BYTE) && (__builtin_tblrdl(offset) == ERASED_WORD);
+}
+
+
+/************************************************************************
+ReadRecord
+
+Reads the record in the slot - returns true if it's valid.
+************************************************************************/
+static bool ReadRecord(const uint8_t page, const uint8_t slot, journal_record_t *const record)
+{
+    uint16_t offset;
+    uint8_t type;
+    uint8_t crc;
+    uint8_t i;
+
+    TBLPAG = JOURNAL_PAGE_TBL(page);
+    offset = JOURNAL_PAGE_OFFSET(page) + (slot * JOURNAL_RECORD_LOCATIONS * 2);
+    type = __builtin_tblrdh(offset);
+    if (type >= NUMBER_OF_JOURNAL_TYPES)
+    {
+        return false;
+    }
+    for (i = 0; i < JOURNAL_DATA_WORDS; ++i)
+    {
+        record->data[i] = __builtin_tblrdl(offset + (i * 2));
+    }
+    record->type = type;
+    record->sequence = __builtin_tblrdh(offset + 2) | ((uint16_t)__builtin_tblrdh(offset + 4) << 8);
+    crc = __builtin_tblrdh(offset + 6);
+    return crc == RecordCRC(record);
+}
+
+
+/************************************************************************
+FirstRecord
+
+Reads the first valid record of the page - returns false if there isn't
+one before the first free slot.
+************************************************************************/
+static bool FirstRecord(const uint8_t page, journal_record_t *const record)
+{
+    uint8_t slot;
+
+    for (slot = 0; (slot < JOURNAL_SLOTS) && !SlotFree(page, slot); ++slot)
+    {
+        if (ReadRecord(page, slot, record))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/************************************************************************
+EraseAhead
+
+Erases the page ahead of the head page. If it's the tail page then the
+tail moves on to the page after.
+
+Side Effects:	CPU stall occurs for the erase.
+************************************************************************/
+static void EraseAhead(void)
+{
+    uint8_t ahead = NextPage(headPage);
+
+    EraseJournalPage(ahead);
+    if ((tailPage == ahead) && !((tailPage == headPage) && (tailSlot == headSlot)))
+    {
+        tailPage = NextPage(ahead);
+        tailSlot = 0;
+    }
+    aheadErased = true;
+}
+
+
+/************************************************************************
+InitializeJournal
+
+This routine finds the head page - the one whose first record has the
+latest sequence number - and scans it for the head. The tail is the
+first page after it that has records. Nothing is erased or programmed.
+
+Parameters:		None
+Return:			None
+************************************************************************/
+void InitializeJournal(void)
+{
+    uint16_t savedTBLPAG;
+    journal_record_t record;
+    uint16_t latest = 0;
+    bool found = false;
+    uint8_t page;
+    uint8_t slot;
+
+    savedTBLPAG = TBLPAG;
+
+    // the head page - sequence numbers are compared as serial numbers so that they can wrap
+    headPage = JOURNAL_PAGES - 1;
+    for (page = 0; page < JOURNAL_PAGES; ++page)
+    {
+        if (FirstRecord(page, &record) && (!found || ((int16_t)(record.sequence - latest) > 0)))
+        {
+            found = true;
+            headPage = page;
+            latest = record.sequence;
+        }
+    }
+
+    if (found)
+    {
+        // the head - the first free slot - and the sequence number following on from the last record
+        for (slot = 0; (slot < JOURNAL_SLOTS) && !SlotFree(headPage, slot); ++slot)
+        {
+            if (ReadRecord(headPage, slot, &record))
+            {
+                latest = record.sequence;
+            }
+        }
+        headSlot = slot;
+        sequence = latest + 1;
+
+        // the tail
+        tailPage = NextPage(headPage);
+        while ((tailPage != headPage) && !FirstRecord(tailPage, &record))
+        {
+            tailPage = NextPage(tailPage);
+        }
+        tailSlot = 0;
+    }
+    else
+    {
+        // empty - the head page is full so that the first append starts the first page
+        headSlot = JOURNAL_SLOTS;
+        sequence = 0;
+        tailPage = headPage;
+        tailSlot = headSlot;
+    }
+
+    aheadErased = false;
+    aheadChecked = 0;
+    TBLPAG = savedTBLPAG;
+}
+
+
+/************************************************************************
+JournalTasks
+
+Checks the page ahead of the head page a row per invocation and erases
+it if anything is found programmed - so that it's ready when the head
+page fills. The erase waits for a tick when the flash token is free.
+Must be invoked once per timer tick.
+
+Parameters:		None
+Return:			None
+Side Effects:	CPU stall occurs for the erase.
+************************************************************************/
+void JournalTasks(void)
+{
+    uint16_t savedTBLPAG;
+    uint8_t ahead;
+    uint16_t offset;
+    uint16_t end;
+
+    if (!aheadErased)
+    {
+        savedTBLPAG = TBLPAG;
+        ahead = NextPage(headPage);
+        TBLPAG = JOURNAL_PAGE_TBL(ahead);
+        offset = JOURNAL_PAGE_OFFSET(ahead) + (aheadChecked * 2);
+        end = aheadChecked + NUMBER_OF_INSTRUCTIONS_IN_ROW;
+        for (; (aheadChecked < end)
+            && (__builtin_tblrdh(offset) == ERASED_BYTE) && (__builtin_tblrdl(offset) == ERASED_WORD);
+            ++aheadChecked, offset += 2);
+        if ((aheadChecked < end) && FlashToken())
+        {
+            EraseAhead();
+        }
+        else if (aheadChecked >= NUMBER_OF_INSTRUCTIONS_IN_PAGE)
+        {
+            aheadErased = true;
+        }
+        TBLPAG = savedTBLPAG;
+    }
+}
+
+
+/************************************************************************
+JournalAppend
+
+This routine programs a record into the head slot - moving the head on
+to the page ahead first if the head page is full. The page ahead is
+erased here if JournalTasks hasn't got to it.
+
+Parameters:		Record type and data
+Return:			None
+Side Effects:	CPU stall occurs for flash programming and possibly an erase.
+************************************************************************/
+void JournalAppend(const journal_type_t type, const uint16_t data[JOURNAL_DATA_WORDS])
+{
+    uint16_t savedTBLPAG;
+    journal_record_t record;
+    uint16_t location;
+    uint8_t i;
+
+    savedTBLPAG = TBLPAG;
+    if (headSlot >= JOURNAL_SLOTS)
+    {
+        if (!aheadErased)
+        {
+            EraseAhead();
+        }
+        if ((tailPage == headPage) && (tailSlot == headSlot))
+        {
+            // was empty
+            tailPage = NextPage(headPage);
+            tailSlot = 0;
+        }
+        headPage = NextPage(headPage);
+        headSlot = 0;
+        aheadErased = false;
+        aheadChecked = 0;
+    }
+
+    record.type = type;
+    record.sequence = sequence;
+    for (i = 0; i < JOURNAL_DATA_WORDS; ++i)
+    {
+        record.data[i] = data[i];
+    }
+    location = headSlot * JOURNAL_RECORD_LOCATIONS;
+    ProgramLocation(headPage, location, type, data[0]);
+    ProgramLocation(headPage, location + 1, sequence & 0xFF, data[1]);
+    ProgramLocation(headPage, location + 2, sequence >> 8, data[2]);
+    ProgramLocation(headPage, location + 3, RecordCRC(&record), data[3]);
+
+    ++headSlot;
+    ++sequence;
+    TBLPAG = savedTBLPAG;
+}
+
+
+/************************************************************************
+JournalSequence
+
+Returns the sequence number of the next record to be appended.
+************************************************************************/
+uint16_t JournalSequence(void)
+{
+    return sequence;
+}
+
+
+/************************************************************************
+JournalFirst
+
+Starts a read through the journal at the oldest record.
+************************************************************************/
+void JournalFirst(journal_iterator_t *const iterator)
+{
+    iterator->page = tailPage;
+    iterator->slot = tailSlot;
+}
+
+
+/************************************************************************
+JournalNext
+
+Reads the next valid record up to the head - returns false if there
+isn't one.
+************************************************************************/
+bool JournalNext(journal_iterator_t *const iterator, journal_record_t *const record)
+{
+    uint16_t savedTBLPAG;
+    bool valid = false;
+
+    savedTBLPAG = TBLPAG;
+    while (!valid && !((iterator->page == headPage) && (iterator->slot >= headSlot)))
+    {
+        if (iterator->slot >= JOURNAL_SLOTS)
+        {
+            iterator->page = NextPage(iterator->page);
+            iterator->slot = 0;
+        }
+        else
+        {
+            valid = ReadRecord(iterator->page, iterator->slot, record);
+            ++iterator->slot;
+        }
+    }
+    TBLPAG = savedTBLPAG;
+    return valid;
+}
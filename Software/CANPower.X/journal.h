@@ -0,0 +1,86 @@
+/*
+ * File:   journal.h
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Append-only event journal in flash program memory - separate from the EEPROM emulation.
+ * Records are a fixed size - a type, JOURNAL_DATA_WORDS data words and a sequence number - and are
+ * protected by a CRC. The head and tail are cached in RAM so an append is just the programming of the
+ * record. The oldest page is erased to make room as the journal wraps round.
+ *
+ * InitializeJournal must be invoked before anything else. It only reads the flash.
+ * JournalTasks must be invoked once per timer tick - it gets the next page erased ahead of the appends.
+ * JournalAppend programs the flash so the caller should have the flash token for it (see flash.h).
+ * JournalFirst and JournalNext read the records from the oldest to the newest.
+ *
+ */
+
+#ifndef JOURNAL_H
+#define	JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "xc.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+#define JOURNAL_DATA_WORDS 4
+
+// record types - one for each kind of event journalled
+// (JOURNAL_METERS_0 and JOURNAL_METERS_1 are the hour meter deltas of each channel and JOURNAL_METERS_ENERGY
+// the energy deltas of both - see meters.c - and JOURNAL_SNAPSHOT_0 to 2 the parts of a switch chip fault
+// snapshot - see faults.c)
+typedef enum {JOURNAL_STATE=0, JOURNAL_MODE, JOURNAL_FAULT, JOURNAL_METERS_0, JOURNAL_METERS_1,
+    JOURNAL_SNAPSHOT_0, JOURNAL_SNAPSHOT_1, JOURNAL_SNAPSHOT_2, JOURNAL_METERS_ENERGY,
+    NUMBER_OF_JOURNAL_TYPES} journal_type_t;
+
+typedef struct
+{
+    uint16_t sequence; // increments with each record appended
+    journal_type_t type;
+    uint16_t data[JOURNAL_DATA_WORDS];
+} journal_record_t;
+
+// position of a read through the journal
+typedef struct
+{
+    uint8_t page;
+    uint8_t slot;
+} journal_iterator_t;
+
+
+/* Must be called once at initialisation time - finds the head and tail of the journal */
+void InitializeJournal(void);
+
+
+/* Must be invoked once per timer tick - checks and erases the page ahead of the head */
+void JournalTasks(void);
+
+
+/* Appends a record. Stalls for the programming of the record (and for a page erase if the
+ * appends have got ahead of JournalTasks) - one flash operation for the flash token. */
+void JournalAppend(const journal_type_t type, const uint16_t data[JOURNAL_DATA_WORDS]);
+
+
+/* Returns the sequence number that the next record appended will have */
+uint16_t JournalSequence(void);
+
+
+/* Starts a read at the oldest record */
+void JournalFirst(journal_iterator_t *const iterator);
+
+
+/* Reads the next record - returns false once there are no more. Records that are corrupt (e.g. cut
+ * short by a reset) are skipped. */
+bool JournalNext(journal_iterator_t *const iterator, journal_record_t *const record);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* JOURNAL_H */
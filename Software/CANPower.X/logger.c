@@ -0,0 +1,387 @@
+/*
+ * File:   logger.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Ride data logger to a JEDEC SPI NOR flash on CS1.
+ *
+ * Records are LOG_RECORD_WORDS words - the type, Minutes and Timer at the append and the data - so a page holds
+ * RECORDS_PER_PAGE of them. There are two page buffers: records are appended to one while the other waits for
+ * or is being programmed. If both are full the record is dropped (and counted) rather than waiting for the flash.
+ * Each buffer has room for the page program command and address ahead of the records so a page goes to the
+ * flash as a single SPI transaction.
+ *
+ * The flash is a ring of pages. The sector after the one being written is erased as the writing moves into
+ * each sector, so there is always an erased gap ahead of the writing and the end of the ring is the first erased
+ * page after a programmed one. At start up that is found by reading the first word of each page in turn (an
+ * erased page's type word reads LOG_PADDING) and the sector after it is erased again in case the power went
+ * during its erase. If no page is erased the sector at the start is erased first.
+ *
+ * The identification, the scan and the programming are a protothread (see protothread.h) run by LoggerThread
+ * on every timer tick and SPI done event. The SPI transactions are queued at SPI_PRIORITY_EXPANSION so they
+ * only ever hold up the switch chip by one transaction. The page program and sector erase times (ms) are
+ * waited out by reading the flash status once a tick - appends carry on into the other buffer meanwhile.
+ *
+ * The SPI is in 16 bit mode so the one byte commands (write enable and read status) go out with a second
+ * byte which the flash ignores - CS1 still goes inactive on a byte boundary.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "logger.h"
+#include "SPI.h"
+#include "timer.h"
+#include "CAN.h"
+#include "MC06XSD200.h"
+#include "protothread.h"
+#include "xc.h"
+
+
+// JEDEC SPI NOR commands
+#define WRITE_ENABLE 0x06
+#define READ_STATUS 0x05
+#define READ_DATA 0x03
+#define PAGE_PROGRAM 0x02
+#define SECTOR_ERASE 0x20
+#define READ_JEDEC_ID 0x9F
+#define STATUS_BUSY 0x01 // write (program or erase) in progress
+
+#define FLASH_SPI_MODE 0
+#define FLASH_CLOCK_DIVIDER 2 // the fastest SCK the prescales can make - well within any SPI flash
+#define MINIMUM_CAPACITY 16 // log2 of the flash size in bytes - 64KB
+#define MAXIMUM_CAPACITY 23 // 8MB - the pages are counted in 16 bits
+
+#define RECORDS_PER_PAGE (LOG_PAGE_SIZE / 2 / LOG_RECORD_WORDS)
+#define PAGES_PER_SECTOR (LOG_SECTOR_SIZE / LOG_PAGE_SIZE)
+#define HEADER_WORDS 2 // command and address ahead of the records in a page program
+#define PROGRAM_WORDS (HEADER_WORDS + LOG_PAGE_SIZE / 2)
+#define NO_SECTOR 0xFFFF
+#define LEVEL_UNKNOWN 0xFFFF
+
+#if PROGRAM_WORDS > SPI_MAX_WORDS
+#error "SPI_MAX_WORDS is too small for a page program"
+#endif
+
+
+typedef enum
+{
+    IDENTIFYING=0, // reading the JEDEC ID
+    ABSENT, // no flash fitted - appends are dropped
+    SCANNING, // finding the end of the ring
+    LOGGING // programming the page buffers as they fill and erasing ahead
+} states_t;
+static states_t state;
+static pt_t thread;
+
+// the SPI transaction for each command in turn and the short commands and their responses
+static SPI_transaction_t transaction;
+static SPIData_t command[3];
+static SPIData_t response[3];
+
+// page buffers
+static SPIData_t buffers[2][PROGRAM_WORDS];
+static bool full[2]; // waiting to be programmed
+static uint16_t full_time[2]; // Timer when it filled
+static uint8_t filling; // the buffer being appended to
+static uint8_t filled; // records in it
+static uint8_t programming; // the next buffer to be programmed
+
+// the ring
+static uint16_t pages; // in the flash
+static uint16_t head; // the next page to be programmed
+static uint16_t erase_sector; // to be erased before the next page program - NO_SECTOR if none
+
+static logger_statistics_t statistics;
+static uint16_t logged_level_0; // channel levels last logged
+static uint16_t logged_level_1;
+
+
+/* Returns the sector after the one containing the page */
+static uint16_t NextSector(const uint16_t page)
+{
+    uint16_t sector = page / PAGES_PER_SECTOR + 1;
+    return (sector == pages / PAGES_PER_SECTOR) ? 0 : sector;
+}
+
+
+/* Fills in a command and the three address bytes as two words */
+static void Address(SPIData_t *const words, const uint8_t instruction, const uint32_t address)
+{
+    words[0] = ((uint16_t)instruction << 8) | (uint16_t)((address >> 16) & 0xFF);
+    words[1] = (uint16_t)address;
+}
+
+
+/* Queues the transfer of the words to the flash. The words received are kept in response (only for
+ * the short commands) */
+static void Transfer(const SPIData_t *const words, const uint16_t length)
+{
+    transaction.transmit = words;
+    transaction.length = length;
+    transaction.receive = (length <= (sizeof(response) / sizeof(response[0]))) ? response : NULL;
+    SPIQueue(&transaction);
+}
+
+
+/* Hands the buffer being filled over for programming */
+static void Filled(void)
+{
+    full[filling] = true;
+    full_time[filling] = Timer();
+    filling ^= 1;
+    filled = 0;
+}
+
+
+/* The identification, scan and programming sequence */
+static pt_status_t LoggerSequence(pt_t *const pt)
+{
+    static uint16_t page; // being scanned
+    static bool previous_written; // the page before it has been programmed
+    static bool erased_seen; // an erased page has been found
+    static bool erasing; // the write in progress is a sector erase
+    static uint16_t start_time; // Timer value at the start of the current wait
+    uint16_t latency;
+
+    PT_BEGIN(pt);
+    command[0] = READ_JEDEC_ID << 8;
+    command[1] = 0;
+    Transfer(command, 2);
+    PT_WAIT_WHILE(pt, SPIBusy(&transaction));
+    // manufacturer in the low byte of the first word and the capacity in the low byte of the second
+    if (((response[0] & 0xFF) == 0x00) || ((response[0] & 0xFF) == 0xFF)
+      || ((response[1] & 0xFF) < MINIMUM_CAPACITY) || ((response[1] & 0xFF) > MAXIMUM_CAPACITY))
+    {
+        state = ABSENT;
+        PT_EXIT(pt);
+    }
+    pages = (uint16_t)((1UL << (response[1] & 0xFF)) / LOG_PAGE_SIZE);
+
+    // find the end of the ring
+    state = SCANNING;
+    previous_written = false;
+    erased_seen = false;
+    for (page = 0; page < pages; ++page)
+    {
+        Address(command, READ_DATA, (uint32_t)page * LOG_PAGE_SIZE);
+        command[2] = 0;
+        Transfer(command, 3);
+        PT_WAIT_WHILE(pt, SPIBusy(&transaction));
+        if (response[2] != LOG_PADDING)
+        {
+            previous_written = true;
+        }
+        else if (previous_written)
+        {
+            break;
+        }
+        else
+        {
+            erased_seen = true;
+        }
+    }
+    if (page < pages)
+    {
+        head = page;
+        erase_sector = NextSector(head);
+    }
+    else
+    {
+        // the programmed pages run to the end of the flash - or every page is programmed
+        head = 0;
+        erase_sector = erased_seen ? NextSector(head) : 0;
+    }
+
+    state = LOGGING;
+    while (true)
+    {
+        PT_WAIT_UNTIL(pt, (erase_sector != NO_SECTOR) || full[programming]);
+        command[0] = WRITE_ENABLE << 8;
+        Transfer(command, 1);
+        PT_WAIT_WHILE(pt, SPIBusy(&transaction));
+        erasing = (erase_sector != NO_SECTOR);
+        if (erasing)
+        {
+            Address(command, SECTOR_ERASE, (uint32_t)erase_sector * LOG_SECTOR_SIZE);
+            Transfer(command, 2);
+        }
+        else
+        {
+            Address(buffers[programming], PAGE_PROGRAM, (uint32_t)head * LOG_PAGE_SIZE);
+            Transfer(buffers[programming], PROGRAM_WORDS);
+        }
+        PT_WAIT_WHILE(pt, SPIBusy(&transaction));
+
+        // the status is read once a tick until the program or erase is done
+        do
+        {
+            start_time = Timer();
+            PT_WAIT_UNTIL(pt, Timer() != start_time);
+            command[0] = READ_STATUS << 8;
+            Transfer(command, 1);
+            PT_WAIT_WHILE(pt, SPIBusy(&transaction));
+        } while (response[0] & STATUS_BUSY);
+
+        if (erasing)
+        {
+            ++statistics.erases;
+            // the sector being written has to be erased when the ring has no gap - then the one after it
+            erase_sector = (erase_sector == head / PAGES_PER_SECTOR) ? NextSector(head) : NO_SECTOR;
+        }
+        else
+        {
+            ++statistics.pages;
+            latency = Timer() - full_time[programming];
+            if (latency > statistics.maximum_latency)
+            {
+                statistics.maximum_latency = latency;
+            }
+            full[programming] = false;
+            programming ^= 1;
+            head = (head + 1 == pages) ? 0 : head + 1;
+            if ((head % PAGES_PER_SECTOR) == 0)
+            {
+                erase_sector = NextSector(head); // into a new sector - erase the one after it
+            }
+        }
+    }
+    PT_END(pt);
+}
+
+
+/* Must be called once at initialisation time after the SPI and timer modules */
+void InitializeLogger(void)
+{
+    state = IDENTIFYING;
+    PT_INIT(&thread);
+    transaction.chip_select = SPI_CS1;
+    transaction.priority = SPI_PRIORITY_EXPANSION;
+    transaction.callback = NULL; // the thread is run on the SPI done event
+    SPISetMode(SPI_CS1, FLASH_SPI_MODE);
+    SPISetClockDivider(SPI_CS1, FLASH_CLOCK_DIVIDER);
+    full[0] = false;
+    full[1] = false;
+    filling = 0;
+    filled = 0;
+    programming = 0;
+    erase_sector = NO_SECTOR;
+    statistics.records = 0;
+    statistics.dropped = 0;
+    statistics.pages = 0;
+    statistics.erases = 0;
+    statistics.maximum_latency = 0;
+    logged_level_0 = LEVEL_UNKNOWN;
+    logged_level_1 = LEVEL_UNKNOWN;
+}
+
+
+/* Must be invoked once per timer tick - logs the CAN frames received and any channel level changes */
+void LoggerTasks(void)
+{
+    uint16_t data[LOG_DATA_WORDS];
+    uint8_t message;
+    if (state == ABSENT)
+    {
+        return;
+    }
+    for (message = 0; message < CAN_LOGGED_MESSAGES; ++message)
+    {
+        if (CANFrame(message, &data[0], &data[1])) // identifier then the four data words
+        {
+            LogAppend(LOG_CAN, data);
+        }
+    }
+    data[0] = PWMLevel0();
+    data[1] = PWMLevel1();
+    if ((data[0] != logged_level_0) || (data[1] != logged_level_1))
+    {
+        data[2] = SwitchChipFault();
+        data[3] = 0;
+        data[4] = 0;
+        if (LogAppend(LOG_LEVELS, data))
+        {
+            logged_level_0 = data[0];
+            logged_level_1 = data[1];
+        }
+    }
+}
+
+
+/* Must be invoked on every timer tick and SPI done event */
+void LoggerThread(void)
+{
+    if (state != ABSENT)
+    {
+        LoggerSequence(&thread);
+    }
+}
+
+
+/* Appends a record. Returns false if it had to be dropped - no flash fitted or both page buffers full. */
+bool LogAppend(const log_type_t type, const uint16_t data[LOG_DATA_WORDS])
+{
+    SPIData_t *record;
+    uint8_t i;
+    if (state == ABSENT)
+    {
+        return false;
+    }
+    if (full[filling])
+    {
+        ++statistics.dropped;
+        return false;
+    }
+    record = &buffers[filling][HEADER_WORDS + filled * LOG_RECORD_WORDS];
+    record[0] = type;
+    record[1] = Minutes();
+    record[2] = Timer();
+    for (i=0; i<LOG_DATA_WORDS; ++i)
+    {
+        record[3 + i] = data[i];
+    }
+    ++statistics.records;
+    if (++filled == RECORDS_PER_PAGE)
+    {
+        Filled();
+    }
+    return true;
+}
+
+
+/* Pads out the page buffer being filled so that it gets programmed - e.g. before the power goes */
+void LoggerFlush(void)
+{
+    uint16_t i;
+    if ((state != ABSENT) && (filled > 0) && !full[filling])
+    {
+        for (i = HEADER_WORDS + filled * LOG_RECORD_WORDS; i < PROGRAM_WORDS; ++i)
+        {
+            buffers[filling][i] = LOG_PADDING; // as erased - so left unprogrammed
+        }
+        Filled();
+    }
+}
+
+
+/* Returns true if there's nothing appended waiting to be programmed - a buffer stays full until its page
+ * program has finished */
+bool LoggerIdle(void)
+{
+    return (state == ABSENT) || (!full[0] && !full[1] && (filled == 0));
+}
+
+
+/* Returns true if a flash has been identified */
+bool LoggerPresent(void)
+{
+    return (state == SCANNING) || (state == LOGGING);
+}
+
+
+/* Returns the logging statistics since reset */
+void LoggerStatistics(logger_statistics_t *const statistics_copy)
+{
+    *statistics_copy = statistics;
+}
@@ -0,0 +1,90 @@
+/*
+ * File:   logger.h
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Ride data logger to a JEDEC SPI NOR flash on CS1.
+ * Records - CAN frames, channel level changes and switch chip faults - are appended to a RAM page buffer.
+ * Each full buffer is programmed to the flash as one 256 byte page while the other buffer fills, so
+ * an append only ever copies to RAM. The flash is a ring of pages - the sector after the one being written
+ * is erased in the background as the writing moves into each sector.
+ *
+ * The flash is identified by its JEDEC ID at start up. If there isn't one the logger stays idle and appends
+ * are dropped. Otherwise the end of the ring is found by a background scan of the pages.
+ *
+ * The SPI and timer modules must be initialised before this one. LoggerTasks must be invoked once per timer
+ * tick - it logs the new CAN frames and channel level changes. LoggerThread must be invoked on every timer
+ * tick and SPI done event.
+ *
+ */
+
+#ifndef LOGGER_H
+#define	LOGGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+#define LOG_DATA_WORDS 5
+#define LOG_RECORD_WORDS 8 // type, Minutes, Timer and the data - 16 bytes
+#define LOG_PAGE_SIZE 256 // bytes
+#define LOG_SECTOR_SIZE 4096 // bytes - the smallest erase
+
+// record types
+typedef enum {LOG_CAN=0, LOG_LEVELS, LOG_FAULT, NUMBER_OF_LOG_TYPES} log_type_t;
+#define LOG_PADDING 0xFFFF // type word of the erased records that pad out a page flushed part full
+
+typedef struct
+{
+    uint32_t records; // appended
+    uint32_t dropped; // lost because both page buffers were full
+    uint32_t pages; // programmed
+    uint32_t erases; // sectors erased
+    uint16_t maximum_latency; // ticks from a page buffer filling to it being programmed
+} logger_statistics_t;
+
+
+/* Must be called once at initialisation time after the SPI and timer modules */
+void InitializeLogger(void);
+
+
+/* Must be invoked once per timer tick - logs the CAN frames received and any channel level changes */
+void LoggerTasks(void);
+
+
+/* Must be invoked on every timer tick and SPI done event - runs the flash identification, the scan
+ * for the end of the ring, and the page programs and sector erases on as far as they can go */
+void LoggerThread(void);
+
+
+/* Appends a record. Returns false if it had to be dropped - no flash fitted or both page buffers full. */
+bool LogAppend(const log_type_t type, const uint16_t data[LOG_DATA_WORDS]);
+
+
+/* Pads out the page buffer being filled so that it gets programmed - e.g. before the power goes */
+void LoggerFlush(void);
+
+
+/* Returns true if there's nothing appended waiting to be programmed - both page buffers are empty and the
+ * last page program has finished (or no flash is fitted). LoggerFlush first so that a part full page goes too. */
+bool LoggerIdle(void);
+
+
+/* Returns true if a flash has been identified */
+bool LoggerPresent(void);
+
+
+/* Returns the logging statistics since reset */
+void LoggerStatistics(logger_statistics_t *const statistics);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LOGGER_H */
@@ -8,8 +8,10 @@
  * and then repeatedly invoke the Tasks function of each module. However, between each
  * Task invocation the processor will idle - to be woken up by an interrupt. So at least
  * one regular interrupt source must have been set up during module initialisation.
- * Tasks are invoked once per timer tick. Wake-ups for interrupts other than the timer
- * are ignored for the purposes of processing the Tasks.
+ * Tasks are invoked once per timer tick - signalled by the timer event. Wake-ups for interrupts
+ * that don't signal the timer event are ignored for the purposes of processing the Tasks.
+ * Threads (protothread driver sequences) are invoked after the Tasks on every timer tick and
+ * also on every SPI done event so that driver sequences follow on as soon as a transfer completes.
  */
 
 #include <stdlib.h>
@@ -23,7 +25,15 @@
 #include "hardware.h"
 #include "MC06XSD200.h"
 #include "EEPROM.h"
+#include "journal.h"
+#include "flash.h"
+#include "meters.h"
+#include "faults.h"
 #include "application.h"
+#include "energy.h"
+#include "events.h"
+#include "logger.h"
+#include "ADC.h"
 
 
 // *****************************************************************************
@@ -35,13 +45,20 @@
 void Initialize(void)
 {
     InitializeHardware();
+    InitializeEvents(); // before anything that enables interrupts
     InitializePorts();
-    InitializeEEPROM(); // after the hardware but before starting the timer - it could take a while
+    InitializeEEPROM(); // after the hardware but before starting the timer - it only reads the flash
+    InitializeJournal();
     InitializeTimer();
+    InitializeMeters(); // after the EEPROM, journal and timer
+    InitializeFaults(); // after the EEPROM and journal
+    InitializeEnergy();
     InitializeLEDs();
     InitializeSPI();
+    InitializeLogger(); // after the SPI and timer
     InitializeCAN();
-    InitializeMC06XSD200();
+    InitializeADC();
+    InitializeMC06XSD200(); // after the ADC
     InitializeApplication();
 }
 
@@ -56,9 +73,30 @@ void Initialize(void)
 // *****************************************************************************
 void Tasks(void)
 {
+    FlashTasks(); // frees the flash token - the application, EEPROM, journal, meters and faults take turns with it
     ApplicationTasks();
     LEDTasks();
     MC06XSD200Tasks();
+    EnergyTasks();
+    EEPROMTasks();
+    JournalTasks();
+    MetersTasks();
+    FaultsTasks();
+    LoggerTasks();
+}
+
+
+// *****************************************************************************
+// *****************************************************************************
+// ** Threads
+// ** Invoked once per timer tick after the Tasks and on every SPI done event.
+// ** Calls each module's protothread which runs on until it has to wait.
+// *****************************************************************************
+// *****************************************************************************
+void Threads(void)
+{
+    MC06XSD200Thread();
+    LoggerThread();
 }
 
 
@@ -70,21 +108,26 @@ void Tasks(void)
 
 int main(void)
 {
-    uint16_t last_time, now;
+    events_t events;
     Initialize();
 
-    // tasks invoked once per timer tick. I.e. when the timer value changes
-    last_time = Timer();
+    // tasks invoked once per timer tick. I.e. when the timer event has been signalled
+    // threads invoked after the tasks and whenever an SPI transfer has completed
     while (true)
     {
-        now = Timer();
-        if (now != last_time)
+        events = EventsFetch(EVENT_TIMER | EVENT_SPI_DONE);
+        if (events & EVENT_TIMER)
         {
-            last_time = now;
             Tasks();            
         }
+        if (events)
+        {
+            Threads();
+        }
         // watchdog time out is 64ms. Idling resets it. Must be here at least every 64ms
+        EnergyCPUMode(CPU_IDLE);
         Idle();
+        EnergyCPUMode(CPU_RUN); // the waking interrupt has run before Idle returns - its time is accounted as idle
     }
 
     /* Execution should not come here during normal operation */
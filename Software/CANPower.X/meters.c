@@ -0,0 +1,337 @@
+/*
+ * File:   meters.c
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Lifetime hour meters and energy totals for the two switch channels.
+ *
+ * MetersTick counts ticks in RAM in the duty band of the channel's level. A commit converts the whole
+ * seconds counted to a delta record for the journal - one record per channel that has been on, the data words
+ * being the seconds added to each band - and carries the part second over to the next commit. The energy the
+ * switch chip has measured (SwitchChannelEnergy - Ws since reset) since the last commit goes in a third record
+ * with a 32 bit delta for each channel. So a commit is at most three journal records and nothing is written
+ * while the channels stay off.
+ * A commit only updates RAM - the totals and the deltas outstanding. MetersTasks then writes the records a
+ * flash operation per tick, when it gets the flash token (see flash.h), so the commit at ignition off doesn't
+ * stall, and MetersFlush writes whatever is left before the power is cut. A commit made before the last one is
+ * written adds to its deltas.
+ * Time deltas are 16 bits so a longer one is written over several records.
+ *
+ * Every METER_CHECKPOINT_RECORDS delta records the 32 bit totals are written to the emulated EEPROM as one atomic
+ * group, with the sequence number of the next journal record and a marker that says there is a checkpoint (every
+ * sequence number is valid so an unwritten one can't). It's written on the tick after the last outstanding record
+ * so the sequence number never gets ahead of the journal. The EEPROM emulation only programs the words
+ * that have changed - mostly just the low words of the bands used since the last checkpoint.
+ * At boot the totals are the checkpoint plus the deltas journalled from its sequence number onwards. A delta
+ * record that is lost to a reset part way through its programming loses the time in it, at most the
+ * METER_COMMIT_INTERVAL. Deltas before the first checkpoint are all applied.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "meters.h"
+#include "EEPROM.h"
+#include "journal.h"
+#include "timer.h"
+#include "MC06XSD200.h"
+#include "flash.h"
+#include "xc.h"
+
+
+#define METER_COMMIT_INTERVAL 15 // minutes between the commits while a channel is on
+#define METER_CHECKPOINT_RECORDS 4 // delta records between the checkpoints of the totals
+
+#define PWM_FULL_ON 256 // level of a channel fully on
+#define BIN_LEVELS (PWM_FULL_ON / METER_BINS) // levels in each duty band
+#define SECONDS_PER_HOUR 3600
+
+// checkpoint layout in the emulated EEPROM - the time totals then the energy totals (low word then high word)
+// then the sequence number and the marker
+#define TOTAL_ADDRESS(channel, bin) (METERS_EEPROM_ADDRESS + ((channel) * METER_BINS + (bin)) * 2)
+#define ENERGY_ADDRESS(channel) (METERS_EEPROM_ADDRESS + (METER_CHANNELS * METER_BINS + (channel)) * 2)
+#define SEQUENCE_ADDRESS (METERS_EEPROM_ADDRESS + (METER_CHANNELS * METER_BINS + METER_CHANNELS) * 2)
+#define MARKER_ADDRESS (SEQUENCE_ADDRESS + 1)
+#define CHECKPOINT_MARKER 0x4D43 // anything but the ERASED_WORD_VALUE
+
+#if METERS_EEPROM_ADDRESS + METERS_EEPROM_SIZE > DATA_EE_SIZE
+#error "DATA_EE_SIZE is too small for the meters checkpoint"
+#endif
+
+
+static uint32_t totals[METER_CHANNELS][METER_BINS]; // committed seconds in each band
+static uint32_t ticks[METER_CHANNELS][METER_BINS];  // ticks counted since the last commit
+static uint32_t energy[METER_CHANNELS];             // committed Ws
+static uint32_t energy_read[METER_CHANNELS];        // SwitchChannelEnergy at the last commit
+static uint16_t last_commit_time;                   // Minutes at the last commit
+static uint8_t records;                             // delta records since the last checkpoint
+
+// committed deltas yet to be journalled and whether the checkpoint is to follow them - see WriteNext
+static uint32_t time_deltas[METER_CHANNELS][METER_BINS];
+static uint32_t energy_deltas[METER_CHANNELS];
+static bool checkpoint_due;
+
+
+static void WriteCheckpoint(void);
+static bool Outstanding(void);
+static bool WriteNext(void);
+
+
+/* Writes the committed totals, the sequence number of the next journal record and the marker to the emulated
+ * EEPROM as one group. Stalls for the programming. */
+static void WriteCheckpoint(void)
+{
+    uint8_t channel;
+    uint8_t bin;
+
+    DataEEBegin();
+    for (channel=0; channel<METER_CHANNELS; ++channel)
+    {
+        for (bin=0; bin<METER_BINS; ++bin)
+        {
+            DataEEStage(totals[channel][bin] & 0xFFFF, TOTAL_ADDRESS(channel, bin));
+            DataEEStage(totals[channel][bin] >> 16, TOTAL_ADDRESS(channel, bin) + 1);
+        }
+        DataEEStage(energy[channel] & 0xFFFF, ENERGY_ADDRESS(channel));
+        DataEEStage(energy[channel] >> 16, ENERGY_ADDRESS(channel) + 1);
+    }
+    DataEEStage(JournalSequence(), SEQUENCE_ADDRESS);
+    DataEEStage(CHECKPOINT_MARKER, MARKER_ADDRESS);
+    DataEECommit();
+}
+
+
+/* Returns true if there are delta records or a checkpoint to write */
+static bool Outstanding(void)
+{
+    bool outstanding = checkpoint_due;
+    uint8_t channel;
+    uint8_t bin;
+
+    for (channel=0; channel<METER_CHANNELS; ++channel)
+    {
+        for (bin=0; bin<METER_BINS; ++bin)
+        {
+            outstanding |= (time_deltas[channel][bin] != 0);
+        }
+        outstanding |= (energy_deltas[channel] != 0);
+    }
+    return outstanding;
+}
+
+
+/* Writes the next of the outstanding delta records to the journal or, once they're all written, the checkpoint
+ * if it's due - one flash operation. Time deltas too big for a record are written over several.
+ * Returns false if there was nothing to write. */
+static bool WriteNext(void)
+{
+    uint16_t data[JOURNAL_DATA_WORDS];
+    bool written = false;
+    uint8_t channel;
+    uint8_t bin;
+
+    for (channel=0; !written && channel<METER_CHANNELS; ++channel)
+    {
+        for (bin=0; bin<METER_BINS; ++bin)
+        {
+            written |= (time_deltas[channel][bin] != 0);
+        }
+        if (written)
+        {
+            for (bin=0; bin<METER_BINS; ++bin)
+            {
+                data[bin] = (time_deltas[channel][bin] > UINT16_MAX) ? UINT16_MAX : time_deltas[channel][bin];
+                time_deltas[channel][bin] -= data[bin];
+            }
+            JournalAppend(JOURNAL_METERS_0 + channel, data);
+        }
+    }
+    if (!written && ((energy_deltas[0] != 0) || (energy_deltas[1] != 0)))
+    {
+        for (channel=0; channel<METER_CHANNELS; ++channel)
+        {
+            data[channel * 2] = energy_deltas[channel] & 0xFFFF;
+            data[channel * 2 + 1] = energy_deltas[channel] >> 16;
+            energy_deltas[channel] = 0;
+        }
+        JournalAppend(JOURNAL_METERS_ENERGY, data);
+        written = true;
+    }
+
+    if (written)
+    {
+        ++records;
+        checkpoint_due = (records >= METER_CHECKPOINT_RECORDS);
+    }
+    else if (checkpoint_due)
+    {
+        WriteCheckpoint();
+        records = 0;
+        checkpoint_due = false;
+        written = true;
+    }
+    return written;
+}
+
+
+/* Must be called once at initialisation time after the EEPROM, journal and timer - rebuilds the totals */
+void InitializeMeters(void)
+{
+    journal_iterator_t iterator;
+    journal_record_t record;
+    uint16_t checkpoint_sequence;
+    bool checkpointed;
+    uint8_t channel;
+    uint8_t bin;
+
+    // the checkpoint - if there's been one (any sequence number is valid so the marker says)
+    checkpointed = (DataEERead(MARKER_ADDRESS) == CHECKPOINT_MARKER);
+    checkpoint_sequence = DataEERead(SEQUENCE_ADDRESS);
+    for (channel=0; channel<METER_CHANNELS; ++channel)
+    {
+        for (bin=0; bin<METER_BINS; ++bin)
+        {
+            totals[channel][bin] = checkpointed ?
+                DataEERead(TOTAL_ADDRESS(channel, bin)) | ((uint32_t)DataEERead(TOTAL_ADDRESS(channel, bin) + 1) << 16) : 0;
+            ticks[channel][bin] = 0;
+            time_deltas[channel][bin] = 0;
+        }
+        energy[channel] = checkpointed ?
+            DataEERead(ENERGY_ADDRESS(channel)) | ((uint32_t)DataEERead(ENERGY_ADDRESS(channel) + 1) << 16) : 0;
+        energy_read[channel] = 0; // the switch chip's measurement starts from zero at its initialisation
+        energy_deltas[channel] = 0;
+    }
+    checkpoint_due = false;
+
+    // plus the deltas since - counted so that the next checkpoint is due after the same number of records
+    records = 0;
+    JournalFirst(&iterator);
+    while (JournalNext(&iterator, &record))
+    {
+        if (checkpointed && ((int16_t)(record.sequence - checkpoint_sequence) < 0))
+        {
+            continue;
+        }
+        if (record.type == JOURNAL_METERS_0 || record.type == JOURNAL_METERS_1)
+        {
+            channel = record.type - JOURNAL_METERS_0;
+            for (bin=0; bin<METER_BINS; ++bin)
+            {
+                totals[channel][bin] += record.data[bin];
+            }
+            ++records;
+        }
+        else if (record.type == JOURNAL_METERS_ENERGY)
+        {
+            for (channel=0; channel<METER_CHANNELS; ++channel)
+            {
+                energy[channel] += record.data[channel * 2] | ((uint32_t)record.data[channel * 2 + 1] << 16);
+            }
+            ++records;
+        }
+    }
+
+    last_commit_time = Minutes();
+}
+
+
+/* Must be invoked once per timer tick - commits at the coarse interval and writes what's been committed a flash
+ * operation per tick when it gets the flash token */
+void MetersTasks(void)
+{
+    if ((uint16_t)(Minutes() - last_commit_time) >= METER_COMMIT_INTERVAL)
+    {
+        MetersCommit();
+    }
+    if (Outstanding() && FlashToken())
+    {
+        WriteNext();
+    }
+}
+
+
+/* Invoked once per timer tick for each channel with its PWM level (0 - off to 256 - fully on)
+ * while the switch chip is driving the outputs */
+void MetersTick(const uint8_t channel, const uint16_t level)
+{
+    if (channel < METER_CHANNELS && level != 0)
+    {
+        ++ticks[channel][(level > PWM_FULL_ON ? PWM_FULL_ON - 1 : level - 1) / BIN_LEVELS];
+    }
+}
+
+
+/* Commits the time and energy accumulated since the last commit - adds them to the totals and to the deltas
+ * that MetersTasks writes to flash. Doesn't stall. */
+void MetersCommit(void)
+{
+    uint32_t seconds;
+    uint32_t reading;
+    uint8_t channel;
+    uint8_t bin;
+
+    last_commit_time = Minutes();
+    for (channel=0; channel<METER_CHANNELS; ++channel)
+    {
+        for (bin=0; bin<METER_BINS; ++bin)
+        {
+            // whole seconds only - the part second stays for the next commit
+            seconds = ticks[channel][bin] / TIMER_FREQUENCY;
+            ticks[channel][bin] -= seconds * TIMER_FREQUENCY;
+            totals[channel][bin] += seconds;
+            time_deltas[channel][bin] += seconds;
+        }
+
+        // the energy measured since the last commit
+        reading = SwitchChannelEnergy(channel);
+        energy[channel] += reading - energy_read[channel];
+        energy_deltas[channel] += reading - energy_read[channel];
+        energy_read[channel] = reading;
+    }
+}
+
+
+/* Writes everything committed but not yet in flash. Stalls for the flash programming. */
+void MetersFlush(void)
+{
+    while (WriteNext())
+    {
+        ClrWdt();
+    }
+}
+
+
+/* Returns the lifetime time in seconds in the duty band */
+uint32_t MeterBinTime(const uint8_t channel, const uint8_t bin)
+{
+    if (channel >= METER_CHANNELS || bin >= METER_BINS)
+    {
+        return 0;
+    }
+    return totals[channel][bin] + ticks[channel][bin] / TIMER_FREQUENCY;
+}
+
+
+/* Returns the lifetime on time in seconds */
+uint32_t MeterOnTime(const uint8_t channel)
+{
+    uint32_t time = 0;
+    uint8_t bin;
+    for (bin=0; bin<METER_BINS; ++bin)
+    {
+        time += MeterBinTime(channel, bin);
+    }
+    return time;
+}
+
+
+/* Returns the lifetime energy delivered by the channel in Wh - including the energy not yet committed */
+uint32_t MeterEnergy(const uint8_t channel)
+{
+    if (channel >= METER_CHANNELS)
+    {
+        return 0;
+    }
+    return (energy[channel] + (SwitchChannelEnergy(channel) - energy_read[channel])) / SECONDS_PER_HOUR;
+}
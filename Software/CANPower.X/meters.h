@@ -0,0 +1,75 @@
+/*
+ * File:   meters.h
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ *
+ * Lifetime hour meters and energy totals for the two switch channels.
+ * The time each channel is on is accumulated in RAM, once per timer tick, in one of METER_BINS duty bands.
+ * The accumulated time is committed only by MetersCommit (at ignition off) and every METER_COMMIT_INTERVAL
+ * minutes - as a journal record of the seconds added to each band since the last commit. MetersTasks writes the
+ * records to flash in the background and MetersFlush writes any left before the power is cut.
+ * Every few commits the totals are checkpointed to the emulated EEPROM, along with the journal sequence number,
+ * so the lifetime totals are rebuilt at boot from the checkpoint and the few delta records appended after it.
+ * The energy totals are the switch chip's measurement (SwitchChannelEnergy) committed and checkpointed alongside
+ * the times in the same way.
+ *
+ * The EEPROM, journal and timer modules must be initialised before this one.
+ * MC06XSD200Tasks reports each channel's level with MetersTick. MetersTasks must be invoked once per timer tick.
+ *
+ */
+
+#ifndef METERS_H
+#define	METERS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+#define METER_CHANNELS 2
+#define METER_BINS 4 // duty bands - up to a quarter, a half, three quarters and fully on
+
+// emulated EEPROM words used for the checkpoint - after the application's settings
+#define METERS_EEPROM_ADDRESS 2
+#define METERS_EEPROM_SIZE (METER_CHANNELS * METER_BINS * 2 + METER_CHANNELS * 2 + 2)
+
+
+/* Must be called once at initialisation time after the EEPROM, journal and timer - rebuilds the totals */
+void InitializeMeters(void);
+
+
+/* Must be invoked once per timer tick - commits at the coarse interval and writes the commits to flash */
+void MetersTasks(void);
+
+
+/* Invoked once per timer tick for each channel with its PWM level (0 - off to 256 - fully on)
+ * while the switch chip is driving the outputs */
+void MetersTick(const uint8_t channel, const uint16_t level);
+
+
+/* Commits the time and energy accumulated since the last commit - MetersTasks writes it to flash */
+void MetersCommit(void);
+
+
+/* Writes everything committed that's not yet in flash - stalls until it is. For before the power is cut. */
+void MetersFlush(void);
+
+
+/* functions return lifetime totals in seconds - including the time not yet committed */
+uint32_t MeterBinTime(const uint8_t channel, const uint8_t bin);
+uint32_t MeterOnTime(const uint8_t channel);
+
+
+/* Returns the lifetime energy delivered by the channel in Wh - as measured by the switch chip */
+uint32_t MeterEnergy(const uint8_t channel);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* METERS_H */
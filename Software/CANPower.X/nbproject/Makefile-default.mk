@@ -57,17 +57,17 @@ OBJECTDIR=build/${CND_CONF}/${IMAGE_TYPE}
 DISTDIR=dist/${CND_CONF}/${IMAGE_TYPE}
 
 # Source Files Quoted if spaced
-SOURCEFILES_QUOTED_IF_SPACED=main.c ports.c configuration_bits.c timer.c LEDs.c SPI.c CAN.c hardware.c MC06XSD200.c application.c EEPROM.c
+SOURCEFILES_QUOTED_IF_SPACED=main.c ports.c configuration_bits.c timer.c LEDs.c SPI.c CAN.c hardware.c MC06XSD200.c application.c EEPROM.c energy.c events.c ADC.c logger.c faults.c meters.c journal.c flash.c
 
 # Object Files Quoted if spaced
-OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/main.o ${OBJECTDIR}/ports.o ${OBJECTDIR}/configuration_bits.o ${OBJECTDIR}/timer.o ${OBJECTDIR}/LEDs.o ${OBJECTDIR}/SPI.o ${OBJECTDIR}/CAN.o ${OBJECTDIR}/hardware.o ${OBJECTDIR}/MC06XSD200.o ${OBJECTDIR}/application.o ${OBJECTDIR}/EEPROM.o
-POSSIBLE_DEPFILES=${OBJECTDIR}/main.o.d ${OBJECTDIR}/ports.o.d ${OBJECTDIR}/configuration_bits.o.d ${OBJECTDIR}/timer.o.d ${OBJECTDIR}/LEDs.o.d ${OBJECTDIR}/SPI.o.d ${OBJECTDIR}/CAN.o.d ${OBJECTDIR}/hardware.o.d ${OBJECTDIR}/MC06XSD200.o.d ${OBJECTDIR}/application.o.d ${OBJECTDIR}/EEPROM.o.d
+OBJECTFILES_QUOTED_IF_SPACED=${OBJECTDIR}/main.o ${OBJECTDIR}/ports.o ${OBJECTDIR}/configuration_bits.o ${OBJECTDIR}/timer.o ${OBJECTDIR}/LEDs.o ${OBJECTDIR}/SPI.o ${OBJECTDIR}/CAN.o ${OBJECTDIR}/hardware.o ${OBJECTDIR}/MC06XSD200.o ${OBJECTDIR}/application.o ${OBJECTDIR}/EEPROM.o ${OBJECTDIR}/energy.o ${OBJECTDIR}/events.o ${OBJECTDIR}/journal.o ${OBJECTDIR}/flash.o ${OBJECTDIR}/meters.o ${OBJECTDIR}/faults.o ${OBJECTDIR}/logger.o ${OBJECTDIR}/ADC.o
+POSSIBLE_DEPFILES=${OBJECTDIR}/main.o.d ${OBJECTDIR}/ports.o.d ${OBJECTDIR}/configuration_bits.o.d ${OBJECTDIR}/timer.o.d ${OBJECTDIR}/LEDs.o.d ${OBJECTDIR}/SPI.o.d ${OBJECTDIR}/CAN.o.d ${OBJECTDIR}/hardware.o.d ${OBJECTDIR}/MC06XSD200.o.d ${OBJECTDIR}/application.o.d ${OBJECTDIR}/EEPROM.o.d ${OBJECTDIR}/energy.o.d ${OBJECTDIR}/events.o.d ${OBJECTDIR}/journal.o.d ${OBJECTDIR}/flash.o.d ${OBJECTDIR}/meters.o.d ${OBJECTDIR}/faults.o.d ${OBJECTDIR}/logger.o.d ${OBJECTDIR}/ADC.o.d
 
 # Object Files
-OBJECTFILES=${OBJECTDIR}/main.o ${OBJECTDIR}/ports.o ${OBJECTDIR}/configuration_bits.o ${OBJECTDIR}/timer.o ${OBJECTDIR}/LEDs.o ${OBJECTDIR}/SPI.o ${OBJECTDIR}/CAN.o ${OBJECTDIR}/hardware.o ${OBJECTDIR}/MC06XSD200.o ${OBJECTDIR}/application.o ${OBJECTDIR}/EEPROM.o
+OBJECTFILES=${OBJECTDIR}/main.o ${OBJECTDIR}/ports.o ${OBJECTDIR}/configuration_bits.o ${OBJECTDIR}/timer.o ${OBJECTDIR}/LEDs.o ${OBJECTDIR}/SPI.o ${OBJECTDIR}/CAN.o ${OBJECTDIR}/hardware.o ${OBJECTDIR}/MC06XSD200.o ${OBJECTDIR}/application.o ${OBJECTDIR}/EEPROM.o ${OBJECTDIR}/energy.o ${OBJECTDIR}/events.o ${OBJECTDIR}/journal.o ${OBJECTDIR}/flash.o ${OBJECTDIR}/meters.o ${OBJECTDIR}/faults.o ${OBJECTDIR}/logger.o ${OBJECTDIR}/ADC.o
 
 # Source Files
-SOURCEFILES=main.c ports.c configuration_bits.c timer.c LEDs.c SPI.c CAN.c hardware.c MC06XSD200.c application.c EEPROM.c
+SOURCEFILES=main.c ports.c configuration_bits.c timer.c LEDs.c SPI.c CAN.c hardware.c MC06XSD200.c application.c EEPROM.c energy.c events.c ADC.c logger.c faults.c meters.c journal.c flash.c
 
 
 CFLAGS=
@@ -171,6 +171,62 @@ ${OBJECTDIR}/EEPROM.o: EEPROM.c  nbproject/Makefile-${CND_CONF}.mk
 	${MP_CC} $(MP_EXTRA_CC_PRE)  EEPROM.c  -o ${OBJECTDIR}/EEPROM.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/EEPROM.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1    -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
 	@${FIXDEPS} "${OBJECTDIR}/EEPROM.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
 	
+${OBJECTDIR}/energy.o: energy.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/energy.o.d 
+	@${RM} ${OBJECTDIR}/energy.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  energy.c  -o ${OBJECTDIR}/energy.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/energy.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1    -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/energy.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/events.o: events.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/events.o.d 
+	@${RM} ${OBJECTDIR}/events.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  events.c  -o ${OBJECTDIR}/events.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/events.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1    -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/events.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/ADC.o: ADC.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/ADC.o.d 
+	@${RM} ${OBJECTDIR}/ADC.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  ADC.c  -o ${OBJECTDIR}/ADC.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/ADC.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1    -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/ADC.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/logger.o: logger.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/logger.o.d 
+	@${RM} ${OBJECTDIR}/logger.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  logger.c  -o ${OBJECTDIR}/logger.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/logger.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1    -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/logger.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/faults.o: faults.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/faults.o.d 
+	@${RM} ${OBJECTDIR}/faults.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  faults.c  -o ${OBJECTDIR}/faults.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/faults.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1    -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/faults.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/meters.o: meters.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/meters.o.d 
+	@${RM} ${OBJECTDIR}/meters.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  meters.c  -o ${OBJECTDIR}/meters.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/meters.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1    -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/meters.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/journal.o: journal.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/journal.o.d 
+	@${RM} ${OBJECTDIR}/journal.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  journal.c  -o ${OBJECTDIR}/journal.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/journal.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1    -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/journal.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/flash.o: flash.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/flash.o.d 
+	@${RM} ${OBJECTDIR}/flash.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  flash.c  -o ${OBJECTDIR}/flash.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/flash.o.d"      -g -D__DEBUG -D__MPLAB_DEBUGGER_PK3=1    -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/flash.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
 else
 ${OBJECTDIR}/main.o: main.c  nbproject/Makefile-${CND_CONF}.mk
 	@${MKDIR} "${OBJECTDIR}" 
@@ -249,6 +305,62 @@ ${OBJECTDIR}/EEPROM.o: EEPROM.c  nbproject/Makefile-${CND_CONF}.mk
 	${MP_CC} $(MP_EXTRA_CC_PRE)  EEPROM.c  -o ${OBJECTDIR}/EEPROM.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/EEPROM.o.d"        -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
 	@${FIXDEPS} "${OBJECTDIR}/EEPROM.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
 	
+${OBJECTDIR}/energy.o: energy.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/energy.o.d 
+	@${RM} ${OBJECTDIR}/energy.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  energy.c  -o ${OBJECTDIR}/energy.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/energy.o.d"        -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/energy.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/events.o: events.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/events.o.d 
+	@${RM} ${OBJECTDIR}/events.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  events.c  -o ${OBJECTDIR}/events.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/events.o.d"        -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/events.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/ADC.o: ADC.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/ADC.o.d 
+	@${RM} ${OBJECTDIR}/ADC.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  ADC.c  -o ${OBJECTDIR}/ADC.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/ADC.o.d"        -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/ADC.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/logger.o: logger.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/logger.o.d 
+	@${RM} ${OBJECTDIR}/logger.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  logger.c  -o ${OBJECTDIR}/logger.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/logger.o.d"        -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/logger.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/faults.o: faults.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/faults.o.d 
+	@${RM} ${OBJECTDIR}/faults.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  faults.c  -o ${OBJECTDIR}/faults.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/faults.o.d"        -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/faults.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/meters.o: meters.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/meters.o.d 
+	@${RM} ${OBJECTDIR}/meters.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  meters.c  -o ${OBJECTDIR}/meters.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/meters.o.d"        -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/meters.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/journal.o: journal.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/journal.o.d 
+	@${RM} ${OBJECTDIR}/journal.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  journal.c  -o ${OBJECTDIR}/journal.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/journal.o.d"        -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/journal.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
+${OBJECTDIR}/flash.o: flash.c  nbproject/Makefile-${CND_CONF}.mk
+	@${MKDIR} "${OBJECTDIR}" 
+	@${RM} ${OBJECTDIR}/flash.o.d 
+	@${RM} ${OBJECTDIR}/flash.o 
+	${MP_CC} $(MP_EXTRA_CC_PRE)  flash.c  -o ${OBJECTDIR}/flash.o  -c -mcpu=$(MP_PROCESSOR_OPTION)  -MMD -MF "${OBJECTDIR}/flash.o.d"        -g -omf=elf -DXPRJ_default=$(CND_CONF)  -legacy-libc  $(COMPARISON_BUILD)  -O0 -msmart-io=1 -Wall -msfr-warn=off  
+	@${FIXDEPS} "${OBJECTDIR}/flash.o.d" $(SILENT)  -rsi ${MP_CC_DIR}../ 
+	
 endif
 
 # ------------------------------------------------------------------------------------
@@ -18,11 +18,12 @@ void InitializePorts(void)
     // except for the CS outputs, LED outputs, and CAN standby which are driven high
     LATA = 0x0000; 
     LATB = 0x1400; // for CS0 and CAN standby
-    LATC = 0x0018; // for LED0 and LED1
+    LATC = 0x0058; // for CS1, LED0 and LED1
     ODCC = 0x0018; // LED0 and LED1 open drain (for external pull ups)
     TRISA = 0x008C;
     TRISB = 0x4180;
     TRISC = 0x0100;
+    AD1PCFGL = 0xFBFF; // all digital except AN10 for the switch chip current sense (CSNS)
 
     // map the selectable pins after unlocking the pin configuration in the OSCCON register
     uint8_t oscconl_value;
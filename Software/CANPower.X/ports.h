@@ -27,6 +27,9 @@ extern "C" {
 #define PORT_CS0 _LATB12
 #define CS0_PORT_ACTIVE 0
 #define CS0_PORT_INACTIVE 1
+#define PORT_CS1 _LATC6 // spare pin for a second SPI device
+#define CS1_PORT_ACTIVE 0
+#define CS1_PORT_INACTIVE 1
 
 // CAN device output port positions
 #define PORT_CAN_STBY _LATB10
@@ -0,0 +1,61 @@
+/* 
+ * File:   protothread.h
+ * Author: Raph Weyman
+ *
+ * Created on 18 October 2026
+ * 
+ * Stackless co-routines (protothreads) for writing driver sequences linearly.
+ * 
+ * A protothread is a function taking a pointer to a pt_t which holds the point at which
+ * the thread is to resume. The body is wrapped in PT_BEGIN and PT_END and can wait and yield
+ * with the macros below. Each invocation runs the thread on from where it last waited until it
+ * next waits, yields, exits or ends - so a sequence continues as soon as the thread is invoked
+ * with its wait condition satisfied rather than one step per timer tick.
+ * 
+ * Implemented as a switch statement with case labels at the wait points (line numbers) so:
+ *  - local variables are not preserved across waits and yields - use statics.
+ *  - switch statements can't be used in the thread body around a wait or yield.
+ *  - only one wait or yield per source line.
+ * 
+ */
+
+#ifndef PROTOTHREAD_H
+#define	PROTOTHREAD_H
+
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+// protothread state - the point at which to resume. Zero to start at the beginning.
+typedef uint16_t pt_t;
+
+// returned by the protothread function
+typedef enum {PT_WAITING=0, PT_YIELDED, PT_EXITED, PT_ENDED} pt_status_t;
+
+
+// (re)starts a protothread from the beginning the next time it is invoked
+#define PT_INIT(pt) (*(pt) = 0)
+
+// wraps the protothread function body
+#define PT_BEGIN(pt) switch (*(pt)) { case 0:
+#define PT_END(pt) } *(pt) = 0; return PT_ENDED
+
+// returns until the condition is true when the protothread is invoked
+#define PT_WAIT_UNTIL(pt, condition) do {*(pt) = __LINE__; case __LINE__: if (!(condition)) return PT_WAITING;} while (0)
+#define PT_WAIT_WHILE(pt, condition) PT_WAIT_UNTIL((pt), !(condition))
+
+// returns once - continuing from here the next time the protothread is invoked
+#define PT_YIELD(pt) do {*(pt) = __LINE__; return PT_YIELDED; case __LINE__: ;} while (0)
+
+// returns and starts from the beginning the next time the protothread is invoked
+#define PT_EXIT(pt) do {*(pt) = 0; return PT_EXITED;} while (0)
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* PROTOTHREAD_H */
@@ -13,6 +13,7 @@
 #include "xc.h"
 #include "hardware.h"
 #include "interrupts.h"
+#include "events.h"
 
 
 // free running timer incremented every timer period.
@@ -24,6 +25,9 @@ static uint16_t minute;
 // keeps track of the ticks for the minute timer
 static uint16_t time_last_minute;
 
+// free running count of timer hardware counts at the start of the current tick
+static uint32_t tick_start_count;
+
 
 // Returns the current value of the timer.
 uint16_t Timer(void)
@@ -38,6 +42,21 @@ uint16_t Minutes(void)
     return minute;
 }
 
+// Returns a free running count of the timer hardware counts at TIMER_COUNT_FREQUENCY.
+// Re-reads if the timer interrupt changes the tick start count part way through.
+uint32_t TimerCount(void)
+{
+    uint32_t start_count;
+    uint16_t count;
+    do
+    {
+        start_count = tick_start_count;
+        count = TMR4;
+    }
+    while (start_count != tick_start_count);
+    return start_count + count;
+}
+
 
 // Invoke once to initialize timer module.
 // Timer interrupt is started immediately.
@@ -46,11 +65,12 @@ void InitializeTimer(void)
     timer = 0;
     minute = 0;
     time_last_minute = 0;
+    tick_start_count = 0;
     T4CONbits.TON = 0;
     T4CONbits.TSIDL = 0; // don't stop on idle - the main loop idles and requires a regular interrupt to wake it up again
     T4CONbits.TCKPS = 0b01; //prescaler 8
     TMR4 = 0;
-    PR4 = (FCY * TIMER_PERIOD / 8 / 1000);
+    PR4 = TIMER_COUNTS_PER_TICK - 1; // the period is PR4 + 1 counts - exactly TIMER_PERIOD
     _T4IF = 0;
     _T4IP = TIMER_INTERRUPT_PRIORITY;
     _T4IE = 1;
@@ -62,10 +82,12 @@ void InitializeTimer(void)
 void __attribute__((interrupt(no_auto_psv))) _T4Interrupt(void)
 {
     ++timer;
-    if ((timer - time_last_minute) > TICKS_PER_MINUTE)
+    tick_start_count += TIMER_COUNTS_PER_TICK;
+    if ((uint16_t)(timer - time_last_minute) > TICKS_PER_MINUTE)
     {
         ++minute;
         time_last_minute += TICKS_PER_MINUTE;
     }
+    EventSignal(EVENT_BIT_TIMER);
     _T4IF = 0;
 }
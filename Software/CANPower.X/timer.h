@@ -13,6 +13,7 @@
 #define	TIMER_H
 
 #include <stdint.h>
+#include "hardware.h"
 
 #ifdef	__cplusplus
 extern "C" {
@@ -24,6 +25,10 @@ extern "C" {
 #define TIMER_FREQUENCY (1000 / TIMER_PERIOD) // Hz
 #define TICKS_PER_MINUTE (60000 / TIMER_PERIOD)
 
+// hardware counts for finer grained timing than the timer tick (timer pre-scaler is 8)
+#define TIMER_COUNT_FREQUENCY (FCY / 8) // Hz
+#define TIMER_COUNTS_PER_TICK (TIMER_COUNT_FREQUENCY / TIMER_FREQUENCY)
+
 
 // Invoke once to initialize timer module.
 // Timer interrupt is started immediately.
@@ -38,6 +43,11 @@ uint16_t Timer(void);
 // and rolls back through zero on overflow
 uint16_t Minutes(void);
 
+// Returns a free running count of the timer hardware counts at TIMER_COUNT_FREQUENCY.
+// Rolls back around to zero on overflow so use differences only.
+// Not to be used from an interrupt routine at or above the timer interrupt priority.
+uint32_t TimerCount(void);
+
 #ifdef	__cplusplus
 }
 #endif